@@ -39,6 +39,9 @@ u64 boot_ttbr1_l0[PTP_ENTRIES] ALIGN(PTP_SIZE);
 u64 boot_ttbr1_l1[PTP_ENTRIES] ALIGN(PTP_SIZE);
 u64 boot_ttbr1_l2[PTP_ENTRIES] ALIGN(PTP_SIZE);
 
+/* 全为无效项的页表页，内核切换 TTBR1 时临时使用（见 replace_ttbr1_el1） */
+u64 empty_ttbr1_l0[PTP_ENTRIES] ALIGN(PTP_SIZE);
+
 /*
  *  bit[0]:    有效位，表示该页表项是否有效，有效表示指向下一级页表、内存页或内存块
  *  bit[1]:    表示该页表项是否指向下一级页表
@@ -1,5 +1,6 @@
 #include <irq/irq.h>
 #include <arch/machine/esr.h>
+#include <arch/machine/registers.h>
 #include <common/utils.h>
 #include <common/macro.h>
 #include "irq_entry.h"
@@ -60,7 +61,8 @@ u64 handle_sync(int type, u64 esr, u64 address)
 		break;
 	case ESR_EL1_EC_IABT_LEL:
 		kdebug("Instruction Abort from a lower Exception level\n");
-		// do_page_fault(esr, address, type, &fix_addr);
+		/* address 是出错指令的地址（ELR_EL1），出错的虚拟地址记录在 FAR_EL1 中 */
+		do_page_fault(esr, read_sysreg(far_el1), type, &fix_addr);
 		return address;
 	case ESR_EL1_EC_IABT_CEL:
 		kinfo("Instruction Abort from current Exception level\n");
@@ -70,7 +72,7 @@ u64 handle_sync(int type, u64 esr, u64 address)
 		break;
 	case ESR_EL1_EC_DABT_LEL:
 		kdebug("Data Abort from a lower Exception level\n");
-		// do_page_fault(esr, address, type, &fix_addr);
+		do_page_fault(esr, read_sysreg(far_el1), type, &fix_addr);
 		return address;
 	case ESR_EL1_EC_DABT_CEL:
 		kdebug("Data Abort from a current Exception level\n");
@@ -28,6 +28,7 @@
 void set_exception_vector(void);
 void enable_irq(void);
 void disable_irq(void);
+u64 handle_sync(int type, u64 esr, u64 address);
 /* fault handlers */
 void do_page_fault(u64 esr, u64 fault_addr, int type, u64 *fix_addr);
 
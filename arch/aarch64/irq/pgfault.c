@@ -0,0 +1,141 @@
+#include <common/errno.h>
+#include <common/kprint.h>
+#include <common/lock.h>
+#include <common/macro.h>
+#include <common/types.h>
+#include <arch/machine/esr.h>
+#include <arch/machine/registers.h>
+#include <arch/mmu.h>
+#include <arch/sync.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/ptp_cache.h>
+#include <mm/tlb.h>
+#include <mm/vmspace.h>
+#include "irq_entry.h"
+
+static int get_prop_run(struct pgtbl_run *run, void *arg)
+{
+	*(vmr_prop_t *)arg = run->flags;
+	return 1;
+}
+
+/**
+ * @brief: 判断当前页表中va的映射是否已经允许这次访问，调用者需持有 vmspace 的读锁
+ * @param access: VMR_READ、VMR_WRITE 或 VMR_EXEC
+*/
+static bool pte_permits(void *pgtbl, vaddr_t va, vmr_prop_t access)
+{
+	vmr_prop_t prop;
+
+	if (walk_range_in_pgtbl(pgtbl, va, 1, get_prop_run, &prop) != 1)
+		return false;
+	/* 写时复制的页还没有复制，可写权限只记录在 SW_WRITE 中 */
+	if ((access & VMR_WRITE) && (prop & VMR_COW))
+		return false;
+	return (prop & access) == access;
+}
+
+/**
+ * @brief: 处理用户地址上的缺页异常
+ * @param esr: ESR_EL1
+ * @param fault_addr: 出错的虚拟地址（FAR_EL1）
+ * @param type: 异常类型
+ * @param fix_addr: 内核访问用户内存出错时的修复地址，目前没有使用
+ *
+ * - 转换错误：当前地址空间的匿名区域中第一次访问的页，分配并映射（handle_anon_fault）
+ * - 访问标志错误：硬件不更新访问标志时，设置被工作集扫描清除的访问标志（handle_access_fault）
+ * - 写入写时复制的页时复制该页（handle_cow_fault）
+ * - 权限提升时没有失效TLB，残留的旧条目造成的假权限错误只需失效本CPU上的条目。
+ *   只有当前的页表项确实允许这次访问时才是假错误，真正越权的访问（如写入只读页、执行不可执行的页）不做处理
+ * 处理完成后返回并重新执行出错的指令。
+ * 缺页处理都只持有 vmspace 的读锁，页表项的修改由页表页的锁（split page-table lock）保护，
+ * 同一地址空间中不同区域上的缺页可以在多个CPU上并发处理
+*/
+void do_page_fault(u64 esr, u64 fault_addr, int type, u64 *fix_addr)
+{
+	u32 ec = GET_ESR_EL1_EC(esr);
+	u32 fsc = GET_ESR_EL1_FSC(esr);
+	bool write = (ec == ESR_EL1_EC_DABT_LEL || ec == ESR_EL1_EC_DABT_CEL) &&
+		     GET_ESR_EL1_WnR(esr) == DABT_BY_WRITE;
+	bool exec = ec == ESR_EL1_EC_IABT_LEL || ec == ESR_EL1_EC_IABT_CEL;
+	vmr_prop_t access = exec ? VMR_EXEC : write ? VMR_WRITE : VMR_READ;
+	struct vmspace *vms = get_current_vmspace();
+	void *pgtbl = get_current_user_pgtbl();
+	long rss = 0;
+	int ret = -EFAULT;
+
+	if (fault_addr < USER_SPACE_END && IS_TRANS_FAULT(fsc) && vms != NULL &&
+	    handle_anon_fault(vms, fault_addr, access) == 0)
+		return;
+
+	if (fault_addr >= USER_SPACE_END || (!IS_ACCESS_FAULT(fsc) && !IS_PERM_FAULT(fsc)))
+		goto unhandled;
+
+	/* 防止处理期间其他CPU解除映射、回收页表页 */
+	if (vms != NULL)
+		read_lock(&vms->lock);
+	if (IS_ACCESS_FAULT(fsc)) {
+		ret = handle_access_fault(pgtbl, fault_addr);
+	} else {
+		if (write)
+			ret = handle_cow_fault(pgtbl, fault_addr, &rss);
+		if (ret != 0 && pte_permits(pgtbl, fault_addr, access)) {
+			flush_tlb_spurious_fault(fault_addr);
+			ret = 0;
+		}
+	}
+	if (vms != NULL) {
+		atomic_fetch_add_64(&vms->rss, rss);
+		read_unlock(&vms->lock);
+	}
+	if (ret == 0)
+		return;
+unhandled:
+	kwarn("unhandled page fault: type %d, esr 0x%lx, addr 0x%lx\n", type, esr, fault_addr);
+}
+
+#define PGFAULT_TEST_VA (0x10000000UL)
+
+/**
+ * @brief: 经过异常入口处理缺页：出错的虚拟地址从 FAR_EL1 读取，与出错指令的地址（ELR_EL1）无关
+*/
+void pgfault_test(void)
+{
+	void *saved_pgtbl = get_current_user_pgtbl();
+	void *pgtbl = alloc_ptp();
+	void *child = alloc_ptp();
+	struct page *pages[2];
+	paddr_t pa[2], child_pa;
+	u64 esr;
+
+	assert(pgtbl != NULL && child != NULL);
+	for (int i = 0; i < 2; i++) {
+		pages[i] = virt_to_page(get_pages(0));
+		assert(pages[i] != NULL);
+		/* 由页表管理的页，写时复制时计数 */
+		pages[i]->refcount = 1;
+		pa[i] = virt_to_phys(page_to_virt(pages[i]));
+		assert(map_range_in_pgtbl_user(pgtbl, PGFAULT_TEST_VA + i * PAGE_SIZE, pa[i], PAGE_SIZE,
+					       VMR_READ | VMR_WRITE, NULL) == 0);
+	}
+	assert(clone_range_in_pgtbl_cow(child, pgtbl, PGFAULT_TEST_VA, 2 * PAGE_SIZE, NULL, NULL) == 0);
+	set_page_table(virt_to_phys(child));
+
+	/* 位于第二页的指令写入第一页：只复制第一页，返回地址不变 */
+	esr = ((u64)ESR_EL1_EC_DABT_LEL << ESR_EL1_EC_SHIFT) | ((u64)DABT_BY_WRITE << ESR_EL1_WnR_SHIFT) |
+	      DFSC_PERM_FAULT_L3;
+	write_sysreg(PGFAULT_TEST_VA + 8, far_el1);
+	assert(handle_sync(SYNC_EL0_64, esr, PGFAULT_TEST_VA + PAGE_SIZE) == PGFAULT_TEST_VA + PAGE_SIZE);
+	assert(query_in_pgtbl(child, PGFAULT_TEST_VA, &child_pa, NULL) == 0 && child_pa != pa[0]);
+	assert(query_in_pgtbl(child, PGFAULT_TEST_VA + PAGE_SIZE, &child_pa, NULL) == 0 && child_pa == pa[1]);
+	assert(pages[0]->refcount == 1 && pages[1]->refcount == 2);
+
+	set_page_table(virt_to_phys(saved_pgtbl));
+	assert(unmap_range_in_pgtbl(child, PGFAULT_TEST_VA, 2 * PAGE_SIZE, NULL) == 0);
+	assert(unmap_range_in_pgtbl(pgtbl, PGFAULT_TEST_VA, 2 * PAGE_SIZE, NULL) == 0);
+	free_ptp(child);
+	free_ptp(pgtbl);
+	kinfo("page fault test passed\n");
+}
@@ -26,6 +26,21 @@ void enable_cpu_cnt(void)
 	asm volatile("msr pmcntenset_el0, %0" ::"r"(PMCNTENSET_EL0_C));
 }
 
+/**
+ * @brief 让第 idx 个事件计数器统计 event 事件，并将其清零
+ * @param idx 事件计数器编号，需小于 PMCR_EL0.N
+ * @param event 事件编号，见 PMU_EVENT_*
+ */
+void pmu_enable_event_counter(u32 idx, u32 event)
+{
+	asm volatile("msr pmselr_el0, %0" ::"r"((u64)idx));
+	asm volatile("isb");
+	asm volatile("msr pmxevtyper_el0, %0" ::"r"((u64)event));
+	asm volatile("msr pmxevcntr_el0, %0" ::"r"(0UL));
+	asm volatile("msr pmcntenset_el0, %0" ::"r"(1UL << idx));
+	asm volatile("isb");
+}
+
 void disable_cpu_cnt(void)
 {
 	/* 禁用所有计数器 */
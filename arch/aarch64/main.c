@@ -1,6 +1,7 @@
 #include <arch/machine/smp.h>
 #include <arch/machine/pmu.h>
 #include <arch/mm/page_table.h>
+#include <arch/mm/asid.h>
 #include <irq/irq.h>
 #include <irq/timer.h>
 #include <arch/boot.h>
@@ -11,6 +12,10 @@
 #include <common/lock.h>
 #include <common/poweroff.h>
 #include <mm/mm.h>
+#include <mm/uaccess.h>
+#include <lib/memops.h>
+#include <lib/rbtree.h>
+#include <lib/string.h>
 
 /* 临时内核栈，真正栈帧由KSTACKx_ADDR(cpuid)计算，此时还没有将其写入页表 */
 char cpu_stacks[PLAT_CPU_NUM][CPU_STACK_SIZE] ALIGN(STACK_ALIGNMENT);
@@ -36,13 +41,31 @@ void main(paddr_t boot_flag, void *physmem_info)
 	init_per_cpu_info(0);
 	kinfo("per-CPU info init finished\n");
 
+	/* 内存管理大量使用memset/memcpy，先检查它们的正确性 */
+	memops_test();
+	string_test();
+	rbtree_test();
+
+	/* 硬件支持时开启访问标志和脏状态的硬件更新，页表测试需要知道是否开启 */
+	init_hw_access_dirty();
+
 	/* Init mm */
 	mm_init(physmem_info);
 	kinfo("mm init finished\n");
 
+	/* 用内核自己的页表替换启动页表，之后的内核映射（如内核栈）都建立在新页表中 */
+	init_kernel_pgtbl();
+	kernel_pgtbl_test();
+	print_pgtbl_stats(get_kernel_pgtbl());
+
+	init_asid();
+	asid_test();
+	uaccess_test();
+	pgfault_test();
+
 	/* 将内核栈映射到KSTACK_BASE以上的地址，确保发生栈溢出的时候不会破坏内核数据 */
-	map_range_in_pgtbl_kernel((void *)((unsigned long)boot_ttbr1_l0 + KBASE), KSTACKx_ADDR(0),
-				  (unsigned long)(cpu_stacks[0]) - KBASE, CPU_STACK_SIZE, VMR_READ | VMR_WRITE);
+	map_range_in_pgtbl_kernel(get_kernel_pgtbl(), KSTACKx_ADDR(0), (unsigned long)(cpu_stacks[0]) - KBASE,
+				  CPU_STACK_SIZE, VMR_READ | VMR_WRITE);
 
 	/* 初始化 */
 	arch_interrupt_init();
@@ -52,6 +75,13 @@ void main(paddr_t boot_flag, void *physmem_info)
 	pmu_init();
 	kinfo("pmu init finished\n");
 
+#ifdef KMK_BENCH
+	memops_bench();
+	string_bench();
+	mm_bench();
+	asid_bench();
+#endif
+
 	/// 关机
 	plat_poweroff();
 }
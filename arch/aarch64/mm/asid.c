@@ -0,0 +1,193 @@
+#include <common/types.h>
+#include <common/macro.h>
+#include <common/bitops.h>
+#include <common/kprint.h>
+#include <common/lock.h>
+#include <common/utils.h>
+#include <arch/sync.h>
+#include <arch/machine/smp.h>
+#include <arch/machine/registers.h>
+#include <arch/mm/asid.h>
+
+/*
+ * ASID 分配器（参考 Linux arch/arm64/mm/context.c）
+ *
+ * 每个用户页表在第一次被切换时分配一个ASID，写入 TTBR0_EL1[63:48]。由于用户页表项都带有 nG 标记，
+ * TLB 条目会以ASID区分，切换地址空间时不再需要刷新TLB。
+ *
+ * ASID 用完后，将全局的代（generation）加一，清空位图并做一次广播的TLB刷新，之后所有旧代的
+ * context_id 在下次切换时都会重新分配ASID。各CPU上正在运行的ASID会被保留到新的一代中，
+ * 因为它们的TLB条目在刷新之后可能又被重新填充了。
+ */
+
+#define MAX_ASID_BITS 16
+#define NUM_ASIDS (1UL << asid_bits)
+#define ASID_MASK (NUM_ASIDS - 1)
+#define ASID_FIRST_VERSION NUM_ASIDS
+
+#define ctx_asid(id) ((id) & ASID_MASK)
+#define ctx_generation_match(id) (!(((id) ^ asid_generation) >> asid_bits))
+
+static u32 asid_bits;
+static volatile u64 asid_generation;
+static unsigned long asid_map[BITS_TO_LONGS(1UL << MAX_ASID_BITS)];
+/* 下一次从哪个ASID开始查找空闲位 */
+static unsigned long cur_idx = 1;
+
+/* 各CPU上当前使用的 context_id，发生回绕时被清0 */
+static u64 active_asids[PLAT_CPU_NUM];
+/* 回绕时各CPU正在使用的 context_id，需要保留到新的一代 */
+static u64 reserved_asids[PLAT_CPU_NUM];
+
+static struct lock asid_lock;
+
+/**
+ * @brief: 根据 ID_AA64MMFR0_EL1.ASIDBits 确定ASID位宽，并初始化分配器
+*/
+void init_asid(void)
+{
+	u64 mmfr0 = read_sysreg(id_aa64mmfr0_el1);
+	u64 fld = (mmfr0 >> ID_AA64MMFR0_EL1_ASIDBITS_SHIFT) & ID_AA64MMFR0_EL1_ASIDBITS_MASK;
+
+	asid_bits = fld == ID_AA64MMFR0_EL1_ASIDBITS_16 ? 16 : 8;
+	asid_generation = ASID_FIRST_VERSION;
+	memset(asid_map, 0, sizeof(asid_map));
+	/* ASID 0 保留给 boot_ttbr0_l0 */
+	set_bit(0, asid_map);
+	lock_init(&asid_lock);
+
+	kinfo("%u-bit ASIDs, %lu ASIDs available\n", asid_bits, NUM_ASIDS - 1);
+}
+
+u32 get_asid_bits(void)
+{
+	return asid_bits;
+}
+
+/**
+ * @brief: 取出 context_id 中的ASID。context_id 可能属于旧的一代，此时该ASID可能已经分配给了其他地址空间，
+ *         按它失效TLB只会多失效一些条目，不影响正确性
+*/
+u64 context_id_to_asid(u64 context_id)
+{
+	return ctx_asid(context_id);
+}
+
+/**
+ * @brief: ASID 用完时调用，清空位图，保留各CPU正在使用的ASID，然后广播刷新所有CPU的TLB。
+ *         调用者需持有 asid_lock
+*/
+static void flush_context(void)
+{
+	u64 asid;
+
+	memset(asid_map, 0, BITS_TO_LONGS(NUM_ASIDS) * sizeof(unsigned long));
+	set_bit(0, asid_map);
+
+	for (int cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+		asid = atomic_exchange_64((s64 *)&active_asids[cpu], 0);
+		/*
+		 * active 为0说明该CPU在上一次回绕后还没有切换过地址空间，仍在使用上一次保留的ASID，
+		 * 需要继续保留它
+		 */
+		if (asid == 0)
+			asid = reserved_asids[cpu];
+		set_bit(ctx_asid(asid), asid_map);
+		reserved_asids[cpu] = asid;
+	}
+
+	/* 一次广播刷新即可清除所有CPU上旧代的TLB条目 */
+	dsb(ishst);
+	asm volatile("tlbi vmalle1is" ::: "memory");
+	dsb(ish);
+	isb();
+}
+
+/**
+ * @brief: 检查 context_id 是否是某个CPU回绕时保留的ASID，如果是，将其更新为新一代的 context_id
+*/
+static bool check_update_reserved_asid(u64 asid, u64 newasid)
+{
+	bool hit = false;
+
+	for (int cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+		if (reserved_asids[cpu] == asid) {
+			hit = true;
+			reserved_asids[cpu] = newasid;
+		}
+	}
+	return hit;
+}
+
+/**
+ * @brief: 为 context_id 分配当前代的ASID，调用者需持有 asid_lock
+ * @return: 新的 context_id
+*/
+static u64 new_context(u64 context_id)
+{
+	u64 generation = asid_generation;
+	unsigned long asid;
+
+	if (context_id != 0) {
+		u64 newasid = generation | ctx_asid(context_id);
+
+		/* 回绕时正在某个CPU上运行，ASID被保留了 */
+		if (check_update_reserved_asid(context_id, newasid))
+			return newasid;
+		/* 旧的ASID在新一代中还没有被别人占用，继续使用它，减少TLB条目的浪费 */
+		if (!get_bit(ctx_asid(context_id), asid_map)) {
+			set_bit(ctx_asid(context_id), asid_map);
+			return newasid;
+		}
+	}
+
+	asid = find_next_zero_bit(asid_map, NUM_ASIDS, cur_idx);
+	if (asid != NUM_ASIDS)
+		goto set_asid;
+
+	/* ASID 已用完，开始新的一代 */
+	generation += ASID_FIRST_VERSION;
+	asid_generation = generation;
+	flush_context();
+
+	/* 保留的ASID最多 PLAT_CPU_NUM 个，一定能找到空闲的ASID */
+	asid = find_next_zero_bit(asid_map, NUM_ASIDS, 1);
+	BUG_ON(asid == NUM_ASIDS);
+
+set_asid:
+	set_bit(asid, asid_map);
+	cur_idx = asid;
+	return asid | generation;
+}
+
+/**
+ * @brief: 切换到 context_id 对应的地址空间前调用，返回应当写入 TTBR0_EL1 的ASID
+ *         context_id 属于当前代时（最常见的情况）不需要加锁，只需要一次CAS更新本CPU的 active_asids
+ * @param context_id: 地址空间的 context_id，首次使用时应为0
+ * @return: ASID
+*/
+u64 asid_switch(u64 *context_id)
+{
+	u32 cpu = smp_get_cpu_id();
+	u64 asid = *(volatile u64 *)context_id;
+	u64 old_active = active_asids[cpu];
+
+	/*
+	 * 如果 active_asids 为0，说明其他CPU正在 flush_context 中回收ASID，需要走慢路径；
+	 * 否则用CAS更新，与 flush_context 中的 atomic_exchange 竞争
+	 */
+	if (likely(old_active != 0 && ctx_generation_match(asid)) &&
+	    atomic_cmpxchg_64(&active_asids[cpu], old_active, asid) == old_active)
+		return ctx_asid(asid);
+
+	lock(&asid_lock);
+	asid = *context_id;
+	if (!ctx_generation_match(asid)) {
+		asid = new_context(asid);
+		*context_id = asid;
+	}
+	active_asids[cpu] = asid;
+	unlock(&asid_lock);
+
+	return ctx_asid(asid);
+}
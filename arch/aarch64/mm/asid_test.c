@@ -0,0 +1,127 @@
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <arch/machine/pmu.h>
+#include <arch/machine/registers.h>
+#include <arch/mm/asid.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/tlb.h>
+#include <mm/common_pte.h>
+#include <mm/page_table.h>
+
+#define ASID_BENCH_VA (0x400000UL)
+#define ASID_BENCH_PAGES_ORDER (4)
+#define ASID_BENCH_PAGES (1 << ASID_BENCH_PAGES_ORDER)
+#define ASID_BENCH_ROUNDS (1024)
+
+void asid_test(void)
+{
+	u32 bits = get_asid_bits();
+	u64 nr_asids = 1UL << bits;
+	u64 a = 0, b = 0, asid_a, asid_b;
+	u64 *ctx;
+	u64 last = 0;
+	bool rollover = false;
+
+	/* 1. 不同的地址空间得到不同的非0 ASID，重复切换时ASID不变 */
+	asid_a = asid_switch(&a);
+	asid_b = asid_switch(&b);
+	assert(asid_a != 0 && asid_b != 0 && asid_a != asid_b);
+	assert(asid_switch(&a) == asid_a);
+	assert(asid_switch(&b) == asid_b);
+
+	/* 2. 切换 nr_asids 个新的地址空间，必然发生一次回绕 */
+	ctx = kzalloc(nr_asids * sizeof(u64));
+	assert(ctx != NULL);
+	for (u64 i = 0; i < nr_asids; i++) {
+		u64 asid = asid_switch(&ctx[i]);
+
+		assert(asid != 0 && asid < nr_asids);
+		if (i > 0 && (ctx[i] >> bits) != (ctx[i - 1] >> bits)) {
+			/* 回绕时正在使用的ASID被保留，新地址空间不会拿到它 */
+			assert(!rollover);
+			rollover = true;
+			last = i - 1;
+			assert(asid != (ctx[last] & (nr_asids - 1)));
+		}
+	}
+	assert(rollover);
+
+	/* 3. 回绕时正在运行的地址空间切换回来后ASID不变，只是代更新了 */
+	asid_a = ctx[last] & (nr_asids - 1);
+	assert(asid_switch(&ctx[last]) == asid_a);
+	assert((ctx[last] >> bits) == (ctx[nr_asids - 1] >> bits));
+
+	/* 4. 旧代的地址空间重新分配到当前代 */
+	asid_switch(&a);
+	assert((a >> bits) == (ctx[last] >> bits));
+
+	kfree(ctx);
+	kinfo("asid test passed\n");
+}
+
+static void *asid_bench_pgtbl(paddr_t pa)
+{
+	void *pgtbl = get_pages(0);
+	long rss = 0;
+
+	memset(pgtbl, 0, PAGE_SIZE);
+	map_range_in_pgtbl_user(pgtbl, ASID_BENCH_VA, pa, ASID_BENCH_PAGES * PAGE_SIZE, VMR_READ | VMR_WRITE, &rss);
+	return pgtbl;
+}
+
+static void asid_bench_touch(void)
+{
+	for (int i = 0; i < ASID_BENCH_PAGES; i++)
+		(void)*(volatile u64 *)(ASID_BENCH_VA + i * PAGE_SIZE);
+}
+
+/**
+ * @brief: 两个地址空间在同一虚拟地址映射各自的页，交替切换并访问这些页。
+ *         对比使用ASID切换和不使用ASID（每次切换都刷新TLB）的开销
+*/
+void asid_bench(void)
+{
+	void *pages_a = get_pages(ASID_BENCH_PAGES_ORDER);
+	void *pages_b = get_pages(ASID_BENCH_PAGES_ORDER);
+	void *pgtbl_a = asid_bench_pgtbl(virt_to_phys(pages_a));
+	void *pgtbl_b = asid_bench_pgtbl(virt_to_phys(pages_b));
+	u64 saved_ttbr0 = read_sysreg(ttbr0_el1);
+	u64 start, asid_cycles, flush_cycles;
+	long rss = 0;
+
+	start = pmu_read_real_cycle();
+	for (int i = 0; i < ASID_BENCH_ROUNDS; i++) {
+		set_page_table(virt_to_phys(pgtbl_a));
+		asid_bench_touch();
+		set_page_table(virt_to_phys(pgtbl_b));
+		asid_bench_touch();
+	}
+	asid_cycles = pmu_read_real_cycle() - start;
+
+	start = pmu_read_real_cycle();
+	for (int i = 0; i < ASID_BENCH_ROUNDS; i++) {
+		set_ttbr0_el1(virt_to_phys(pgtbl_a));
+		flush_tlb_all();
+		asid_bench_touch();
+		set_ttbr0_el1(virt_to_phys(pgtbl_b));
+		flush_tlb_all();
+		asid_bench_touch();
+	}
+	flush_cycles = pmu_read_real_cycle() - start;
+
+	set_ttbr0_el1(saved_ttbr0);
+	flush_tlb_all();
+
+	unmap_range_in_pgtbl(pgtbl_a, ASID_BENCH_VA, ASID_BENCH_PAGES * PAGE_SIZE, &rss);
+	unmap_range_in_pgtbl(pgtbl_b, ASID_BENCH_VA, ASID_BENCH_PAGES * PAGE_SIZE, &rss);
+	free_pages(pgtbl_a);
+	free_pages(pgtbl_b);
+	free_pages(pages_a);
+	free_pages(pages_b);
+
+	kinfo("asid bench: %d switches touching %d pages, with asid %lu cycles, with tlb flush %lu cycles per switch\n",
+	      2 * ASID_BENCH_ROUNDS, ASID_BENCH_PAGES, asid_cycles / (2 * ASID_BENCH_ROUNDS),
+	      flush_cycles / (2 * ASID_BENCH_ROUNDS));
+}
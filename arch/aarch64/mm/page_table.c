@@ -10,41 +10,157 @@
 #include <mm/common_pte.h>
 #include <arch/mmu.h>
 #include <arch/sync.h>
+#include <arch/boot.h>
+#include <mm/tlb.h>
+#include <mm/ptp_cache.h>
+#include <mm/rmap.h>
 
 #include <arch/mm/page_table.h>
+#include <arch/mm/asid.h>
+#include <arch/machine/registers.h>
+#include <arch/machine/smp.h>
 
 /**
- * @brief: 设置用户页表基址寄存器，用于切换用户态进程的页表
+ * @brief: 设置用户页表基址寄存器，用于切换用户态进程的页表。
+ *         页表的ASID保存在根页表页的 page->context_id 中，与页表基址一起写入 TTBR0_EL1，
+ *         用户页表项都带有 nG 标记，因此切换时无需刷新TLB
  * @param pgtbl: 页表物理地址（注意不是虚拟地址）
 */
 void set_page_table(paddr_t pgtbl)
 {
-	set_ttbr0_el1(pgtbl);
+	struct page *page = virt_to_page((void *)phys_to_virt(pgtbl));
+	u32 cpu_bit = BIT(smp_get_cpu_id());
+	u64 asid = 0;
+
+	/* 不在buddy中的静态页表（如 boot_ttbr0_l0）使用保留的ASID 0 */
+	if (page) {
+		asid = asid_switch(&page->context_id);
+		/*
+		 * 先记录本CPU，再加载页表，与 tlb_gather_flush 中先修改页表项、再读取 cpu_mask 的顺序配对，
+		 * 保证失效TLB时不会漏掉正在切换到该地址空间的CPU
+		 */
+		if (!(page->cpu_mask & cpu_bit))
+			atomic_fetch_or_32(&page->cpu_mask, cpu_bit);
+		smp_mb();
+	}
+	set_ttbr0_el1(pgtbl | (asid << TTBR_ASID_SHIFT));
+}
+
+/*
+ * 内核页表的根页表页，不在伙伴系统中，tlb_gather_flush 据此按内核页表失效所有ASID。
+ * init_kernel_pgtbl 之前内核使用启动时的 boot_ttbr1_l0
+ */
+static ptp_t kernel_pgtbl_l0 ALIGN(PAGE_SIZE);
+static bool kernel_pgtbl_ready;
+
+/**
+ * @brief: 获取内核页表（TTBR1）的基址（虚拟地址）
+*/
+void *get_kernel_pgtbl(void)
+{
+	if (kernel_pgtbl_ready)
+		return &kernel_pgtbl_l0;
+	return (void *)phys_to_virt(boot_ttbr1_l0);
+}
+
+/**
+ * @brief: 在mm_init之后建立内核自己的页表，替换启动时的 boot_ttbr1_l0：
+ *         - 内核镜像按段以4KB粒度映射：代码只读可执行，只读数据只读，其余可读写，都不可执行
+ *         - 其余物理内存和外设尽量使用2MB/1GB块映射
+ *         - 所有内核页表项都是全局的（nG = 0），切换用户地址空间（ASID）后TLB中的内核条目仍然有效
+ *         启动页表中直接映射区域之外的映射（vmalloc、内核栈）所在的页表页直接挂到新的根页表页上
+*/
+void init_kernel_pgtbl(void)
+{
+	ptp_t *boot_l0 = (ptp_t *)phys_to_virt(boot_ttbr1_l0);
+	ptp_t *l0 = &kernel_pgtbl_l0;
+	paddr_t text_start = (vaddr_t)&_text_start - KBASE;
+	paddr_t text_end = (vaddr_t)&_text_end - KBASE;
+	paddr_t rodata_start = (paddr_t)&_serial_end;
+	paddr_t rodata_end = (paddr_t)&_edata;
+	paddr_t extable_start = (paddr_t)&_bss_end;
+	paddr_t img_end_pa = ROUND_UP((paddr_t)&img_end, PAGE_SIZE);
+	struct {
+		paddr_t start;
+		paddr_t end;
+		vmr_prop_t flags;
+	} sections[] = {
+		/* 镜像之前的内存和 init 段（启动代码、启动页表） */
+		{ 0, text_start, VMR_READ | VMR_WRITE },
+		{ text_start, text_end, VMR_READ | VMR_EXEC },
+		/* .data 和 .init.serial */
+		{ text_end, rodata_start, VMR_READ | VMR_WRITE },
+		{ rodata_start, rodata_end, VMR_READ },
+		{ rodata_end, extable_start, VMR_READ | VMR_WRITE },
+		{ extable_start, img_end_pa, VMR_READ },
+		/* 伙伴系统管理的内存 */
+		{ img_end_pa, PHYS_MEM_END, VMR_READ | VMR_WRITE },
+		{ PHYS_MEM_END, PERIPHERAL_END, VMR_READ | VMR_WRITE | VMR_DEVICE },
+		{ PERIPHERAL_END, LOCAL_PERIPHERAL_END, VMR_READ | VMR_WRITE | VMR_DEVICE },
+	};
+
+	BUG_ON(kernel_pgtbl_ready);
+	for (int i = 0; i < ARRAY_SIZE(sections); i++) {
+		if (sections[i].start == sections[i].end)
+			continue;
+		BUG_ON(sections[i].start % PAGE_SIZE || sections[i].end < sections[i].start);
+		BUG_ON(map_range_in_pgtbl_kernel(l0, KBASE + sections[i].start, sections[i].start,
+						 sections[i].end - sections[i].start, sections[i].flags) < 0);
+	}
+
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		if (i != GET_L0_INDEX(KBASE) && !IS_PTE_INVALID(boot_l0->ent[i].pte))
+			l0->ent[i] = boot_l0->ent[i];
+	}
+
+	set_ttbr1_el1(virt_to_phys(l0));
+	kernel_pgtbl_ready = true;
+	kinfo("kernel page table initialized\n");
+}
+
+/**
+ * @brief: 获取当前CPU正在使用的用户页表（TTBR0）的基址（虚拟地址）
+*/
+void *get_current_user_pgtbl(void)
+{
+	/* TTBR0_EL1 的 [47:1] 为页表基址，[63:48] 为ASID */
+	return (void *)phys_to_virt(read_sysreg(ttbr0_el1) & (((1UL << TTBR_ASID_SHIFT) - 1) & ~PAGE_MASK));
 }
 
-static int __vmr_prot_to_ap(vmr_prop_t prot)
+#define USER_PTE 0
+#define KERNEL_PTE 1
+
+/* 内核页表项不允许EL0访问 */
+static int __vmr_prot_to_ap(vmr_prop_t prot, int kind)
 {
 	if ((prot & VMR_READ) && !(prot & VMR_WRITE)) {
-		return AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO;
+		return kind == KERNEL_PTE ? AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_NA :
+					    AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO;
 	} else if (prot & VMR_WRITE) {
-		return AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW;
+		return kind == KERNEL_PTE ? AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_NA :
+					    AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW;
 	}
 	return 0;
 }
 
-static int __ap_to_vmr_prot(int ap)
+/* 用户页表项按EL0的视角解码：AP为 *_EL0_NA 时用户态不能访问（mprotect(PROT_NONE)） */
+static int __ap_to_vmr_prot(int ap, int kind)
 {
-	if (ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO) {
+	if (kind == USER_PTE) {
+		if (ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO)
+			return VMR_READ;
+		if (ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW)
+			return VMR_READ | VMR_WRITE;
+		return 0;
+	}
+	if (ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO || ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_NA) {
 		return VMR_READ;
-	} else if (ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW) {
+	} else if (ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW || ap == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_NA) {
 		return VMR_READ | VMR_WRITE;
 	}
 	return 0;
 }
 
-#define USER_PTE 0
-#define KERNEL_PTE 1
-
 /**
  * @brief: 设置页表项的属性
  * @param entry: 页表项
@@ -61,7 +177,7 @@ static int set_pte_flags(pte_t *entry, vmr_prop_t flags, int kind)
 	 * 当前访问权限（AP）设置，映射的页面始终是可读的（不考虑XOM，Execute-Only Memory
 	 * EL1可以直接访问EL0（显式禁用SMAP，Supervisor Mode Access Prevention）
 	*/
-	entry->l3_page.AP = __vmr_prot_to_ap(flags);
+	entry->l3_page.AP = __vmr_prot_to_ap(flags, kind);
 
 	/**
 	 * 内核态不能直接执行用户态的代码，用户态也不能直接执行内核态的代码
@@ -82,8 +198,9 @@ static int set_pte_flags(pte_t *entry, vmr_prop_t flags, int kind)
 
 	// 设置访问标志位
 	entry->l3_page.AF = AARCH64_MMU_ATTR_PAGE_AF_ACCESSED;
-	// 设置非全局标志位，表示该页表项在TLB中的缓存只对当前ASID有效，读于实现进程隔离很重要
-	entry->l3_page.nG = 1;
+	// 用户页表项设置非全局标志位，表示该页表项在TLB中的缓存只对当前ASID有效，对于实现进程隔离很重要。
+	// 内核页表项是全局的，在所有地址空间中共享，切换ASID后TLB中的条目仍然有效
+	entry->l3_page.nG = kind == USER_PTE;
 	// 定义共享属性，INNER_SHAREABLE表示被"内层域"（如CPU核组）共享，需维护所有缓存一致性（L1/L2/L3）
 	entry->l3_page.SH = INNER_SHAREABLE;
 	// 设置内存类型
@@ -99,6 +216,15 @@ static int set_pte_flags(pte_t *entry, vmr_prop_t flags, int kind)
 	return 0;
 }
 
+/* 页表项中输出地址（下一级页表、块或页的物理地址）所在的位 [47:12] */
+#define PTE_ADDR_MASK (((1UL << 48) - 1) & ~PAGE_MASK)
+
+/*
+ * 拆分块映射（break-before-make）期间中间级页表项的临时值：硬件看到的是无效项，但不为空，
+ * 缺页处理用CAS安装页表页或大页时不会覆盖它，而是等待拆分完成
+ */
+#define PTE_DESCRIPTOR_BUSY (1UL << 58)
+
 #define GET_PADDR_IN_PTE(entry) (((u64)(entry)->table.next_table_addr) << PAGE_SHIFT)
 #define GET_NEXT_PTP(entry) phys_to_virt(GET_PADDR_IN_PTE(entry))
 
@@ -153,10 +279,9 @@ static int get_next_ptp(ptp_t *cur_ptp, u32 level, vaddr_t va, ptp_t **next_ptp,
 			paddr_t new_ptp_paddr;
 			pte_t new_pte_val;
 
-			new_ptp = get_pages(0);
+			new_ptp = alloc_ptp();
 			if (new_ptp == NULL)
 				return -ENOMEM;
-			memset((void *)new_ptp, 0, PAGE_SIZE);
 			if (rss)
 				*rss += PAGE_SIZE;
 
@@ -167,8 +292,20 @@ static int get_next_ptp(ptp_t *cur_ptp, u32 level, vaddr_t va, ptp_t **next_ptp,
 			new_pte_val.table.is_table = 1;
 			new_pte_val.table.next_table_addr = new_ptp_paddr >> PAGE_SHIFT;
 
-			/* same effect as: cur_ptp->ent[index] = new_pte_val; */
-			entry->pte = new_pte_val.pte;
+			/*
+			 * 缺页处理只持有 vmspace 的读锁，其他CPU可能同时在同一位置安装页表页，因此用CAS安装，
+			 * 失败时改用对方安装的页表页或大页。屏障保证其他CPU通过该项看到的是已经清零的页表页
+			 */
+			smp_wmb();
+			if (atomic_cmpxchg_64(&entry->pte, PTE_DESCRIPTOR_INVALID, new_pte_val.pte) !=
+			    PTE_DESCRIPTOR_INVALID) {
+				free_ptp(new_ptp);
+				if (rss)
+					*rss -= PAGE_SIZE;
+				/* 其他CPU正在拆分该项上的块映射，等待它写入新的页表项 */
+				while (IS_PTE_INVALID(*(volatile u64 *)&entry->pte))
+					;
+			}
 		}
 	}
 
@@ -234,6 +371,130 @@ int query_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t *pa, pte_t **entry)
 	return 0;
 }
 
+/* va、pa都按Lx块大小对齐，并且剩余长度足够时，可以直接使用Lx块映射 */
+#define CAN_MAP_BLOCK(va, pa, page_cnt, level_pages)                                                   \
+	(IS_ALIGNED((va), (level_pages) << PAGE_SHIFT) && IS_ALIGNED((pa), (level_pages) << PAGE_SHIFT) && \
+	 (page_cnt) >= (level_pages))
+
+/**
+ * @brief: 将entry设置为L1（1GB）或L2（2MB）块映射
+ * @param entry: L1或L2页表项
+ * @param level: 页表项所在的级别
+ * @param pa: 块的物理地址，需要按块大小对齐
+ * @param flags: 映射属性
+ * @param kind: 映射类型（内核/用户）
+*/
+static void set_block_pte(pte_t *entry, u32 level, paddr_t pa, vmr_prop_t flags, int kind)
+{
+	pte_t new_pte_val;
+
+	new_pte_val.pte = 0;
+	if (level == L1) {
+		new_pte_val.l1_block.is_valid = 1;
+		new_pte_val.l1_block.is_table = 0;
+		new_pte_val.l1_block.pfn = pa >> L1_INDEX_SHIFT;
+	} else {
+		BUG_ON(level != L2);
+		new_pte_val.l2_block.is_valid = 1;
+		new_pte_val.l2_block.is_table = 0;
+		new_pte_val.l2_block.pfn = pa >> L2_INDEX_SHIFT;
+	}
+	/* 块描述符与页描述符的属性位位置相同 */
+	set_pte_flags(&new_pte_val, flags, kind);
+	entry->pte = new_pte_val.pte;
+}
+
+/**
+ * @brief: 判断L3页表页中从index开始的一组 CONT_PTES 个页表项是否都为空
+*/
+static bool cont_ptes_are_invalid(ptp_t *l3_ptp, int index)
+{
+	for (int i = 0; i < CONT_PTES; i++) {
+		if (!IS_PTE_INVALID(l3_ptp->ent[index + i].pte))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief: 按 break-before-make 重写一组 CONT_PTES 个页表项：先使整组失效并失效TLB，再写入新值。
+ *         同一组页表项的 Contiguous 位不一致时TLB可能同时缓存64KB和4KB的条目，因此设置或清除
+ *         Contiguous 位都不能直接修改正在使用的页表项
+ * @param pgtbl: 所属页表，用于失效TLB
+ * @param first: 组内第一个页表项
+ * @param va: 组的起始虚拟地址
+ * @param set_cont: 设置还是清除 Contiguous 位
+ *
+ * 硬件可能同时在更新组内页表项的访问标志和脏状态，用原子交换使其失效，不会丢失这些更新。
+ * 硬件只更新TLB所用的那一项，整组作为一个整体被访问或写入，重写时把访问标志和脏状态合并到每一项
+*/
+static void rewrite_cont_ptes(void *pgtbl, pte_t *first, vaddr_t va, bool set_cont)
+{
+	u64 saved[CONT_PTES];
+	struct tlb_gather tlb;
+	bool accessed = false, dirty = false;
+
+	for (int i = 0; i < CONT_PTES; i++) {
+		saved[i] = atomic_exchange_64((s64 *)&first[i].pte, PTE_DESCRIPTOR_INVALID);
+		accessed |= !!(saved[i] & AARCH64_MMU_PTE_AF_MASK);
+		dirty |= (saved[i] & AARCH64_MMU_PTE_DBM_MASK) && !(saved[i] & AARCH64_MMU_PTE_RDONLY_MASK);
+	}
+	tlb_gather_init(&tlb, pgtbl);
+	tlb_gather_add_range(&tlb, va, CONT_PTE_SIZE);
+	tlb_gather_flush(&tlb);
+
+	for (int i = 0; i < CONT_PTES; i++) {
+		saved[i] &= ~AARCH64_MMU_PTE_CONT_MASK;
+		if (set_cont)
+			saved[i] |= AARCH64_MMU_PTE_CONT_MASK;
+		if (accessed)
+			saved[i] |= AARCH64_MMU_PTE_AF_MASK;
+		if (dirty && (saved[i] & AARCH64_MMU_PTE_DBM_MASK))
+			saved[i] &= ~AARCH64_MMU_PTE_RDONLY_MASK;
+		first[i].pte = saved[i];
+	}
+	dsb(ishst);
+}
+
+/**
+ * @brief: 拆开index所在的一组连续映射，清除整组的 Contiguous 位，映射本身保持不变。
+ *         修改组内任意一个页表项之前都必须先拆开
+ * @param pgtbl: 所属页表
+ * @param l3_ptp: L3页表页
+ * @param index: 组内任意一项的下标
+ * @param va: index对应的虚拟地址
+*/
+static void unfold_cont_ptes(void *pgtbl, ptp_t *l3_ptp, int index, vaddr_t va)
+{
+	rewrite_cont_ptes(pgtbl, &l3_ptp->ent[ROUND_DOWN(index, CONT_PTES)], ROUND_DOWN(va, CONT_PTE_SIZE), false);
+}
+
+/**
+ * @brief: 如果index所在的一组页表项映射了一段按64KB对齐的连续物理内存，并且属性完全相同，
+ *         则为整组设置 Contiguous 位。用于逐页建立的映射凑齐一组之后
+ * @param pgtbl: 所属页表
+ * @param l3_ptp: L3页表页
+ * @param index: 组内任意一项的下标
+ * @param va: index对应的虚拟地址
+*/
+static void try_fold_cont_ptes(void *pgtbl, ptp_t *l3_ptp, int index, vaddr_t va)
+{
+	pte_t *first = &l3_ptp->ent[ROUND_DOWN(index, CONT_PTES)];
+	u64 pte = first->pte;
+	/* 访问标志和 DBM 页的脏状态由硬件更新，比较时忽略，合并时由 rewrite_cont_ptes 统一 */
+	u64 hw_bits = AARCH64_MMU_PTE_AF_MASK | ((pte & AARCH64_MMU_PTE_DBM_MASK) ? AARCH64_MMU_PTE_RDONLY_MASK : 0);
+	u64 attrs = pte & ~PTE_ADDR_MASK & ~hw_bits;
+	paddr_t pa = pte & PTE_ADDR_MASK;
+
+	if (IS_PTE_INVALID(pte) || IS_PTE_CONT(pte) || !IS_ALIGNED(pa, CONT_PTE_SIZE))
+		return;
+	for (int i = 1; i < CONT_PTES; i++) {
+		if ((first[i].pte & ~hw_bits) != (attrs | (pa + i * PAGE_SIZE)))
+			return;
+	}
+	rewrite_cont_ptes(pgtbl, first, ROUND_DOWN(va, CONT_PTE_SIZE), true);
+}
+
 /**
  * @brief: 在内核或用户页表中映射物理地址到指定虚拟地址
  * @param pgtbl: 内核/用户页表基址（虚拟地址）
@@ -243,6 +504,10 @@ int query_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t *pa, pte_t **entry)
  * @param flags: 映射属性
  * @param kind: 映射类型（内核/用户）
  * @param rss: 映射的物理页数
+ *
+ * va、pa和剩余长度都按1GB/2MB对齐，并且对应的页表项为空时，直接使用L1/L2块映射，
+ * 范围两端不对齐的部分仍使用4KB页映射。4KB页映射中按64KB对齐的一组页表项同样设置 Contiguous 位，
+ * 逐页建立的用户映射凑齐一组后也会合并
 */
 static int map_range_in_pgtbl_common(void *pgtbl, vaddr_t va, paddr_t pa, size_t len, vmr_prop_t flags, int kind,
 				     long *rss)
@@ -252,7 +517,10 @@ static int map_range_in_pgtbl_common(void *pgtbl, vaddr_t va, paddr_t pa, size_t
 	pte_t *pte;
 	int ret;
 	int pte_index;
-	int i;
+	int i, j, nr;
+	pte_t new_pte_val;
+	u64 old_pte;
+	bool cont;
 
 	BUG_ON(pgtbl == NULL);
 	BUG_ON(va % PAGE_SIZE);
@@ -268,33 +536,70 @@ static int map_range_in_pgtbl_common(void *pgtbl, vaddr_t va, paddr_t pa, size_t
 		// 通过l0_ptp获取l1_ptp，如果l1_ptp不存在，则分配一个新的l1_ptp
 		ret = get_next_ptp(l0_ptp, L0, va, &l1_ptp, &pte, true, rss);
 		BUG_ON(ret != 0);
+
+		// 尝试使用1GB的L1块映射
+		pte = &l1_ptp->ent[GET_L1_INDEX(va)];
+		if (IS_PTE_INVALID(pte->pte) && CAN_MAP_BLOCK(va, pa, total_page_cnt, L1_PER_ENTRY_PAGES)) {
+			set_block_pte(pte, L1, pa, flags, kind);
+			va += L1_PER_ENTRY_PAGES << PAGE_SHIFT;
+			pa += L1_PER_ENTRY_PAGES << PAGE_SHIFT;
+			if (rss)
+				*rss += L1_PER_ENTRY_PAGES << PAGE_SHIFT;
+			total_page_cnt -= L1_PER_ENTRY_PAGES;
+			continue;
+		}
 		// 通过l1_ptp获取l2_ptp，如果l2_ptp不存在，则分配一个新的l2_ptp
 		ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &pte, true, rss);
 		BUG_ON(ret != 0);
+
+		// 尝试使用2MB的L2块映射
+		pte = &l2_ptp->ent[GET_L2_INDEX(va)];
+		if (IS_PTE_INVALID(pte->pte) && CAN_MAP_BLOCK(va, pa, total_page_cnt, L2_PER_ENTRY_PAGES)) {
+			set_block_pte(pte, L2, pa, flags, kind);
+			va += L2_PER_ENTRY_PAGES << PAGE_SHIFT;
+			pa += L2_PER_ENTRY_PAGES << PAGE_SHIFT;
+			if (rss)
+				*rss += L2_PER_ENTRY_PAGES << PAGE_SHIFT;
+			total_page_cnt -= L2_PER_ENTRY_PAGES;
+			continue;
+		}
 		// 通过l2_ptp获取l3_ptp，如果l3_ptp不存在，则分配一个新的l3_ptp
 		ret = get_next_ptp(l2_ptp, L2, va, &l3_ptp, &pte, true, rss);
 		BUG_ON(ret != 0);
 		// 通过l3_ptp获取物理页
 		pte_index = GET_L3_INDEX(va); // 计算当前页表项的索引
-		for (i = pte_index; i < PTP_ENTRIES; ++i) {
+		for (i = pte_index; i < PTP_ENTRIES && total_page_cnt > 0; i += nr) {
+			// va、pa都按64KB对齐、剩余长度足够并且整组页表项为空时，整组设置 Contiguous 位
+			cont = CAN_MAP_BLOCK(va, pa, total_page_cnt, CONT_PTES) && cont_ptes_are_invalid(l3_ptp, i);
+			nr = cont ? CONT_PTES : 1;
+
 			// 设置l3_ptp的页表项
-			pte_t new_pte_val;
 			new_pte_val.pte = 0; // 清空页表项
 			new_pte_val.l3_page.is_valid = 1; // 设置有效位
 			new_pte_val.l3_page.is_page = 1; // 设置页表项类型为页
 			new_pte_val.l3_page.pfn = pa >> PAGE_SHIFT; // 设置物理页号
-			set_pte_flags(&new_pte_val, flags,
-				      kind); // 设置页表项属性
-			l3_ptp->ent[i].pte = new_pte_val.pte; // 更新页表项
+			set_pte_flags(&new_pte_val, flags, kind); // 设置页表项属性
+			new_pte_val.l3_page.Contiguous = cont;
 
-			va += PAGE_SIZE;
-			pa += PAGE_SIZE;
+			// 覆盖连续映射中的某一项之前先拆开整组，映射没有变化时保留整组的 Contiguous 位
+			old_pte = l3_ptp->ent[i].pte;
+			if (!cont && IS_PTE_CONT(old_pte)) {
+				if ((old_pte & ~AARCH64_MMU_PTE_CONT_MASK) == new_pte_val.pte)
+					new_pte_val.pte = old_pte;
+				else
+					unfold_cont_ptes(pgtbl, l3_ptp, i, va);
+			}
+			for (j = 0; j < nr; j++)
+				l3_ptp->ent[i + j].pte = new_pte_val.pte + j * PAGE_SIZE; // 更新页表项
+
+			va += nr * PAGE_SIZE;
+			pa += nr * PAGE_SIZE;
 			if (rss)
-				*rss += PAGE_SIZE;
-			total_page_cnt -= 1;
-			// 如果映射范围很广，可能跨越多个l3，l2，l1页表页
-			if (total_page_cnt == 0)
-				break;
+				*rss += nr * PAGE_SIZE;
+			total_page_cnt -= nr;
+			// 逐页建立的用户映射可能凑齐了一组连续映射
+			if (!cont && kind == USER_PTE)
+				try_fold_cont_ptes(pgtbl, l3_ptp, i, va - PAGE_SIZE);
 		}
 	}
 
@@ -330,3 +635,1589 @@ int map_range_in_pgtbl_user(void *pgtbl, vaddr_t va, paddr_t pa, size_t len, vmr
 {
 	return map_range_in_pgtbl_common(pgtbl, va, pa, len, flags, USER_PTE, rss);
 }
+
+/**
+ * @brief: 判断从pages[0]开始的 CONT_PTES 个页是否是一段按64KB对齐的连续物理内存
+*/
+static bool pages_can_map_cont(struct page **pages)
+{
+	paddr_t pa = virt_to_phys(page_to_virt(pages[0]));
+
+	if (!IS_ALIGNED(pa, CONT_PTE_SIZE))
+		return false;
+	for (int i = 1; i < CONT_PTES; i++) {
+		if (pages[i] != pages[0] + i)
+			return false;
+	}
+	return true;
+}
+
+/* 页表项所在页表页的锁（split page-table lock） */
+static struct lock *pte_lockptr(pte_t *entry)
+{
+	return &virt_to_page((void *)ROUND_DOWN((vaddr_t)entry, PAGE_SIZE))->ptl;
+}
+
+/**
+ * @brief: 将n个物理上不一定连续的页依次映射到从va开始的连续虚拟地址，映射属性都为flags。
+ *         每个L3页表页只从L0查找一次，之后在循环中连续填写页表项，最后只做一次屏障。
+ *         va >= KBASE 时建立内核映射，否则建立用户映射。页的引用计数由调用者管理
+ * @param pgtbl: 页表基址（虚拟地址）
+ * @param va: 起始虚拟地址，需要按页对齐
+ * @param pages: 要映射的页
+ * @param n: 页数
+ * @param flags: 映射属性
+ * @param rss: 映射的物理页数，可以为NULL
+ * @param install: 持有L3页表页的锁填写，只填写空的页表项，安装了的页在pages中置为NULL
+ * @return: 0 on success, -ENOMEM 如果无法分配页表页, -EEXIST 如果某一页已经被映射（install 时跳过这些页），
+ *          出错时已经建立的映射保持不变
+ *
+ * 与 map_range_in_pgtbl_user 相同，按64KB对齐、物理连续并且原来为空的一组页表项设置 Contiguous 位
+*/
+static int __map_pages_in_pgtbl(void *pgtbl, vaddr_t va, struct page **pages, unsigned long n, vmr_prop_t flags,
+				long *rss, bool install)
+{
+	struct lock *ptl = NULL;
+	int kind = va >= KBASE ? KERNEL_PTE : USER_PTE;
+	ptp_t *l1_ptp, *l2_ptp, *l3_ptp;
+	pte_t *pte, new_pte_val;
+	u64 attrs;
+	int ret = 0;
+	int index, end, nr;
+
+	BUG_ON(pgtbl == NULL);
+	BUG_ON(va % PAGE_SIZE);
+
+	/* 所有页的属性相同，只计算一次 */
+	new_pte_val.pte = 0;
+	new_pte_val.l3_page.is_valid = 1;
+	new_pte_val.l3_page.is_page = 1;
+	set_pte_flags(&new_pte_val, flags, kind);
+	attrs = new_pte_val.pte;
+
+	while (n > 0) {
+		ret = get_next_ptp((ptp_t *)pgtbl, L0, va, &l1_ptp, &pte, true, rss);
+		if (ret == NORMAL_PTP)
+			ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &pte, true, rss);
+		if (ret == NORMAL_PTP)
+			ret = get_next_ptp(l2_ptp, L2, va, &l3_ptp, &pte, true, rss);
+		if (ret < 0)
+			break;
+		if (ret == BLOCK_PTP && install) {
+			/* 其他CPU已经用大页映射了这一段，页留给调用者释放 */
+			nr = MIN(n, (HUGE_PAGE_SIZE - (va & (HUGE_PAGE_SIZE - 1))) >> PAGE_SHIFT);
+			va += nr * PAGE_SIZE;
+			pages += nr;
+			n -= nr;
+			ret = 0;
+			continue;
+		}
+		/* 逐页映射不会覆盖块映射，调用者应先解除映射 */
+		BUG_ON(ret != NORMAL_PTP);
+
+		index = GET_L3_INDEX(va);
+		end = MIN((unsigned long)PTP_ENTRIES, index + n);
+		if (install) {
+			ptl = pte_lockptr(&l3_ptp->ent[index]);
+			lock(ptl);
+		}
+		for (; index < end; index += nr) {
+			pte = &l3_ptp->ent[index];
+			if (IS_ALIGNED(index, CONT_PTES) && end - index >= CONT_PTES &&
+			    cont_ptes_are_invalid(l3_ptp, index) && pages_can_map_cont(pages)) {
+				nr = CONT_PTES;
+				for (int i = 0; i < CONT_PTES; i++)
+					pte[i].pte = attrs | AARCH64_MMU_PTE_CONT_MASK |
+						     virt_to_phys(page_to_virt(pages[i]));
+			} else {
+				nr = 1;
+				if (!IS_PTE_INVALID(pte->pte)) {
+					/* 替换正在使用的页表项需要 break-before-make，调用者应先解除映射 */
+					if (!install) {
+						ret = -EEXIST;
+						goto out;
+					}
+					/* 其他CPU已经映射了这一页，页留给调用者释放 */
+					va += PAGE_SIZE;
+					pages++;
+					n--;
+					continue;
+				}
+				pte->pte = attrs | virt_to_phys(page_to_virt(pages[0]));
+			}
+			if (install)
+				memset(pages, 0, nr * sizeof(*pages));
+			va += nr * PAGE_SIZE;
+			pages += nr;
+			n -= nr;
+			if (rss)
+				*rss += nr * PAGE_SIZE;
+		}
+		if (install)
+			unlock(ptl);
+	}
+
+out:
+	dsb(ishst);
+	isb();
+
+	/* 只填写原来无效的页表项，TLB中不会缓存无效的页表项，不需要失效TLB */
+	return ret < 0 ? ret : 0;
+}
+
+int map_pages_in_pgtbl(void *pgtbl, vaddr_t va, struct page **pages, unsigned long n, vmr_prop_t flags, long *rss)
+{
+	return __map_pages_in_pgtbl(pgtbl, va, pages, n, flags, rss, false);
+}
+
+/**
+ * @brief: 与 map_pages_in_pgtbl 相同，但只填写空的页表项，用于只持有 vmspace 读锁的缺页处理。
+ *         中间级页表页用CAS安装，L3页表项在其所在页表页的锁内填写，不同L3页表页上的缺页互不等待
+ * @return: 0 on success, -ENOMEM 如果无法分配页表页。安装了的页在pages中置为NULL，
+ *          其余的页（已经被其他CPU映射的位置，或者出错之后的页）由调用者释放
+*/
+int install_pages_in_pgtbl(void *pgtbl, vaddr_t va, struct page **pages, unsigned long n, vmr_prop_t flags,
+			   long *rss)
+{
+	return __map_pages_in_pgtbl(pgtbl, va, pages, n, flags, rss, true);
+}
+
+/* Lx页表项覆盖的地址范围大小的位数 */
+#define LEVEL_SHIFT(level) (L3_INDEX_SHIFT + (L3 - (level)) * PAGE_ORDER)
+#define LEVEL_ENTRY_SIZE(level) (1UL << LEVEL_SHIFT(level))
+#define GET_INDEX_IN_LEVEL(va, level) (((va) >> LEVEL_SHIFT(level)) & PTP_INDEX_MASK)
+
+struct unmap_ctx {
+	long *rss;
+	/* 记录需要失效的TLB范围，以及是否回收了页表页 */
+	struct tlb_gather *tlb;
+};
+
+/**
+ * @brief: 为页表管理的页（refcount 不为0）增加一个映射，由调用者管理的页不计数
+*/
+static void get_user_page(paddr_t pa)
+{
+	struct page *page = virt_to_page((void *)phys_to_virt(pa));
+
+	if (page && page->refcount > 0)
+		atomic_fetch_add_32(&page->refcount, 1);
+}
+
+/**
+ * @brief: 解除页表管理的页的一个映射，最后一个映射解除时交给gather在失效TLB之后释放
+*/
+static void put_user_page(struct tlb_gather *tlb, paddr_t pa)
+{
+	struct page *page = virt_to_page((void *)phys_to_virt(pa));
+
+	if (page && page->refcount > 0 && atomic_fetch_sub_32(&page->refcount, 1) == 1) {
+		page_remove_anon_rmap(page);
+		tlb_gather_free_page(tlb, page);
+	}
+}
+
+/**
+ * @brief: 为块映射中页表管理的页各增加一个映射。透明大页的每一页单独计数（见 map_huge_page_in_pgtbl），
+ *         首页不是页表管理的页时整块都由调用者管理
+*/
+static void get_user_pages(paddr_t pa, size_t len)
+{
+	struct page *page = virt_to_page((void *)phys_to_virt(pa));
+
+	if (page == NULL || page->refcount == 0)
+		return;
+	for (size_t off = 0; off < len; off += PAGE_SIZE)
+		get_user_page(pa + off);
+}
+
+/**
+ * @brief: 解除块映射中页表管理的页的映射，同 get_user_pages
+*/
+static void put_user_pages(struct tlb_gather *tlb, paddr_t pa, size_t len)
+{
+	struct page *page = virt_to_page((void *)phys_to_virt(pa));
+
+	if (page == NULL || page->refcount == 0)
+		return;
+	for (size_t off = 0; off < len; off += PAGE_SIZE)
+		put_user_page(tlb, pa + off);
+}
+
+static bool ptp_is_empty(ptp_t *ptp)
+{
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		if (!IS_PTE_INVALID(ptp->ent[i].pte))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief: 将L1或L2块映射拆分为下一级的512个块/页映射，映射的物理地址和属性保持不变
+ * @param entry: 块映射所在的页表项
+ * @param level: 页表项所在的级别
+ * @param block_va: 块映射的起始虚拟地址
+ * @param rss: 新分配的页表页计入rss
+ * @return: 0 on success, -ENOMEM 如果无法分配页表页
+ *
+ * 修改块映射为表映射需要遵循 break-before-make：先使页表项失效并失效TLB，再写入新的表项，
+ * 否则TLB中可能同时存在同一地址的两个不同大小的条目。在这期间访问该块的CPU会触发缺页，
+ * 因此不能拆分正在使用的内核映射
+*/
+static int split_block_pte(pte_t *entry, u32 level, vaddr_t block_va, long *rss)
+{
+	ptp_t *new_ptp;
+	pte_t new_pte_val;
+	u64 attrs = entry->pte & ~PTE_ADDR_MASK;
+	paddr_t pa = entry->pte & PTE_ADDR_MASK;
+	size_t sub_size = LEVEL_ENTRY_SIZE(level + 1);
+
+	BUG_ON(level != L1 && level != L2);
+
+	new_ptp = alloc_ptp();
+	if (new_ptp == NULL)
+		return -ENOMEM;
+	if (rss)
+		*rss += PAGE_SIZE;
+
+	/* L3中的页描述符 bit[1] 为1，L2中的块描述符 bit[1] 为0。2MB块拆分出的页天然按64KB对齐并且连续 */
+	if (level + 1 == L3)
+		attrs |= AARCH64_MMU_PTE_TABLE_MASK | AARCH64_MMU_PTE_CONT_MASK;
+	for (int i = 0; i < PTP_ENTRIES; i++)
+		new_ptp->ent[i].pte = attrs | (pa + i * sub_size);
+
+	entry->pte = PTE_DESCRIPTOR_BUSY;
+	flush_tlb_range(block_va, LEVEL_ENTRY_SIZE(level));
+
+	new_pte_val.pte = 0;
+	new_pte_val.table.is_valid = 1;
+	new_pte_val.table.is_table = 1;
+	new_pte_val.table.next_table_addr = virt_to_phys((vaddr_t)new_ptp) >> PAGE_SHIFT;
+	entry->pte = new_pte_val.pte;
+	dsb(ishst);
+
+	return 0;
+}
+
+/**
+ * @brief: 解除ptp中[va, end)范围内的映射，递归处理下一级页表，并回收变空的页表页
+ * @param ptp: 页表页
+ * @param level: ptp所在的级别
+ * @param va: 起始虚拟地址，[va, end)不超出ptp覆盖的范围
+ * @param end: 结束虚拟地址
+ * @param ctx: rss以及需要失效的TLB范围
+ * @return: 0 on success, -ENOMEM 如果拆分块映射时无法分配页表页
+*/
+static int unmap_range_in_ptp(ptp_t *ptp, u32 level, vaddr_t va, vaddr_t end, struct unmap_ctx *ctx)
+{
+	size_t entry_size = LEVEL_ENTRY_SIZE(level);
+	vaddr_t entry_start, next;
+	ptp_t *next_ptp;
+	paddr_t pa, cont_pa[CONT_PTES];
+	pte_t *entry;
+	int ret;
+
+	for (; va != end; va = next) {
+		entry_start = ROUND_DOWN(va, entry_size);
+		next = entry_start + entry_size;
+		/* 地址空间的最后一项会回绕到0 */
+		if (next - 1 >= end - 1)
+			next = end;
+
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte))
+			continue;
+
+		if (level == L3 && IS_PTE_CONT(entry->pte)) {
+			/* 整组解除连续映射时一次清除整组，只解除其中一部分时先拆开整组 */
+			if (IS_ALIGNED(va, CONT_PTE_SIZE) && end - va >= CONT_PTE_SIZE) {
+				/* 整组清除并记录失效范围之后才把页交给gather，同下面的单个页表项 */
+				for (int i = 0; i < CONT_PTES; i++) {
+					cont_pa[i] = entry[i].pte & PTE_ADDR_MASK;
+					entry[i].pte = PTE_DESCRIPTOR_INVALID;
+				}
+				if (ctx->rss)
+					*ctx->rss -= CONT_PTE_SIZE;
+				tlb_gather_add_range(ctx->tlb, va, CONT_PTE_SIZE);
+				for (int i = 0; i < CONT_PTES; i++)
+					put_user_page(ctx->tlb, cont_pa[i]);
+				next = va + CONT_PTE_SIZE;
+				continue;
+			}
+			unfold_cont_ptes(ctx->tlb->pgtbl, ptp, GET_INDEX_IN_LEVEL(va, level), va);
+		}
+
+		if (level == L3 || !IS_PTE_TABLE(entry->pte)) {
+			if (va == entry_start && next - va == entry_size) {
+				/* 先清除页表项并记录失效范围，再把页交给gather，页只会在该范围失效之后释放 */
+				pa = entry->pte & PTE_ADDR_MASK;
+				entry->pte = PTE_DESCRIPTOR_INVALID;
+				if (ctx->rss)
+					*ctx->rss -= entry_size;
+				tlb_gather_add_range(ctx->tlb, va, entry_size);
+				if (level == L3)
+					put_user_page(ctx->tlb, pa);
+				else
+					put_user_pages(ctx->tlb, pa, entry_size);
+				continue;
+			}
+			/* 只解除块映射的一部分，先拆分为下一级映射 */
+			ret = split_block_pte(entry, level, entry_start, ctx->rss);
+			if (ret < 0)
+				return ret;
+		}
+
+		next_ptp = (ptp_t *)GET_NEXT_PTP(entry);
+		ret = unmap_range_in_ptp(next_ptp, level + 1, va, next, ctx);
+		if (ret < 0)
+			return ret;
+
+		/* 只回收从伙伴系统分配的页表页，启动时静态分配的内核页表页保持不变 */
+		if (ptp_is_empty(next_ptp) && virt_to_page(next_ptp) != NULL) {
+			entry->pte = PTE_DESCRIPTOR_INVALID;
+			if (ctx->rss)
+				*ctx->rss -= PAGE_SIZE;
+			/*
+			 * 失效该范围内任意一个地址都会清除页表遍历缓存中指向被回收页表页的条目。
+			 * 其他CPU的页表遍历可能仍在读取该页，失效之后才能放回缓存被再次分配
+			 */
+			tlb_gather_add_range(ctx->tlb, va, PAGE_SIZE);
+			tlb_gather_free_table(ctx->tlb, next_ptp);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief: 解除页表中[va, va + len)范围内的映射，回收变空的L1/L2/L3页表页，需要失效的TLB范围记录在tlb中，
+ *         由调用者在完成所有修改后统一调用 tlb_gather_flush，从而把多次解除映射的TLB失效合并为一次
+ * @param pgtbl: 页表基址（虚拟地址），L0页表页本身不会被回收
+ * @param va: 虚拟地址，需要按页对齐
+ * @param len: 解除映射的长度
+ * @param rss: 映射的物理页数，每解除一页减去PAGE_SIZE，每回收一个页表页也减去PAGE_SIZE
+ * @param tlb: 由 tlb_gather_init(tlb, pgtbl) 初始化的gather结构
+ * @return: 0 on success, -ENOMEM 如果拆分块映射时无法分配页表页，此时部分范围可能已经解除映射
+ *
+ * 范围只覆盖块映射的一部分时，先把块拆分为下一级的映射，再解除其中的一部分
+*/
+int unmap_range_in_pgtbl_gather(void *pgtbl, vaddr_t va, size_t len, long *rss, struct tlb_gather *tlb)
+{
+	struct unmap_ctx ctx = { .rss = rss, .tlb = tlb };
+	size_t aligned_len = ROUND_UP(len, PAGE_SIZE);
+	int ret;
+
+	BUG_ON(pgtbl == NULL);
+	BUG_ON(va % PAGE_SIZE);
+	if (aligned_len == 0)
+		return 0;
+
+	ret = unmap_range_in_ptp((ptp_t *)pgtbl, L0, va, va + aligned_len, &ctx);
+	if (ret < 0)
+		kwarn("unmap range [0x%lx, 0x%lx) failed: %d\n", va, va + len, ret);
+	return ret;
+}
+
+/**
+ * @brief: 解除页表中[va, va + len)范围内的映射，并批量失效对应的TLB条目
+ * @param pgtbl: 页表基址（虚拟地址）
+ * @param va: 虚拟地址，需要按页对齐
+ * @param len: 解除映射的长度
+ * @param rss: 同 unmap_range_in_pgtbl_gather
+ * @return: 0 on success, -ENOMEM 如果拆分块映射时无法分配页表页
+ *
+ * 所有页表项修改完成后统一失效TLB：只清除了最后一级页表项时使用只失效最后一级的TLBI，
+ * 回收了页表页时使用失效所有级别的TLBI，以清除页表遍历缓存中指向被回收页表页的条目
+*/
+int unmap_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, long *rss)
+{
+	struct tlb_gather tlb;
+	int ret;
+
+	tlb_gather_init(&tlb, pgtbl);
+	ret = unmap_range_in_pgtbl_gather(pgtbl, va, len, rss, &tlb);
+	tlb_gather_flush(&tlb);
+	return ret;
+}
+
+/* 判断相邻的映射能否合并时比较的属性位：忽略输出地址、页/块描述符的区别以及 Contiguous 位 */
+#define PTE_RUN_ATTR_MASK (~(PTE_ADDR_MASK | AARCH64_MMU_PTE_TABLE_MASK | AARCH64_MMU_PTE_CONT_MASK))
+
+struct walk_ctx {
+	/* 正在合并的映射段，len为0表示还没有 */
+	struct pgtbl_run run;
+	u64 attrs;
+	pgtbl_run_fn fn;
+	void *arg;
+};
+
+static vmr_prop_t pte_to_vmr_prop(u64 attrs)
+{
+	pte_t pte = { .pte = attrs };
+	/* 只有用户页表项设置nG（见 set_pte_flags） */
+	vmr_prop_t prop = __ap_to_vmr_prot(pte.l3_page.AP, pte.l3_page.nG ? USER_PTE : KERNEL_PTE);
+
+	/* 内核页表项总是设置UXN，用户页表项总是设置PXN，只要有一个未设置就是可执行的 */
+	if (!pte.l3_page.UXN || !pte.l3_page.PXN)
+		prop |= VMR_EXEC;
+	if (pte.l3_page.attr_index == DEVICE_MEMORY)
+		prop |= VMR_DEVICE;
+	else if (pte.l3_page.attr_index == NORMAL_MEMORY_NOCACHE)
+		prop |= VMR_NOCACHE;
+	/* 开启脏状态跟踪的干净页AP为只读，但映射本身可写 */
+	if (attrs & AARCH64_MMU_PTE_DBM_MASK)
+		prop |= VMR_WRITE;
+	/* 写时复制的页实际只读，映射本身是否可写记录在 SW_WRITE 中 */
+	if (attrs & AARCH64_MMU_PTE_SW_COW) {
+		prop |= VMR_COW;
+		if (attrs & AARCH64_MMU_PTE_SW_WRITE)
+			prop |= VMR_WRITE;
+	}
+	return prop;
+}
+
+/**
+ * @brief: 将一个叶子页表项（页或块）中的[va, va + len)加入当前映射段，不能合并时先把当前映射段交给回调
+ * @return: 0 继续遍历，非0 为回调的返回值，遍历终止
+*/
+static int walk_add_leaf(struct walk_ctx *ctx, vaddr_t va, paddr_t pa, size_t len, u64 attrs)
+{
+	struct pgtbl_run *run = &ctx->run;
+	int ret;
+
+	if (run->len) {
+		if (run->va + run->len == va && run->pa + run->len == pa && ctx->attrs == attrs) {
+			run->len += len;
+			return 0;
+		}
+		ret = ctx->fn(run, ctx->arg);
+		if (ret)
+			return ret;
+	}
+	run->va = va;
+	run->pa = pa;
+	run->len = len;
+	run->flags = pte_to_vmr_prop(attrs);
+	ctx->attrs = attrs;
+	return 0;
+}
+
+/**
+ * @brief: 遍历ptp中[va, end)范围内的映射，递归处理下一级页表。同一页表页中相邻的页表项直接顺序访问，
+ *         不需要每一页都从L0开始查找
+*/
+static int walk_range_in_ptp(ptp_t *ptp, u32 level, vaddr_t va, vaddr_t end, struct walk_ctx *ctx)
+{
+	size_t entry_size = LEVEL_ENTRY_SIZE(level);
+	vaddr_t entry_start, next;
+	pte_t *entry;
+	int ret;
+
+	for (; va != end; va = next) {
+		entry_start = ROUND_DOWN(va, entry_size);
+		next = entry_start + entry_size;
+		/* 地址空间的最后一项会回绕到0 */
+		if (next - 1 >= end - 1)
+			next = end;
+
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte))
+			continue;
+
+		if (level == L3 || !IS_PTE_TABLE(entry->pte)) {
+			ret = walk_add_leaf(ctx, va, (entry->pte & PTE_ADDR_MASK) + (va - entry_start), next - va,
+					    entry->pte & PTE_RUN_ATTR_MASK);
+		} else {
+			ret = walk_range_in_ptp((ptp_t *)GET_NEXT_PTP(entry), level + 1, va, next, ctx);
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief: 一次遍历页表中[va, va + len)范围内的所有映射，把虚拟地址和物理地址都连续、属性相同的映射
+ *         合并为一段交给回调。未映射的空洞不会交给回调，调用者可以通过相邻两段的地址判断
+ * @param pgtbl: 页表基址（虚拟地址）
+ * @param va: 起始虚拟地址，不需要按页对齐
+ * @param len: 长度
+ * @param fn: 回调，返回非0时终止遍历
+ * @param arg: 回调参数
+ * @return: 0 遍历完成，否则为回调返回的非0值
+*/
+int walk_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, pgtbl_run_fn fn, void *arg)
+{
+	struct walk_ctx ctx = { .run = { .len = 0 }, .fn = fn, .arg = arg };
+	int ret;
+
+	BUG_ON(pgtbl == NULL);
+	if (len == 0)
+		return 0;
+
+	ret = walk_range_in_ptp((ptp_t *)pgtbl, L0, va, va + len, &ctx);
+	if (ret == 0 && ctx.run.len)
+		ret = fn(&ctx.run, arg);
+	return ret;
+}
+
+static int dump_run(struct pgtbl_run *run, void *arg)
+{
+	printk("  [0x%lx, 0x%lx) -> [0x%lx, 0x%lx) %c%c%c%s%s%s\n", run->va, run->va + run->len, run->pa,
+	       run->pa + run->len, (run->flags & VMR_READ) ? 'r' : '-', (run->flags & VMR_WRITE) ? 'w' : '-',
+	       (run->flags & VMR_EXEC) ? 'x' : '-', (run->flags & VMR_DEVICE) ? " device" : "",
+	       (run->flags & VMR_NOCACHE) ? " nocache" : "", (run->flags & VMR_COW) ? " cow" : "");
+	(*(unsigned long *)arg)++;
+	return 0;
+}
+
+/**
+ * @brief: 打印页表中[va, va + len)范围内合并后的映射段
+*/
+void dump_pgtbl(void *pgtbl, vaddr_t va, size_t len)
+{
+	unsigned long nr_runs = 0;
+
+	printk("page table %p [0x%lx, 0x%lx):\n", pgtbl, va, va + len);
+	walk_range_in_pgtbl(pgtbl, va, len, dump_run, &nr_runs);
+	printk("  %lu runs\n", nr_runs);
+}
+
+/**
+ * @brief: 统计ptp及其下一级页表中的页表页和各种粒度的映射
+*/
+static void pgtbl_stats_in_ptp(ptp_t *ptp, u32 level, struct pgtbl_stats *stats)
+{
+	pte_t *entry;
+
+	stats->nr_ptps[level]++;
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		entry = &ptp->ent[i];
+		if (IS_PTE_INVALID(entry->pte))
+			continue;
+
+		if (level == L3) {
+			stats->nr_pages++;
+			if (IS_PTE_CONT(entry->pte))
+				stats->nr_cont_pages++;
+		} else if (!IS_PTE_TABLE(entry->pte)) {
+			if (level == L1)
+				stats->nr_l1_blocks++;
+			else
+				stats->nr_l2_blocks++;
+		} else {
+			pgtbl_stats_in_ptp((ptp_t *)GET_NEXT_PTP(entry), level + 1, stats);
+		}
+	}
+}
+
+/**
+ * @brief: 遍历整个页表，统计各级页表页数、各种粒度的映射数和TLB覆盖范围
+ * @param pgtbl: 页表基址（虚拟地址）
+ * @param stats: 统计结果
+ *
+ * 一个块映射或一组连续映射只需要一个TLB条目。TLB覆盖范围按 TLB_MAIN_ENTRIES 个条目
+ * 优先缓存最大的映射估计，即访问局部性最好时TLB能够覆盖的内存大小
+*/
+void get_pgtbl_stats(void *pgtbl, struct pgtbl_stats *stats)
+{
+	unsigned long left = TLB_MAIN_ENTRIES, n;
+	struct {
+		unsigned long nr;
+		size_t size;
+	} entries[4];
+
+	BUG_ON(pgtbl == NULL);
+	memset(stats, 0, sizeof(*stats));
+	pgtbl_stats_in_ptp((ptp_t *)pgtbl, L0, stats);
+
+	entries[0].nr = stats->nr_l1_blocks;
+	entries[0].size = LEVEL_ENTRY_SIZE(L1);
+	entries[1].nr = stats->nr_l2_blocks;
+	entries[1].size = LEVEL_ENTRY_SIZE(L2);
+	entries[2].nr = stats->nr_cont_pages / CONT_PTES;
+	entries[2].size = CONT_PTE_SIZE;
+	entries[3].nr = stats->nr_pages - stats->nr_cont_pages;
+	entries[3].size = PAGE_SIZE;
+
+	for (int i = 0; i < ARRAY_SIZE(entries); i++) {
+		stats->mapped_size += entries[i].nr * entries[i].size;
+		stats->nr_tlb_entries += entries[i].nr;
+		n = MIN(entries[i].nr, left);
+		stats->tlb_reach += n * entries[i].size;
+		left -= n;
+	}
+}
+
+/**
+ * @brief: 打印页表的统计信息，用于调试
+*/
+void print_pgtbl_stats(void *pgtbl)
+{
+	struct pgtbl_stats stats;
+
+	get_pgtbl_stats(pgtbl, &stats);
+	kinfo("page table %p: %lu/%lu/%lu/%lu table pages (L0/L1/L2/L3), %luKB\n", pgtbl, stats.nr_ptps[0],
+	      stats.nr_ptps[1], stats.nr_ptps[2], stats.nr_ptps[3],
+	      (stats.nr_ptps[0] + stats.nr_ptps[1] + stats.nr_ptps[2] + stats.nr_ptps[3]) * PAGE_SIZE / 1024);
+	kinfo("  %lu 1GB blocks, %lu 2MB blocks, %lu 4KB pages (%lu in 64KB contiguous groups), %luMB mapped\n",
+	      stats.nr_l1_blocks, stats.nr_l2_blocks, stats.nr_pages, stats.nr_cont_pages, stats.mapped_size >> 20);
+	kinfo("  %lu TLB entries to map all, TLB reach %luMB with %d entries\n", stats.nr_tlb_entries,
+	      stats.tlb_reach >> 20, TLB_MAIN_ENTRIES);
+}
+
+/* mprotect 修改的权限位：AP[2:1]、PXN、UXN */
+#define PTE_PROT_MASK (AARCH64_MMU_PTE_AP_MASK | AARCH64_MMU_PTE_PXN_MASK | AARCH64_MMU_PTE_UXN_MASK)
+#define PTE_PROT_RIGHTS (VMR_READ | VMR_WRITE | VMR_EXEC)
+
+struct protect_ctx {
+	long *rss;
+	/* 新的权限位，只包含 PTE_PROT_MASK 中的位 */
+	u64 prot;
+	/* 写时复制的页表项使用的权限位：AP保持只读，可写权限记录在 SW_WRITE 中 */
+	u64 cow_prot;
+	/* 只记录权限降低的范围 */
+	struct tlb_gather *tlb;
+};
+
+static u64 protect_pte(struct protect_ctx *ctx, u64 pte)
+{
+	if (pte & AARCH64_MMU_PTE_SW_COW)
+		return (pte & ~(PTE_PROT_MASK | AARCH64_MMU_PTE_SW_WRITE)) | ctx->cow_prot;
+	/* 清除 DBM，否则去掉写权限之后硬件仍会在写入时把页改为可写 */
+	return (pte & ~(PTE_PROT_MASK | AARCH64_MMU_PTE_DBM_MASK)) | ctx->prot;
+}
+
+/**
+ * @brief: 修改从entry开始的nr个叶子页表项的权限位。
+ *         只增加权限时不失效TLB：其他CPU上残留的旧条目最多造成一次假的权限错误，
+ *         由缺页处理失效本CPU上的条目后重新执行；去掉了任何权限时记录到gather中，由调用者统一失效
+ * @param ctx: 新的权限位以及gather
+ * @param entry: 第一个页表项，nr个页表项的权限相同
+ * @param nr: 页表项的个数，修改整组连续映射时为 CONT_PTES
+ * @param va: 起始虚拟地址
+ * @param len: nr个页表项覆盖的长度
+*/
+static void protect_leaf_ptes(struct protect_ctx *ctx, pte_t *entry, int nr, vaddr_t va, size_t len)
+{
+	u64 first = entry->pte;
+	vmr_prop_t removed;
+	u64 old, new;
+
+	if (protect_pte(ctx, first) == first)
+		return;
+
+	/* 硬件可能同时在更新访问标志和脏状态，用CAS修改，不会覆盖硬件的更新 */
+	for (int i = 0; i < nr; i++) {
+		do {
+			old = entry[i].pte;
+			new = protect_pte(ctx, old);
+		} while (new != old && atomic_cmpxchg_64(&entry[i].pte, old, new) != old);
+	}
+
+	/* 按用户态实际的权限比较：AP从RW改为 RW_EL0_NA 同样去掉了用户态的读写权限 */
+	removed = pte_to_vmr_prop(first) & ~pte_to_vmr_prop(entry->pte) & PTE_PROT_RIGHTS;
+	if (removed)
+		tlb_gather_add_range(ctx->tlb, va, len);
+}
+
+/**
+ * @brief: 修改ptp中[va, end)范围内映射的权限，递归处理下一级页表
+ * @return: 0 on success, -ENOMEM 如果拆分块映射时无法分配页表页
+*/
+static int protect_range_in_ptp(ptp_t *ptp, u32 level, vaddr_t va, vaddr_t end, struct protect_ctx *ctx)
+{
+	size_t entry_size = LEVEL_ENTRY_SIZE(level);
+	vaddr_t entry_start, next;
+	pte_t *entry;
+	int ret;
+
+	for (; va != end; va = next) {
+		entry_start = ROUND_DOWN(va, entry_size);
+		next = entry_start + entry_size;
+		/* 地址空间的最后一项会回绕到0 */
+		if (next - 1 >= end - 1)
+			next = end;
+
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte))
+			continue;
+
+		if (level == L3 && IS_PTE_CONT(entry->pte)) {
+			/*
+			 * 整组修改时直接改写每一项：在TLB失效之前，TLB可能使用组内任意一项的权限，
+			 * 即修改前或修改后的权限，失效之后整组一致。只修改其中一部分时组内的权限将永远不一致，
+			 * 必须先拆开整组
+			 */
+			if (IS_ALIGNED(va, CONT_PTE_SIZE) && end - va >= CONT_PTE_SIZE) {
+				protect_leaf_ptes(ctx, entry, CONT_PTES, va, CONT_PTE_SIZE);
+				next = va + CONT_PTE_SIZE;
+				continue;
+			}
+			unfold_cont_ptes(ctx->tlb->pgtbl, ptp, GET_INDEX_IN_LEVEL(va, level), va);
+		}
+
+		if (level == L3 || !IS_PTE_TABLE(entry->pte)) {
+			if (va == entry_start && next - va == entry_size) {
+				protect_leaf_ptes(ctx, entry, 1, va, entry_size);
+				continue;
+			}
+			/* 只修改块映射的一部分，先拆分为下一级映射 */
+			ret = split_block_pte(entry, level, entry_start, ctx->rss);
+			if (ret < 0)
+				return ret;
+		}
+
+		ret = protect_range_in_ptp((ptp_t *)GET_NEXT_PTP(entry), level + 1, va, next, ctx);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief: 一次遍历修改用户页表中[va, va + len)范围内已有映射的访问权限（AP/UXN/PXN），
+ *         物理地址、内存类型等其他属性保持不变，未映射的地址被跳过
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 虚拟地址，需要按页对齐
+ * @param len: 长度
+ * @param flags: 新的权限，只使用 VMR_READ、VMR_WRITE 和 VMR_EXEC
+ * @param rss: 拆分块映射时新分配的页表页计入rss
+ * @return: 0 on success, -ENOMEM 如果拆分块映射时无法分配页表页，此时部分范围的权限可能已经修改
+ *
+ * 范围只覆盖块映射或连续映射组的一部分时，先拆分再修改。所有页表项修改完成后只失效一次TLB，
+ * 并且只失效权限降低的范围，只增加权限时完全不失效TLB。写时复制的页保持只读，
+ * 可写权限记录在 SW_WRITE 中，写入时由 handle_cow_fault 复制
+*/
+int protect_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, vmr_prop_t flags, long *rss)
+{
+	struct protect_ctx ctx;
+	struct tlb_gather tlb;
+	size_t aligned_len = ROUND_UP(len, PAGE_SIZE);
+	pte_t new_pte_val;
+	int ret;
+
+	BUG_ON(pgtbl == NULL);
+	BUG_ON(va % PAGE_SIZE);
+	if (aligned_len == 0)
+		return 0;
+
+	new_pte_val.pte = 0;
+	set_pte_flags(&new_pte_val, flags & PTE_PROT_RIGHTS, USER_PTE);
+	ctx.prot = new_pte_val.pte & PTE_PROT_MASK;
+	new_pte_val.pte = 0;
+	set_pte_flags(&new_pte_val, (flags & (VMR_READ | VMR_EXEC)) | ((flags & VMR_WRITE) ? VMR_READ : 0), USER_PTE);
+	ctx.cow_prot = new_pte_val.pte & PTE_PROT_MASK;
+	if (flags & VMR_WRITE)
+		ctx.cow_prot |= AARCH64_MMU_PTE_SW_WRITE;
+	ctx.rss = rss;
+	ctx.tlb = &tlb;
+
+	tlb_gather_init(&tlb, pgtbl);
+	ret = protect_range_in_ptp((ptp_t *)pgtbl, L0, va, va + aligned_len, &ctx);
+	tlb_gather_flush(&tlb);
+	if (ret < 0)
+		kwarn("protect range [0x%lx, 0x%lx) failed: %d\n", va, va + len, ret);
+	return ret;
+}
+
+struct cow_ctx {
+	/* 新分配的页表页和复制的映射计入子地址空间的rss */
+	long *rss;
+	/* 拆分父地址空间的块映射时新分配的页表页计入父地址空间的rss */
+	long *src_rss;
+	/* 父地址空间中变为只读的范围 */
+	struct tlb_gather *tlb;
+};
+
+/**
+ * @brief: 判断叶子页表项映射的是否是私有内存：页表管理的页（refcount 不为0）在复制地址空间时写时复制，
+ *         设备内存和由调用者管理的页在父子地址空间之间直接共享。后者没有引用计数，无法判断是否只剩一个映射，
+ *         写时复制的话每次写入都要复制一次。块映射只检查首页，见 get_user_pages
+*/
+static bool pte_is_private(u64 pte)
+{
+	pte_t entry = { .pte = pte };
+	struct page *page = virt_to_page((void *)phys_to_virt(pte & PTE_ADDR_MASK));
+
+	return entry.l3_page.attr_index != DEVICE_MEMORY && page != NULL && page->refcount > 0;
+}
+
+/**
+ * @brief: 把私有页的页表项改为写时复制：可写的映射改为只读并设置 SW_WRITE，写入时触发权限错误。
+ *         同时清除 DBM，硬件不能再把共享的页改为可写
+*/
+static u64 cow_pte(u64 pte)
+{
+	pte_t entry = { .pte = pte };
+
+	if (entry.l3_page.AP == AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW || (pte & AARCH64_MMU_PTE_DBM_MASK)) {
+		entry.l3_page.AP = AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO;
+		entry.pte = (entry.pte & ~AARCH64_MMU_PTE_DBM_MASK) | AARCH64_MMU_PTE_SW_WRITE;
+	}
+	return entry.pte | AARCH64_MMU_PTE_SW_COW;
+}
+
+/**
+ * @brief: 复制从entry开始的nr个叶子页表项到dst_entry，私有页在父子地址空间中都改为写时复制
+ * @return: 0 on success, -EEXIST 如果dst中已有映射
+*/
+static int clone_leaf_ptes(struct cow_ctx *ctx, pte_t *entry, pte_t *dst_entry, int nr, vaddr_t va, size_t len)
+{
+	u64 pte;
+
+	for (int i = 0; i < nr; i++) {
+		if (!IS_PTE_INVALID(dst_entry[i].pte))
+			return -EEXIST;
+	}
+
+	for (int i = 0; i < nr; i++) {
+		pte = entry[i].pte;
+		if (pte_is_private(pte)) {
+			pte = cow_pte(pte);
+			/* 父地址空间中去掉了写权限，需要失效TLB */
+			if (pte & ~entry[i].pte & AARCH64_MMU_PTE_SW_WRITE)
+				tlb_gather_add_range(ctx->tlb, va, len);
+			entry[i].pte = pte;
+			if (IS_PTE_TABLE(pte))
+				get_user_page(pte & PTE_ADDR_MASK);
+			else
+				get_user_pages(pte & PTE_ADDR_MASK, len);
+		}
+		dst_entry[i].pte = pte;
+	}
+	if (ctx->rss)
+		*ctx->rss += len;
+	return 0;
+}
+
+/**
+ * @brief: 把src中[va, end)范围内的映射复制到dst的相同位置，递归处理下一级页表
+ * @return: 0 on success, -ENOMEM 如果无法分配页表页, -EEXIST 如果dst中该范围已有映射
+*/
+static int clone_range_in_ptp(ptp_t *src, ptp_t *dst, u32 level, vaddr_t va, vaddr_t end, struct cow_ctx *ctx)
+{
+	size_t entry_size = LEVEL_ENTRY_SIZE(level);
+	vaddr_t entry_start, next;
+	pte_t *entry, *dst_entry;
+	ptp_t *new_ptp;
+	int ret;
+
+	for (; va != end; va = next) {
+		entry_start = ROUND_DOWN(va, entry_size);
+		next = entry_start + entry_size;
+		/* 地址空间的最后一项会回绕到0 */
+		if (next - 1 >= end - 1)
+			next = end;
+
+		entry = &src->ent[GET_INDEX_IN_LEVEL(va, level)];
+		dst_entry = &dst->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte))
+			continue;
+
+		if (level == L3 && IS_PTE_CONT(entry->pte)) {
+			/* 整组复制时一次修改整组，组内保持一致；只复制一部分时先拆开整组 */
+			if (IS_ALIGNED(va, CONT_PTE_SIZE) && end - va >= CONT_PTE_SIZE) {
+				ret = clone_leaf_ptes(ctx, entry, dst_entry, CONT_PTES, va, CONT_PTE_SIZE);
+				if (ret < 0)
+					return ret;
+				next = va + CONT_PTE_SIZE;
+				continue;
+			}
+			unfold_cont_ptes(ctx->tlb->pgtbl, src, GET_INDEX_IN_LEVEL(va, level), va);
+		}
+
+		if (level == L3 || !IS_PTE_TABLE(entry->pte)) {
+			if (va == entry_start && next - va == entry_size) {
+				ret = clone_leaf_ptes(ctx, entry, dst_entry, 1, va, entry_size);
+				if (ret < 0)
+					return ret;
+				continue;
+			}
+			/* 只复制块映射的一部分，先拆分为下一级映射 */
+			ret = split_block_pte(entry, level, entry_start, ctx->src_rss);
+			if (ret < 0)
+				return ret;
+		}
+
+		if (IS_PTE_INVALID(dst_entry->pte)) {
+			new_ptp = alloc_ptp();
+			if (new_ptp == NULL)
+				return -ENOMEM;
+			if (ctx->rss)
+				*ctx->rss += PAGE_SIZE;
+			dst_entry->pte = 0;
+			dst_entry->table.is_valid = 1;
+			dst_entry->table.is_table = 1;
+			dst_entry->table.next_table_addr = virt_to_phys((vaddr_t)new_ptp) >> PAGE_SHIFT;
+		} else if (!IS_PTE_TABLE(dst_entry->pte)) {
+			return -EEXIST;
+		}
+
+		ret = clone_range_in_ptp((ptp_t *)GET_NEXT_PTP(entry), (ptp_t *)GET_NEXT_PTP(dst_entry), level + 1, va,
+					 next, ctx);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief: 把用户页表src中[va, va + len)范围内的映射以写时复制的方式复制到dst，用于复制地址空间。
+ *         私有页在父子地址空间中都映射为只读，不复制任何页的内容，之后哪一方写入，
+ *         就由 handle_cow_fault 只复制被写入的那一页；设备内存等其他映射直接共享
+ * @param dst: 子地址空间的页表基址（虚拟地址），该范围内不能已有映射
+ * @param src: 父地址空间的页表基址（虚拟地址）
+ * @param va: 虚拟地址，需要按页对齐
+ * @param len: 长度
+ * @param rss: 子地址空间的rss，计入复制的映射和新分配的页表页
+ * @param src_rss: 父地址空间的rss，计入拆分块映射时新分配的页表页
+ * @return: 0 on success, -ENOMEM 如果无法分配页表页, -EEXIST 如果dst中该范围已有映射
+ *
+ * 写时复制的页增加引用计数。由调用者管理的页（refcount 为0）不计数，在父子地址空间中直接共享，
+ * 仍由调用者释放
+*/
+int clone_range_in_pgtbl_cow(void *dst, void *src, vaddr_t va, size_t len, long *rss, long *src_rss)
+{
+	struct tlb_gather tlb;
+	struct cow_ctx ctx = { .rss = rss, .src_rss = src_rss, .tlb = &tlb };
+	size_t aligned_len = ROUND_UP(len, PAGE_SIZE);
+	int ret;
+
+	BUG_ON(dst == NULL || src == NULL);
+	BUG_ON(va % PAGE_SIZE);
+	if (aligned_len == 0)
+		return 0;
+
+	tlb_gather_init(&tlb, src);
+	ret = clone_range_in_ptp((ptp_t *)src, (ptp_t *)dst, L0, va, va + aligned_len, &ctx);
+	tlb_gather_flush(&tlb);
+	dsb(ishst);
+	if (ret < 0)
+		kwarn("clone range [0x%lx, 0x%lx) failed: %d\n", va, va + len, ret);
+	return ret;
+}
+
+/* 可写的写时复制页 */
+#define PTE_COW_WRITE (AARCH64_MMU_PTE_SW_COW | AARCH64_MMU_PTE_SW_WRITE)
+
+/**
+ * @brief: 处理用户地址va上的写权限错误：如果va映射的是可写的写时复制页，复制该页并映射为可写。
+ *         块映射先拆分，只复制被写入的页；该页只剩这一个映射时不复制，直接改为可写
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 出错的虚拟地址
+ * @param rss: 拆分块映射时新分配的页表页计入rss。其他CPU可能同时处理缺页，调用者应传入局部变量，
+ *             之后原子地累加到地址空间
+ * @return: 0 on success, -EFAULT 如果va没有映射、不是写时复制的页或映射本身不可写, -ENOMEM
+ *
+ * 调用者持有 vmspace 的读锁，同一地址空间的其他CPU可能同时处理缺页。页表项在其所在页表页的锁内检查和修改，
+ * 复制页时不持有锁，复制完成后页表项已经变化（其他CPU处理了同一个错误）时放弃复制的页
+*/
+int handle_cow_fault(void *pgtbl, vaddr_t va, long *rss)
+{
+	ptp_t *ptp = (ptp_t *)pgtbl;
+	struct tlb_gather tlb;
+	struct lock *ptl;
+	struct page *page;
+	pte_t *entry;
+	pte_t new_pte_val;
+	u64 old_pte;
+	void *copy;
+	paddr_t pa;
+	u32 level;
+	int ret;
+
+	va = ROUND_DOWN(va, PAGE_SIZE);
+	for (level = L0;; level++) {
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		/* 其他CPU正在拆分块映射，重新执行出错的指令 */
+		if (entry->pte == PTE_DESCRIPTOR_BUSY)
+			return 0;
+		if (IS_PTE_INVALID(entry->pte))
+			return -EFAULT;
+		if (level == L3)
+			break;
+		if (!IS_PTE_TABLE(entry->pte)) {
+			ptl = pte_lockptr(entry);
+			lock(ptl);
+			ret = 0;
+			/* 其他CPU可能已经拆分了该块 */
+			if (!IS_PTE_TABLE(entry->pte)) {
+				if ((entry->pte & PTE_COW_WRITE) != PTE_COW_WRITE)
+					ret = -EFAULT;
+				else
+					ret = split_block_pte(entry, level, ROUND_DOWN(va, LEVEL_ENTRY_SIZE(level)),
+							      rss);
+			}
+			unlock(ptl);
+			if (ret < 0)
+				return ret;
+		}
+		ptp = (ptp_t *)GET_NEXT_PTP(entry);
+	}
+
+	ptl = pte_lockptr(entry);
+	lock(ptl);
+	if ((entry->pte & PTE_COW_WRITE) != PTE_COW_WRITE) {
+		unlock(ptl);
+		return -EFAULT;
+	}
+	if (IS_PTE_CONT(entry->pte))
+		unfold_cont_ptes(pgtbl, ptp, GET_L3_INDEX(va), va);
+
+	old_pte = entry->pte;
+	pa = old_pte & PTE_ADDR_MASK;
+	new_pte_val.pte = old_pte & ~PTE_COW_WRITE;
+	new_pte_val.l3_page.AP = AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW;
+
+	/* 只剩这一个映射，直接改为可写。只增加了权限，不需要失效TLB。写时复制的页都由页表管理，见 pte_is_private */
+	page = virt_to_page((void *)phys_to_virt(pa));
+	BUG_ON(page == NULL || page->refcount == 0);
+	if (page->refcount == 1) {
+		entry->pte = new_pte_val.pte;
+		dsb(ishst);
+		unlock(ptl);
+		return 0;
+	}
+	unlock(ptl);
+
+	copy = get_pages(0);
+	if (copy == NULL)
+		return -ENOMEM;
+	/* 所有映射都是只读的，复制期间原来的页不会被修改。持有 vmspace 读锁时该映射不会被解除，页不会被释放 */
+	memcpy(copy, (void *)phys_to_virt(pa), PAGE_SIZE);
+	virt_to_page(copy)->refcount = 1;
+
+	lock(ptl);
+	if (entry->pte != old_pte) {
+		unlock(ptl);
+		free_pages(copy);
+		return 0;
+	}
+	/* 虚拟地址不变，复制得到的页与原来的页属于同一个 anon_vma */
+	page_add_anon_rmap(virt_to_page(copy), page->anon_vma, va);
+	/* 修改输出地址需要 break-before-make，原来的页在失效TLB之后才可能被释放 */
+	tlb_gather_init(&tlb, pgtbl);
+	entry->pte = PTE_DESCRIPTOR_INVALID;
+	tlb_gather_add_range(&tlb, va, PAGE_SIZE);
+	put_user_page(&tlb, pa);
+	tlb_gather_flush(&tlb);
+
+	entry->pte = (new_pte_val.pte & ~PTE_ADDR_MASK) | virt_to_phys((vaddr_t)copy);
+	dsb(ishst);
+	unlock(ptl);
+	return 0;
+}
+
+/**
+ * @brief: 找到va的L3页表项
+ * @param l3_ptp: 返回页表项所在的L3页表页
+ * @return: 页表项, NULL 如果va没有映射或使用块映射
+*/
+static pte_t *get_l3_pte(void *pgtbl, vaddr_t va, ptp_t **l3_ptp)
+{
+	ptp_t *ptp = (ptp_t *)pgtbl;
+	pte_t *entry;
+
+	for (u32 level = L0; level < L3; level++) {
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte) || !IS_PTE_TABLE(entry->pte))
+			return NULL;
+		ptp = (ptp_t *)GET_NEXT_PTP(entry);
+	}
+	entry = &ptp->ent[GET_L3_INDEX(va)];
+	if (IS_PTE_INVALID(entry->pte))
+		return NULL;
+	*l3_ptp = ptp;
+	return entry;
+}
+
+/**
+ * @brief: 页迁移的第一步：使va的页表项失效并把va记录到tlb中，调用者使一批页表项都失效后统一失效TLB
+ * @param pgtbl: 页表基址（虚拟地址）
+ * @param va: 虚拟地址
+ * @param saved: 返回失效前的页表项，包括硬件更新的访问标志和脏状态，之后传给 restore_pte_in_pgtbl
+ * @param tlb: 记录需要失效的地址，pgtbl 需与之相同
+ * @return: 0 on success, -EFAULT 如果va没有使用4KB页映射
+ *
+ * 调用者持有地址空间的写锁，页表项失效期间不会有缺页处理或其他修改。所在的一组连续映射先被拆开，
+ * 拆开时单独失效一次TLB
+*/
+int take_pte_in_pgtbl(void *pgtbl, vaddr_t va, u64 *saved, struct tlb_gather *tlb)
+{
+	ptp_t *l3_ptp;
+	pte_t *entry;
+
+	va = ROUND_DOWN(va, PAGE_SIZE);
+	entry = get_l3_pte(pgtbl, va, &l3_ptp);
+	if (entry == NULL)
+		return -EFAULT;
+	if (IS_PTE_CONT(entry->pte))
+		unfold_cont_ptes(pgtbl, l3_ptp, GET_L3_INDEX(va), va);
+	/* 硬件可能同时在更新访问标志和脏状态 */
+	*saved = atomic_exchange_64((s64 *)&entry->pte, PTE_DESCRIPTOR_INVALID);
+	tlb_gather_add_range(tlb, va, PAGE_SIZE);
+	return 0;
+}
+
+/**
+ * @brief: 页迁移的最后一步：以saved的属性把 take_pte_in_pgtbl 失效的页表项重新映射到pa。
+ *         页表项已经失效并失效过TLB，直接写入即可
+ * @param pgtbl: 页表基址（虚拟地址）
+ * @param va: 虚拟地址
+ * @param saved: take_pte_in_pgtbl 返回的页表项
+ * @param pa: 新的物理页
+*/
+void restore_pte_in_pgtbl(void *pgtbl, vaddr_t va, u64 saved, paddr_t pa)
+{
+	ptp_t *ptp = (ptp_t *)pgtbl;
+	pte_t *entry;
+
+	for (u32 level = L0; level < L3; level++) {
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		BUG_ON(!IS_PTE_TABLE(entry->pte));
+		ptp = (ptp_t *)GET_NEXT_PTP(entry);
+	}
+	entry = &ptp->ent[GET_L3_INDEX(va)];
+	BUG_ON(!IS_PTE_INVALID(entry->pte));
+	entry->pte = (saved & ~PTE_ADDR_MASK) | pa;
+	dsb(ishst);
+}
+
+/**
+ * @brief: 判断va所在的2MB中是否还没有任何映射（L2项无效或者上级页表页还不存在）。
+ *         不持页表锁的检查只是提示，用于在分配和清零大页之前排除已有映射的情况
+*/
+bool huge_range_unmapped_in_pgtbl(void *pgtbl, vaddr_t va)
+{
+	ptp_t *ptp = (ptp_t *)pgtbl;
+	pte_t *entry;
+
+	for (u32 level = L0; level < L2; level++) {
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte))
+			return true;
+		if (!IS_PTE_TABLE(entry->pte))
+			return false;
+		ptp = (ptp_t *)GET_NEXT_PTP(entry);
+	}
+	return IS_PTE_INVALID(ptp->ent[GET_L2_INDEX(va)].pte);
+}
+
+/**
+ * @brief: 用一个L2块映射把2MB的大页映射到va，用于只持有 vmspace 读锁的缺页处理。
+ *         与中间级页表页相同用CAS安装，不会覆盖其他CPU同时安装的页表页、大页或正在拆分的块映射
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 虚拟地址，需要按 HUGE_PAGE_SIZE 对齐
+ * @param pa: 大页的物理地址，需要按 HUGE_PAGE_SIZE 对齐，内容已经初始化
+ * @param flags: 映射属性
+ * @param rss: 新分配的页表页和大页计入rss
+ * @return: 0 on success, -EEXIST 如果这2MB中已经有映射, -ENOMEM 如果无法分配页表页
+*/
+int map_huge_page_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa, vmr_prop_t flags, long *rss)
+{
+	ptp_t *l1_ptp, *l2_ptp;
+	pte_t *entry, new_pte_val;
+	int ret;
+
+	BUG_ON(!IS_ALIGNED(va, HUGE_PAGE_SIZE) || !IS_ALIGNED(pa, HUGE_PAGE_SIZE));
+
+	ret = get_next_ptp((ptp_t *)pgtbl, L0, va, &l1_ptp, &entry, true, rss);
+	if (ret == NORMAL_PTP)
+		ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &entry, true, rss);
+	if (ret < 0)
+		return ret;
+	if (ret == BLOCK_PTP)
+		return -EEXIST;
+
+	set_block_pte(&new_pte_val, L2, pa, flags, USER_PTE);
+	entry = &l2_ptp->ent[GET_L2_INDEX(va)];
+	/* 其他CPU通过该项看到的是已经初始化的大页 */
+	smp_wmb();
+	if (atomic_cmpxchg_64(&entry->pte, PTE_DESCRIPTOR_INVALID, new_pte_val.pte) != PTE_DESCRIPTOR_INVALID)
+		return -EEXIST;
+	dsb(ishst);
+	isb();
+	if (rss)
+		*rss += HUGE_PAGE_SIZE;
+	return 0;
+}
+
+/**
+ * @brief: 把va所在的L2块映射拆分为 PTP_ENTRIES 个页映射，va不是块映射时什么都不做。
+ *         用于只能处理4KB页映射的操作，如页迁移。调用者持有 vmspace 的写锁
+ * @return: 0 on success, -ENOMEM 如果无法分配页表页
+*/
+int split_huge_page_in_pgtbl(void *pgtbl, vaddr_t va, long *rss)
+{
+	ptp_t *ptp = (ptp_t *)pgtbl;
+	pte_t *entry;
+
+	for (u32 level = L0; level < L2; level++) {
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte) || !IS_PTE_TABLE(entry->pte))
+			return 0;
+		ptp = (ptp_t *)GET_NEXT_PTP(entry);
+	}
+	entry = &ptp->ent[GET_L2_INDEX(va)];
+	if (IS_PTE_INVALID(entry->pte) || IS_PTE_TABLE(entry->pte))
+		return 0;
+	return split_block_pte(entry, L2, ROUND_DOWN(va, HUGE_PAGE_SIZE), rss);
+}
+
+/* 收拢为大页时，L3页表页中最多允许的空页表项数，空的位置在大页中填0 */
+#define HUGE_COLLAPSE_MAX_NONE (PTP_ENTRIES / 8)
+
+/**
+ * @brief: 把va开始的2MB中逐页建立的映射收拢为一个大页：复制每一页的内容到新分配的2MB连续内存，
+ *         用一个L2块映射替换原来的L3页表页，然后释放原来的页和页表页
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 虚拟地址，需要按 HUGE_PAGE_SIZE 对齐，这2MB属于同一个匿名区域
+ * @param anon_vma: 区域的 anon_vma，大页中的每一页都加入其中
+ * @param rss: 填充的空页和回收的页表页计入rss
+ * @return: 0 on success, -EINVAL 如果不满足收拢的条件, -ENOMEM
+ *
+ * 只收拢所有页都只映射在这里（refcount 为1，不是写时复制的共享页）、属性相同，并且空的页表项
+ * 不超过 HUGE_COLLAPSE_MAX_NONE 个的L3页表页。属性比较忽略访问标志和 DBM 页的脏状态，
+ * 收拢后任意一页被写过整个大页都是脏的。
+ * 调用者持有 vmspace 的写锁，没有缺页处理同时进行，但其他CPU上的用户程序仍可能在读写这些页，
+ * 因此先使L2页表项失效并失效TLB，之后再读取页表项和复制内容
+*/
+int collapse_huge_page_in_pgtbl(void *pgtbl, vaddr_t va, struct anon_vma *anon_vma, long *rss)
+{
+	u64 ignore = PTE_ADDR_MASK | AARCH64_MMU_PTE_CONT_MASK | AARCH64_MMU_PTE_AF_MASK;
+	ptp_t *ptp = (ptp_t *)pgtbl;
+	struct tlb_gather tlb;
+	struct page *page;
+	pte_t *entry;
+	ptp_t *l3_ptp;
+	u64 pte, attrs = 0;
+	int nr_none = 0;
+	paddr_t pa;
+	void *huge;
+
+	BUG_ON(!IS_ALIGNED(va, HUGE_PAGE_SIZE));
+
+	for (u32 level = L0; level <= L2; level++) {
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte) || !IS_PTE_TABLE(entry->pte))
+			return -EINVAL;
+		ptp = (ptp_t *)GET_NEXT_PTP(entry);
+	}
+	l3_ptp = ptp;
+
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		pte = l3_ptp->ent[i].pte;
+		if (IS_PTE_INVALID(pte)) {
+			if (++nr_none > HUGE_COLLAPSE_MAX_NONE)
+				return -EINVAL;
+			continue;
+		}
+		page = virt_to_page((void *)phys_to_virt(pte & PTE_ADDR_MASK));
+		if (page == NULL || page->refcount != 1 || (pte & AARCH64_MMU_PTE_SW_COW))
+			return -EINVAL;
+		if (attrs == 0) {
+			attrs = pte;
+			if (pte & AARCH64_MMU_PTE_DBM_MASK)
+				ignore |= AARCH64_MMU_PTE_RDONLY_MASK;
+		} else if ((pte ^ attrs) & ~ignore) {
+			return -EINVAL;
+		}
+	}
+
+	huge = get_pages(HUGE_PAGE_ORDER);
+	if (huge == NULL)
+		return -ENOMEM;
+
+	/* 替换中间级页表项同样需要 break-before-make，同时失效页表遍历缓存中指向L3页表页的条目 */
+	tlb_gather_init(&tlb, pgtbl);
+	entry->pte = PTE_DESCRIPTOR_INVALID;
+	tlb_gather_add_range(&tlb, va, HUGE_PAGE_SIZE);
+	tlb.freed_tables = true;
+	tlb_gather_flush(&tlb);
+
+	/* 之后硬件不会再更新这些页表项，其中的访问标志和脏状态是最终的 */
+	attrs = (attrs & ~(PTE_ADDR_MASK | AARCH64_MMU_PTE_TABLE_MASK | AARCH64_MMU_PTE_CONT_MASK)) |
+		AARCH64_MMU_PTE_AF_MASK;
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		pte = l3_ptp->ent[i].pte;
+		if (IS_PTE_INVALID(pte)) {
+			memset((char *)huge + i * PAGE_SIZE, 0, PAGE_SIZE);
+			continue;
+		}
+		pa = pte & PTE_ADDR_MASK;
+		memcpy((char *)huge + i * PAGE_SIZE, (void *)phys_to_virt(pa), PAGE_SIZE);
+		/* 被写过的页（见 pte_is_dirty） */
+		if (!(pte & AARCH64_MMU_PTE_RDONLY_MASK))
+			attrs &= ~AARCH64_MMU_PTE_RDONLY_MASK;
+		l3_ptp->ent[i].pte = PTE_DESCRIPTOR_INVALID;
+		put_user_page(&tlb, pa);
+	}
+	free_ptp(l3_ptp);
+
+	page = virt_to_page(huge);
+	buddy_split_pages(page);
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		page[i].refcount = 1;
+		page_add_anon_rmap(&page[i], anon_vma, va + i * PAGE_SIZE);
+	}
+	if (rss) {
+		*rss += nr_none * PAGE_SIZE;
+		*rss -= PAGE_SIZE;
+	}
+
+	entry->pte = attrs | virt_to_phys((vaddr_t)huge);
+	dsb(ishst);
+	/* 释放原来的页，TLB已经失效过 */
+	tlb_gather_flush(&tlb);
+	return 0;
+}
+
+/* 硬件是否更新访问标志（TCR_EL1.HA）和脏状态（TCR_EL1.HD） */
+static bool hw_access_flag;
+static bool hw_dirty;
+
+/**
+ * @brief: 根据 ID_AA64MMFR1_EL1.HAFDBS 开启硬件更新访问标志和脏状态。不支持时访问标志由
+ *         handle_access_fault 在访问标志错误中设置，不跟踪脏状态。每个CPU都需要设置自己的 TCR_EL1
+*/
+void init_hw_access_dirty(void)
+{
+	u64 hafdbs = read_sysreg(id_aa64mmfr1_el1) & ID_AA64MMFR1_EL1_HAFDBS_MASK;
+	u64 tcr = read_sysreg(tcr_el1);
+
+	hw_access_flag = hafdbs >= ID_AA64MMFR1_EL1_HAFDBS_AF;
+	hw_dirty = hafdbs >= ID_AA64MMFR1_EL1_HAFDBS_DBM;
+	if (hw_access_flag)
+		tcr |= TCR_EL1_HA;
+	if (hw_dirty)
+		tcr |= TCR_EL1_HD;
+	write_sysreg(tcr, tcr_el1);
+	isb();
+	/* TCR_EL1 的字段可能被缓存在TLB中 */
+	flush_tlb_all();
+
+	kinfo("hardware access flag %s, hardware dirty state %s\n", hw_access_flag ? "on" : "off",
+	      hw_dirty ? "on" : "off");
+}
+
+bool pgtbl_hw_dirty(void)
+{
+	return hw_dirty;
+}
+
+/**
+ * @brief: 判断页表项映射的页是否被写过：DBM 干净页的AP为只读，硬件在第一次写入时把它改为可写。
+ *         没有设置 DBM 的可写页无法判断，按脏页处理
+*/
+static bool pte_is_dirty(u64 pte)
+{
+	return !(pte & AARCH64_MMU_PTE_RDONLY_MASK);
+}
+
+void parse_pte_to_common(pte_t *pte, unsigned int level, struct common_pte_t *ret)
+{
+	BUG_ON(level != L3 && !IS_PTE_INVALID(pte->pte) && IS_PTE_TABLE(pte->pte));
+
+	ret->pfn = (pte->pte & PTE_ADDR_MASK) >> PAGE_SHIFT;
+	ret->perm = pte_to_vmr_prop(pte->pte);
+	ret->valid = !IS_PTE_INVALID(pte->pte);
+	ret->access = !!(pte->pte & AARCH64_MMU_PTE_AF_MASK);
+	ret->dirty = pte_is_dirty(pte->pte);
+	ret->_unused = 0;
+}
+
+struct harvest_ctx {
+	struct pgtbl_ws_sample *sample;
+	/* 清除了访问标志或脏状态的范围 */
+	struct tlb_gather *tlb;
+};
+
+/**
+ * @brief: 计算清除访问标志和脏状态后的页表项
+ * @param pte: 叶子页表项
+ * @param accessed: 返回上次清除之后是否被访问过
+ * @param dirty: 返回上次清除之后是否被写入过
+*/
+static u64 harvest_pte(u64 pte, bool *accessed, bool *dirty)
+{
+	u64 new = pte & ~AARCH64_MMU_PTE_AF_MASK;
+
+	*accessed = !!(pte & AARCH64_MMU_PTE_AF_MASK);
+	*dirty = false;
+	/* 写时复制的页只读，写入时复制出的新页不共享，之后才开始跟踪 */
+	if (!hw_dirty || (pte & AARCH64_MMU_PTE_SW_COW) || !pte_is_dirty(pte))
+		return new;
+
+	/* 已经开始跟踪的页被写过；第一次扫描到的可写页不知道之前是否被写过，也按脏页计算 */
+	*dirty = true;
+	return new | AARCH64_MMU_PTE_DBM_MASK | AARCH64_MMU_PTE_RDONLY_MASK;
+}
+
+/**
+ * @brief: 采样并清除从entry开始的nr个叶子页表项的访问标志和脏状态。硬件可能同时在更新这些页表项，
+ *         用CAS修改，不会覆盖硬件的更新。连续映射组作为一个整体，组内任意一项被访问或写入，整组都计入
+ * @param ctx: 统计结果以及gather
+ * @param entry: 第一个页表项
+ * @param nr: 页表项的个数，连续映射组为 CONT_PTES
+ * @param va: nr个页表项覆盖的起始虚拟地址
+ * @param len: nr个页表项覆盖的长度
+ * @param nr_pages: 其中在扫描范围内的页数
+*/
+static void harvest_leaf_ptes(struct harvest_ctx *ctx, pte_t *entry, int nr, vaddr_t va, size_t len,
+			      unsigned long nr_pages)
+{
+	bool accessed = false, dirty = false, a, d;
+	bool changed = false;
+	pte_t first = { .pte = entry->pte };
+	u64 old, new;
+
+	/* 设备内存不计入工作集 */
+	if (first.l3_page.attr_index == DEVICE_MEMORY)
+		return;
+
+	for (int i = 0; i < nr; i++) {
+		do {
+			old = entry[i].pte;
+			new = harvest_pte(old, &a, &d);
+		} while (new != old && atomic_cmpxchg_64(&entry[i].pte, old, new) != old);
+		accessed |= a;
+		dirty |= d;
+		changed |= new != old;
+	}
+
+	ctx->sample->nr_pages += nr_pages;
+	if (accessed)
+		ctx->sample->nr_accessed += nr_pages;
+	if (dirty)
+		ctx->sample->nr_dirty += nr_pages;
+	/* TLB中缓存的旧条目不会再更新页表项，需要失效才能采样到之后的访问和写入 */
+	if (changed)
+		tlb_gather_add_range(ctx->tlb, va, len);
+}
+
+/**
+ * @brief: 采样ptp中[va, end)范围内的映射，递归处理下一级页表
+*/
+static void harvest_range_in_ptp(ptp_t *ptp, u32 level, vaddr_t va, vaddr_t end, struct harvest_ctx *ctx)
+{
+	size_t entry_size = LEVEL_ENTRY_SIZE(level);
+	vaddr_t entry_start, next, group_va;
+	pte_t *entry;
+
+	for (; va != end; va = next) {
+		entry_start = ROUND_DOWN(va, entry_size);
+		next = entry_start + entry_size;
+		/* 地址空间的最后一项会回绕到0 */
+		if (next - 1 >= end - 1)
+			next = end;
+
+		entry = &ptp->ent[GET_INDEX_IN_LEVEL(va, level)];
+		if (IS_PTE_INVALID(entry->pte))
+			continue;
+
+		if (level == L3 && IS_PTE_CONT(entry->pte)) {
+			/* 不拆开整组，范围只覆盖一部分时也整组清除，组内的访问标志保持一致 */
+			group_va = ROUND_DOWN(va, CONT_PTE_SIZE);
+			next = group_va + CONT_PTE_SIZE;
+			if (next - 1 >= end - 1)
+				next = end;
+			harvest_leaf_ptes(ctx, &ptp->ent[GET_L3_INDEX(group_va)], CONT_PTES, group_va, CONT_PTE_SIZE,
+					  (next - va) >> PAGE_SHIFT);
+			continue;
+		}
+
+		if (level == L3 || !IS_PTE_TABLE(entry->pte)) {
+			harvest_leaf_ptes(ctx, entry, 1, entry_start, entry_size, (next - va) >> PAGE_SHIFT);
+			continue;
+		}
+
+		harvest_range_in_ptp((ptp_t *)GET_NEXT_PTP(entry), level + 1, va, next, ctx);
+	}
+}
+
+/**
+ * @brief: 一次遍历采样用户页表中[va, va + len)范围内的映射自上次采样以来是否被访问、被写入，
+ *         然后清除访问标志和脏状态，用于估计工作集和空闲页。所有页表项修改完成后只失效一次TLB
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 虚拟地址，需要按页对齐
+ * @param len: 长度
+ * @param sample: 统计结果，累加到其中，调用者负责清零
+ *
+ * 硬件支持 DBM 时，可写的页在第一次扫描后变为 DBM 干净页，之后由硬件在写入时标记为脏，不会产生异常；
+ * 不支持时不统计脏页。硬件不更新访问标志时，之后第一次访问会产生访问标志错误，由 handle_access_fault 设置。
+ * 内核通过 uaccess 访问用户内存时使用内核的映射，写入后由 mark_dirty_in_pgtbl 标记为脏
+*/
+void harvest_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, struct pgtbl_ws_sample *sample)
+{
+	struct tlb_gather tlb;
+	struct harvest_ctx ctx = { .sample = sample, .tlb = &tlb };
+	size_t aligned_len = ROUND_UP(len, PAGE_SIZE);
+
+	BUG_ON(pgtbl == NULL);
+	BUG_ON(va % PAGE_SIZE);
+	if (aligned_len == 0)
+		return;
+
+	tlb_gather_init(&tlb, pgtbl);
+	harvest_range_in_ptp((ptp_t *)pgtbl, L0, va, va + aligned_len, &ctx);
+	tlb_gather_flush(&tlb);
+}
+
+/**
+ * @brief: 把用户地址va上的 DBM 干净页标记为脏，并设置访问标志。内核通过线性映射写入用户页时硬件不会更新
+ *         用户页表项，需要像硬件一样清除 AP[2]，否则工作集采样会把被写过的页当作干净页。
+ *         两者都只增加权限，TLB中缓存的旧条目最多造成一次假权限错误，不需要失效TLB
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 被写入的虚拟地址
+ * @return: 0 on success, -EFAULT 如果va没有映射
+*/
+int mark_dirty_in_pgtbl(void *pgtbl, vaddr_t va)
+{
+	pte_t *entry;
+	paddr_t pa;
+	u64 old, new;
+
+	if (query_in_pgtbl(pgtbl, va, &pa, &entry) != 0)
+		return -EFAULT;
+	/* 硬件可能同时在更新该页表项 */
+	do {
+		old = entry->pte;
+		new = old | AARCH64_MMU_PTE_AF_MASK;
+		if (old & AARCH64_MMU_PTE_DBM_MASK)
+			new &= ~AARCH64_MMU_PTE_RDONLY_MASK;
+	} while (new != old && atomic_cmpxchg_64(&entry->pte, old, new) != old);
+	dsb(ishst);
+	return 0;
+}
+
+/**
+ * @brief: 处理用户地址va上的访问标志错误：硬件不更新访问标志时，被 harvest_range_in_pgtbl 清除了访问标志的页
+ *         第一次访问会出错，设置访问标志后重新执行出错的指令即可。访问标志为0的页表项不会被缓存在TLB中，
+ *         不需要失效TLB
+ * @param pgtbl: 用户页表基址（虚拟地址）
+ * @param va: 出错的虚拟地址
+ * @return: 0 on success, -EFAULT 如果va没有映射
+*/
+int handle_access_fault(void *pgtbl, vaddr_t va)
+{
+	pte_t *entry;
+	paddr_t pa;
+	int nr = 1;
+
+	if (query_in_pgtbl(pgtbl, va, &pa, &entry) != 0)
+		return -EFAULT;
+	/* 连续映射组整组设置 */
+	if (IS_PTE_CONT(entry->pte)) {
+		entry = (pte_t *)ROUND_DOWN((vaddr_t)entry, CONT_PTES * sizeof(pte_t));
+		nr = CONT_PTES;
+	}
+	for (int i = 0; i < nr; i++)
+		atomic_fetch_or_64(&entry[i].pte, AARCH64_MMU_PTE_AF_MASK);
+	dsb(ishst);
+	return 0;
+}
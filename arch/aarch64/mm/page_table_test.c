@@ -0,0 +1,537 @@
+#include <arch/boot.h>
+#include <arch/machine/pmu.h>
+#include <arch/machine/registers.h>
+#include <common/errno.h>
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/common_pte.h>
+#include <mm/page_table.h>
+#include <mm/tlb.h>
+#include <mm/ptp_cache.h>
+
+#define SZ_4K (PAGE_SIZE)
+#define SZ_64K (CONT_PTE_SIZE)
+#define SZ_2M (L2_PER_ENTRY_PAGES << PAGE_SHIFT)
+#define SZ_1G (L1_PER_ENTRY_PAGES << PAGE_SHIFT)
+
+/* 缓冲区起始地址只按64KB对齐，避免使用2MB块映射 */
+#define CONT_BENCH_VA (SZ_1G + SZ_64K)
+#define CONT_BENCH_ORDER (10)
+#define CONT_BENCH_SIZE (BUDDY_CHUNK_SIZE(CONT_BENCH_ORDER))
+#define CONT_BENCH_ROUNDS (64)
+
+static void check_mapping(void *pgtbl, vaddr_t va, paddr_t pa, size_t len, bool block)
+{
+	paddr_t got;
+	pte_t *pte;
+
+	for (size_t off = 0; off < len; off += MAX(len / 8, SZ_4K)) {
+		assert(query_in_pgtbl(pgtbl, va + off, &got, &pte) == 0);
+		assert(got == pa + off);
+		assert(IS_PTE_TABLE(pte->pte) == !block);
+	}
+	assert(query_in_pgtbl(pgtbl, va + len - 8, &got, &pte) == 0 && got == pa + len - 8);
+}
+
+static bool pte_is_cont(void *pgtbl, vaddr_t va)
+{
+	paddr_t pa;
+	pte_t *pte;
+
+	assert(query_in_pgtbl(pgtbl, va, &pa, &pte) == 0);
+	return IS_PTE_CONT(pte->pte);
+}
+
+struct collect_runs {
+	struct pgtbl_run runs[8];
+	int nr;
+};
+
+static int collect_run(struct pgtbl_run *run, void *arg)
+{
+	struct collect_runs *c = arg;
+
+	assert(c->nr < ARRAY_SIZE(c->runs));
+	c->runs[c->nr++] = *run;
+	return 0;
+}
+
+void page_table_test(void)
+{
+	unsigned long free_mem, free_now, nr_cached;
+	void *ptps[PTP_CACHE_MAX + PTP_CACHE_BATCH];
+	void *pgtbl, *child, *child2, *buf;
+	struct tlb_gather tlb;
+	struct collect_runs c;
+	struct pgtbl_ws_sample sample;
+	struct pgtbl_stats stats;
+	struct page *pages[CONT_PTES + 4];
+	struct common_pte_t cpte;
+	long rss = 0;
+	paddr_t pa, pa2;
+	vaddr_t va;
+	pte_t *pte;
+
+	/* 回收的页表页留在页表页缓存中，比较空闲内存之前先还给伙伴系统 */
+	ptp_cache_drain();
+	free_mem = get_free_mem_size_from_buddy();
+	pgtbl = alloc_ptp();
+	assert(pgtbl != NULL && ptp_cache_nr_pages() == PTP_CACHE_BATCH - 1);
+
+	/* 1. 1GB + 2MB + 3个页：一个L1块、一个L2块、一个L3页表，共分配L1、L2、L3三个页表页 */
+	map_range_in_pgtbl_user(pgtbl, SZ_1G, 2 * SZ_1G, SZ_1G + SZ_2M + 3 * SZ_4K, VMR_READ | VMR_WRITE, &rss);
+	assert(rss == 3 * SZ_4K + SZ_1G + SZ_2M + 3 * SZ_4K);
+	check_mapping(pgtbl, SZ_1G, 2 * SZ_1G, SZ_1G, true);
+	check_mapping(pgtbl, 2 * SZ_1G, 3 * SZ_1G, SZ_2M, true);
+	check_mapping(pgtbl, 2 * SZ_1G + SZ_2M, 3 * SZ_1G + SZ_2M, 3 * SZ_4K, false);
+
+	/* 2. 两端不对齐：页 + L2块 + 页 */
+	rss = 0;
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G + SZ_2M - SZ_4K, SZ_2M - SZ_4K, SZ_2M + 2 * SZ_4K, VMR_READ, &rss);
+	/* 新增一个L2页表页和两个L3页表页 */
+	assert(rss == 3 * SZ_4K + SZ_2M + 2 * SZ_4K);
+	check_mapping(pgtbl, 4 * SZ_1G + SZ_2M - SZ_4K, SZ_2M - SZ_4K, SZ_4K, false);
+	check_mapping(pgtbl, 4 * SZ_1G + SZ_2M, SZ_2M, SZ_2M, true);
+	check_mapping(pgtbl, 4 * SZ_1G + 2 * SZ_2M, 2 * SZ_2M, SZ_4K, false);
+
+	/* 3. pa 不按块对齐时只能使用页映射 */
+	rss = 0;
+	map_range_in_pgtbl_user(pgtbl, 6 * SZ_1G, SZ_4K, SZ_2M, VMR_READ, &rss);
+	assert(rss == 2 * SZ_4K + SZ_2M);
+	check_mapping(pgtbl, 6 * SZ_1G, SZ_4K, SZ_2M, false);
+	/* 统计以上三种映射：TLB 条目数超过 TLB_MAIN_ENTRIES 时，覆盖范围只计入最大的那些映射 */
+	get_pgtbl_stats(pgtbl, &stats);
+	assert(stats.nr_ptps[0] == 1 && stats.nr_ptps[1] == 1 && stats.nr_ptps[2] == 3 && stats.nr_ptps[3] == 4);
+	assert(stats.nr_l1_blocks == 1 && stats.nr_l2_blocks == 2 && stats.nr_pages == 517 && stats.nr_cont_pages == 0);
+	assert(stats.mapped_size == SZ_1G + 2 * SZ_2M + 517 * SZ_4K);
+	assert(stats.nr_tlb_entries == 520);
+	assert(stats.tlb_reach == SZ_1G + 2 * SZ_2M + (TLB_MAIN_ENTRIES - 3) * SZ_4K);
+
+	/* 4. 解除映射，页表页随之回收 */
+	rss = 0;
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G, SZ_1G + SZ_2M + 3 * SZ_4K, &rss) == 0);
+	assert(unmap_range_in_pgtbl(pgtbl, 4 * SZ_1G + SZ_2M - SZ_4K, SZ_2M + 2 * SZ_4K, &rss) == 0);
+	assert(unmap_range_in_pgtbl(pgtbl, 6 * SZ_1G, SZ_2M, &rss) == 0);
+	assert(rss == -(long)(SZ_1G + 3 * SZ_2M + 5 * SZ_4K + 8 * SZ_4K));
+	assert(query_in_pgtbl(pgtbl, SZ_1G, &pa, NULL) != 0);
+	assert(query_in_pgtbl(pgtbl, 4 * SZ_1G + SZ_2M, &pa, NULL) != 0);
+	assert(query_in_pgtbl(pgtbl, 6 * SZ_1G, &pa, NULL) != 0);
+	ptp_cache_drain();
+	assert(get_free_mem_size_from_buddy() == free_mem - SZ_4K);
+
+	/* 5. 只解除块映射的一部分：L1块拆分为L2块，跨越的两个L2块再拆分为页 */
+	rss = 0;
+	map_range_in_pgtbl_user(pgtbl, SZ_1G, 2 * SZ_1G, SZ_1G, VMR_READ | VMR_WRITE, &rss);
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G + SZ_2M - SZ_4K, 2 * SZ_4K, &rss) == 0);
+	assert(rss == 4 * SZ_4K + SZ_1G - 2 * SZ_4K);
+	check_mapping(pgtbl, SZ_1G, 2 * SZ_1G, SZ_2M - SZ_4K, false);
+	check_mapping(pgtbl, SZ_1G + SZ_2M + SZ_4K, 2 * SZ_1G + SZ_2M + SZ_4K, SZ_2M - SZ_4K, false);
+	check_mapping(pgtbl, SZ_1G + 2 * SZ_2M, 2 * SZ_1G + 2 * SZ_2M, SZ_1G - 2 * SZ_2M, true);
+	assert(query_in_pgtbl(pgtbl, SZ_1G + SZ_2M - SZ_4K, &pa, NULL) != 0);
+	assert(query_in_pgtbl(pgtbl, SZ_1G + SZ_2M, &pa, NULL) != 0);
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G, SZ_1G, &rss) == 0);
+	assert(rss == 0);
+
+	/* 6. 多次解除映射共用一个 tlb_gather，相邻的范围合并，超过最大范围数后标记为溢出 */
+	tlb_gather_init(&tlb, pgtbl);
+	map_range_in_pgtbl_user(pgtbl, SZ_1G, SZ_1G, 8 * SZ_4K, VMR_READ, &rss);
+	assert(unmap_range_in_pgtbl_gather(pgtbl, SZ_1G, 2 * SZ_4K, &rss, &tlb) == 0);
+	assert(unmap_range_in_pgtbl_gather(pgtbl, SZ_1G + 2 * SZ_4K, 2 * SZ_4K, &rss, &tlb) == 0);
+	assert(tlb.nr_ranges == 1 && tlb.nr_pages == 4 && !tlb.freed_tables);
+	assert(unmap_range_in_pgtbl_gather(pgtbl, SZ_1G + 5 * SZ_4K, 3 * SZ_4K, &rss, &tlb) == 0);
+	assert(tlb.nr_ranges == 2 && tlb.nr_pages == 7 && !tlb.freed_tables);
+	/* 最后一页解除后L3、L2、L1页表页被回收，但在 flush 之前不会放回页表页缓存 */
+	nr_cached = ptp_cache_nr_pages();
+	assert(unmap_range_in_pgtbl_gather(pgtbl, SZ_1G + 4 * SZ_4K, SZ_4K, &rss, &tlb) == 0);
+	assert(tlb.nr_ranges == 2 && tlb.nr_pages == 8 && tlb.freed_tables);
+	assert(ptp_cache_nr_pages() == nr_cached && !list_empty(&tlb.free_tables));
+	for (int i = 0; i < TLB_GATHER_MAX_RANGES; i++)
+		tlb_gather_add_range(&tlb, 2 * SZ_1G + i * SZ_2M, SZ_4K);
+	assert(tlb.overflow);
+	/* 该页表从未被加载过，flush 只需清空记录 */
+	tlb_gather_flush(&tlb);
+	assert(tlb.nr_ranges == 0 && tlb.nr_pages == 0 && !tlb.overflow && !tlb.freed_tables);
+	assert(ptp_cache_nr_pages() == nr_cached + 3 && list_empty(&tlb.free_tables));
+	assert(rss == 0);
+	/* 释放的页超过数组大小时挂在链表上，不会在记录后面的范围之前提前失效并释放 */
+	for (int i = 0; i < 2 * TLB_GATHER_MAX_PAGES; i++) {
+		buf = get_pages(0);
+		virt_to_page(buf)->refcount = 1;
+		map_range_in_pgtbl_user(pgtbl, SZ_1G + i * SZ_4K, virt_to_phys(buf), SZ_4K, VMR_READ, &rss);
+	}
+	assert(unmap_range_in_pgtbl_gather(pgtbl, SZ_1G, 2 * TLB_GATHER_MAX_PAGES * SZ_4K, &rss, &tlb) == 0);
+	assert(tlb.nr_free_pages == TLB_GATHER_MAX_PAGES && !list_empty(&tlb.free_list));
+	assert(tlb.nr_pages == 2 * TLB_GATHER_MAX_PAGES);
+	tlb_gather_flush(&tlb);
+	assert(tlb.nr_free_pages == 0 && list_empty(&tlb.free_list));
+	assert(rss == 0);
+
+	/* 7. 按64KB对齐的连续页设置 Contiguous 位，修改其中一项时拆开整组，逐页映射凑齐一组后重新合并 */
+	map_range_in_pgtbl_user(pgtbl, SZ_1G + SZ_64K, 2 * SZ_1G, 3 * SZ_64K + SZ_4K, VMR_READ, &rss);
+	for (int i = 1; i <= 3; i++) {
+		assert(pte_is_cont(pgtbl, SZ_1G + i * SZ_64K));
+		assert(pte_is_cont(pgtbl, SZ_1G + (i + 1) * SZ_64K - SZ_4K));
+	}
+	assert(!pte_is_cont(pgtbl, SZ_1G + 4 * SZ_64K));
+	get_pgtbl_stats(pgtbl, &stats);
+	assert(stats.nr_pages == 49 && stats.nr_cont_pages == 48 && stats.nr_tlb_entries == 4);
+	assert(stats.tlb_reach == 3 * SZ_64K + SZ_4K);
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G + 2 * SZ_64K + SZ_4K, SZ_4K, &rss) == 0);
+	assert(!pte_is_cont(pgtbl, SZ_1G + 2 * SZ_64K) && !pte_is_cont(pgtbl, SZ_1G + 3 * SZ_64K - SZ_4K));
+	assert(pte_is_cont(pgtbl, SZ_1G + SZ_64K) && pte_is_cont(pgtbl, SZ_1G + 3 * SZ_64K));
+	check_mapping(pgtbl, SZ_1G + 2 * SZ_64K + 2 * SZ_4K, 2 * SZ_1G + SZ_64K + 2 * SZ_4K, SZ_64K - 2 * SZ_4K, false);
+	map_range_in_pgtbl_user(pgtbl, SZ_1G + 2 * SZ_64K + SZ_4K, 2 * SZ_1G + SZ_64K + SZ_4K, SZ_4K, VMR_READ, &rss);
+	assert(pte_is_cont(pgtbl, SZ_1G + 2 * SZ_64K) && pte_is_cont(pgtbl, SZ_1G + 3 * SZ_64K - SZ_4K));
+	/* 属性不同的页不会合并 */
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G + 2 * SZ_64K, SZ_4K, &rss) == 0);
+	map_range_in_pgtbl_user(pgtbl, SZ_1G + 2 * SZ_64K, 2 * SZ_1G + SZ_64K, SZ_4K, VMR_READ | VMR_WRITE, &rss);
+	assert(!pte_is_cont(pgtbl, SZ_1G + 2 * SZ_64K + SZ_4K));
+	/* 整组解除 */
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G + SZ_64K, 3 * SZ_64K + SZ_4K, &rss) == 0);
+	assert(rss == 0);
+
+	/* 8. 范围遍历：L2块和之后物理连续、属性相同的页合并为一段，属性不同或有空洞时分段 */
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G, SZ_1G, SZ_2M + 3 * SZ_4K, VMR_READ | VMR_WRITE, &rss);
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G + SZ_2M + 3 * SZ_4K, SZ_1G + SZ_2M + 3 * SZ_4K, SZ_4K, VMR_READ, &rss);
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G + SZ_2M + 8 * SZ_4K, SZ_4K, SZ_4K, VMR_READ | VMR_EXEC, &rss);
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(pgtbl, 4 * SZ_1G + 100, SZ_2M + 16 * SZ_4K, collect_run, &c) == 0);
+	assert(c.nr == 3);
+	assert(c.runs[0].va == 4 * SZ_1G + 100 && c.runs[0].pa == SZ_1G + 100);
+	assert(c.runs[0].len == SZ_2M + 3 * SZ_4K - 100 && c.runs[0].flags == (VMR_READ | VMR_WRITE));
+	assert(c.runs[1].va == 4 * SZ_1G + SZ_2M + 3 * SZ_4K && c.runs[1].len == SZ_4K && c.runs[1].flags == VMR_READ);
+	assert(c.runs[2].pa == SZ_4K && c.runs[2].flags == (VMR_READ | VMR_EXEC));
+	assert(unmap_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M + 9 * SZ_4K, &rss) == 0);
+	assert(rss == 0);
+
+	/* 9. 修改权限：只修改块映射或连续映射组的一部分时先拆分，恢复之后相邻映射仍合并为一段 */
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G, SZ_1G, SZ_2M, VMR_READ | VMR_WRITE, &rss);
+	assert(protect_range_in_pgtbl(pgtbl, 4 * SZ_1G + SZ_64K + SZ_4K, SZ_4K, VMR_READ, &rss) == 0);
+	assert(pte_is_cont(pgtbl, 4 * SZ_1G) && !pte_is_cont(pgtbl, 4 * SZ_1G + SZ_64K));
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M, collect_run, &c) == 0);
+	assert(c.nr == 3 && c.runs[1].va == 4 * SZ_1G + SZ_64K + SZ_4K && c.runs[1].len == SZ_4K);
+	assert(c.runs[1].pa == SZ_1G + SZ_64K + SZ_4K && c.runs[1].flags == VMR_READ);
+	assert(c.runs[0].flags == (VMR_READ | VMR_WRITE) && c.runs[2].flags == (VMR_READ | VMR_WRITE));
+	/* 整组修改时保留 Contiguous 位，未映射的地址被跳过 */
+	assert(protect_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M + SZ_64K, VMR_READ | VMR_EXEC, &rss) == 0);
+	assert(pte_is_cont(pgtbl, 4 * SZ_1G + 2 * SZ_64K));
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M, collect_run, &c) == 0);
+	assert(c.nr == 1 && c.runs[0].len == SZ_2M && c.runs[0].flags == (VMR_READ | VMR_EXEC));
+	/* PROT_NONE：AP为 RW_EL0_NA，用户态既不能读也不能写，按去掉权限处理 */
+	assert(protect_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_64K, 0, &rss) == 0);
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M, collect_run, &c) == 0);
+	assert(c.nr == 2 && c.runs[0].len == SZ_64K && c.runs[0].flags == 0);
+	assert(c.runs[1].flags == (VMR_READ | VMR_EXEC));
+	assert(unmap_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M, &rss) == 0);
+	assert(rss == 0);
+
+	/* 10. 页表页缓存：回收的页表页放回缓存并被再次分配，缓存满时归还一批给伙伴系统 */
+	map_range_in_pgtbl_user(pgtbl, SZ_1G, 0, SZ_4K, VMR_READ, &rss);
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G, SZ_4K, &rss) == 0);
+	free_now = get_free_mem_size_from_buddy();
+	map_range_in_pgtbl_user(pgtbl, SZ_1G, 0, SZ_4K, VMR_READ, &rss);
+	assert(get_free_mem_size_from_buddy() == free_now);
+	assert(unmap_range_in_pgtbl(pgtbl, SZ_1G, SZ_4K, &rss) == 0);
+	assert(rss == 0);
+	for (int i = 0; i < ARRAY_SIZE(ptps); i++) {
+		ptps[i] = alloc_ptp();
+		assert(ptps[i] != NULL && ((u64 *)ptps[i])[i % PTP_ENTRIES] == 0);
+	}
+	for (int i = 0; i < ARRAY_SIZE(ptps); i++)
+		free_ptp(ptps[i]);
+	assert(ptp_cache_nr_pages() <= PTP_CACHE_MAX);
+
+	/* 11. 写时复制：复制后页表管理的页在父子中都只读，写入时只复制被写入的页，设备内存直接共享 */
+	child = alloc_ptp();
+	child2 = alloc_ptp();
+	buf = get_pages(9);
+	/* 前16页同时被块映射和连续映射映射，全部解除映射后所有页都被释放 */
+	buddy_split_pages(virt_to_page(buf));
+	for (int i = 0; i < PTP_ENTRIES; i++)
+		virt_to_page(buf)[i].refcount = i < CONT_PTES ? 2 : 1;
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G, virt_to_phys(buf), SZ_2M, VMR_READ | VMR_WRITE, &rss);
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G + SZ_2M, virt_to_phys(buf), SZ_64K, VMR_READ | VMR_WRITE, &rss);
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G + SZ_2M + SZ_64K, SZ_4K, SZ_4K, VMR_READ | VMR_WRITE | VMR_DEVICE,
+				&rss);
+	rss = 0;
+	assert(clone_range_in_pgtbl_cow(child, pgtbl, 4 * SZ_1G, SZ_2M + SZ_64K + SZ_4K, &rss, NULL) == 0);
+	assert(rss == 3 * SZ_4K + SZ_2M + SZ_64K + SZ_4K);
+	for (int i = 0; i < 2; i++) {
+		c.nr = 0;
+		assert(walk_range_in_pgtbl(i ? child : pgtbl, 4 * SZ_1G, SZ_2M + SZ_64K + SZ_4K, collect_run, &c) == 0);
+		assert(c.nr == 3 && c.runs[0].flags == (VMR_READ | VMR_WRITE | VMR_COW));
+		assert(c.runs[1].flags == (VMR_READ | VMR_WRITE | VMR_COW));
+		assert(c.runs[2].flags == (VMR_READ | VMR_WRITE | VMR_DEVICE));
+		assert(pte_is_cont(i ? child : pgtbl, 4 * SZ_1G + SZ_2M));
+	}
+	/* 写入块映射中的一页：拆分块映射，只复制这一页 */
+	((u64 *)buf)[3 * PAGE_SIZE / sizeof(u64)] = 0x1234;
+	rss = 0;
+	assert(handle_cow_fault(child, 4 * SZ_1G + 3 * SZ_4K + 8, &rss) == 0);
+	assert(rss == SZ_4K);
+	assert(query_in_pgtbl(child, 4 * SZ_1G + 3 * SZ_4K, &pa, NULL) == 0);
+	assert(pa != virt_to_phys(buf) + 3 * SZ_4K && *(u64 *)phys_to_virt(pa) == 0x1234);
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(child, 4 * SZ_1G, SZ_2M, collect_run, &c) == 0);
+	assert(c.nr == 3 && c.runs[1].len == SZ_4K && c.runs[1].flags == (VMR_READ | VMR_WRITE));
+	assert(c.runs[2].pa == virt_to_phys(buf) + 4 * SZ_4K);
+	assert(handle_cow_fault(child, 4 * SZ_1G + 3 * SZ_4K, NULL) == -EFAULT);
+	assert(handle_cow_fault(child, 4 * SZ_1G + SZ_2M + SZ_64K, NULL) == -EFAULT);
+	/* 只复制块映射的一部分时拆分父地址空间中的块 */
+	rss = 0;
+	assert(clone_range_in_pgtbl_cow(child2, pgtbl, 4 * SZ_1G + 5 * SZ_4K, SZ_4K, NULL, &rss) == 0);
+	assert(rss == SZ_4K && virt_to_page(buf)[5].refcount == 5);
+	/* 复制出的页再被共享：先写入的一方复制，剩下的一方直接改为可写 */
+	assert(clone_range_in_pgtbl_cow(child2, child, 4 * SZ_1G + 3 * SZ_4K, SZ_4K, NULL, NULL) == 0);
+	assert(handle_cow_fault(child2, 4 * SZ_1G + 3 * SZ_4K, NULL) == 0);
+	assert(query_in_pgtbl(child2, 4 * SZ_1G + 3 * SZ_4K, &pa2, NULL) == 0 && pa2 != pa);
+	assert(handle_cow_fault(child, 4 * SZ_1G + 3 * SZ_4K, NULL) == 0);
+	assert(query_in_pgtbl(child, 4 * SZ_1G + 3 * SZ_4K, &pa2, NULL) == 0 && pa2 == pa);
+	/* 写时复制的页去掉写权限后写入不再复制，恢复写权限后仍然只读，直到写入时复制 */
+	assert(protect_range_in_pgtbl(child, 4 * SZ_1G + SZ_2M, SZ_64K, VMR_READ, NULL) == 0);
+	assert(handle_cow_fault(child, 4 * SZ_1G + SZ_2M, NULL) == -EFAULT);
+	assert(protect_range_in_pgtbl(child, 4 * SZ_1G + SZ_2M, SZ_64K, VMR_READ | VMR_WRITE, NULL) == 0);
+	assert(pte_is_cont(child, 4 * SZ_1G + SZ_2M));
+	assert(handle_cow_fault(child, 4 * SZ_1G + SZ_2M, NULL) == 0 && !pte_is_cont(child, 4 * SZ_1G + SZ_2M));
+	/* 解除映射时释放复制出的页 */
+	assert(unmap_range_in_pgtbl(child2, 4 * SZ_1G, SZ_2M, NULL) == 0);
+	assert(unmap_range_in_pgtbl(child, 4 * SZ_1G, SZ_2M + SZ_64K + SZ_4K, NULL) == 0);
+	assert(unmap_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_2M + SZ_64K + SZ_4K, NULL) == 0);
+	free_ptp(child);
+	free_ptp(child2);
+	/* 由调用者管理的页（refcount 为0）直接共享，写入时不复制 */
+	buf = get_pages(0);
+	map_range_in_pgtbl_user(pgtbl, 4 * SZ_1G, virt_to_phys(buf), SZ_4K, VMR_READ | VMR_WRITE, NULL);
+	child = alloc_ptp();
+	assert(clone_range_in_pgtbl_cow(child, pgtbl, 4 * SZ_1G, SZ_4K, NULL, NULL) == 0);
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(child, 4 * SZ_1G, SZ_4K, collect_run, &c) == 0);
+	assert(c.nr == 1 && c.runs[0].flags == (VMR_READ | VMR_WRITE) && c.runs[0].pa == virt_to_phys(buf));
+	assert(handle_cow_fault(child, 4 * SZ_1G, NULL) == -EFAULT);
+	assert(unmap_range_in_pgtbl(child, 4 * SZ_1G, SZ_4K, NULL) == 0);
+	assert(unmap_range_in_pgtbl(pgtbl, 4 * SZ_1G, SZ_4K, NULL) == 0);
+	free_ptp(child);
+	free_pages(buf);
+
+	/* 12. 工作集采样：采样后清除访问标志和脏状态，连续映射组整组采样，设备内存不计入 */
+	buf = get_pages(4);
+	/* 由页表管理，复制时写时复制。前4页被映射两次 */
+	buddy_split_pages(virt_to_page(buf));
+	for (int i = 0; i < CONT_PTES; i++)
+		virt_to_page(buf)[i].refcount = i < 4 ? 2 : 1;
+	assert(map_range_in_pgtbl_user(pgtbl, 5 * SZ_1G, virt_to_phys(buf), SZ_64K, VMR_READ | VMR_WRITE, NULL) == 0);
+	assert(map_range_in_pgtbl_user(pgtbl, 5 * SZ_1G + 2 * SZ_64K, virt_to_phys(buf), 4 * SZ_4K,
+				       VMR_READ | VMR_WRITE, NULL) == 0);
+	assert(map_range_in_pgtbl_user(pgtbl, 5 * SZ_1G + 3 * SZ_64K, 0x3f000000, SZ_4K, VMR_READ | VMR_DEVICE,
+				       NULL) == 0);
+	assert(pte_is_cont(pgtbl, 5 * SZ_1G));
+	/* 新建立的映射访问标志为1，可写的页在开始跟踪之前按脏页计算 */
+	memset(&sample, 0, sizeof(sample));
+	harvest_range_in_pgtbl(pgtbl, 5 * SZ_1G, 4 * SZ_64K, &sample);
+	assert(sample.nr_pages == 20 && sample.nr_accessed == 20);
+	assert(sample.nr_dirty == (pgtbl_hw_dirty() ? 20 : 0));
+	memset(&sample, 0, sizeof(sample));
+	harvest_range_in_pgtbl(pgtbl, 5 * SZ_1G, 4 * SZ_64K, &sample);
+	assert(sample.nr_pages == 20 && sample.nr_accessed == 0 && sample.nr_dirty == 0);
+	/* 采样不改变映射的权限 */
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(pgtbl, 5 * SZ_1G, SZ_64K, collect_run, &c) == 0);
+	assert(c.nr == 1 && c.runs[0].flags == (VMR_READ | VMR_WRITE));
+	assert(query_in_pgtbl(pgtbl, 5 * SZ_1G + 2 * SZ_64K, &pa, &pte) == 0);
+	parse_pte_to_common(pte, L3, &cpte);
+	assert(cpte.valid && !cpte.access && cpte.perm == (VMR_READ | VMR_WRITE));
+	/* 访问标志错误设置整组的访问标志，只采样组的一部分时也清除整组 */
+	assert(handle_access_fault(pgtbl, 5 * SZ_1G + SZ_4K) == 0);
+	assert(handle_access_fault(pgtbl, 5 * SZ_1G + 2 * SZ_64K + SZ_4K) == 0);
+	assert(handle_access_fault(pgtbl, 5 * SZ_1G + SZ_64K) == -EFAULT);
+	parse_pte_to_common(pte + 1, L3, &cpte);
+	assert(cpte.access);
+	memset(&sample, 0, sizeof(sample));
+	harvest_range_in_pgtbl(pgtbl, 5 * SZ_1G + 2 * SZ_4K, SZ_4K, &sample);
+	assert(sample.nr_pages == 1 && sample.nr_accessed == 1);
+	memset(&sample, 0, sizeof(sample));
+	harvest_range_in_pgtbl(pgtbl, 5 * SZ_1G, 4 * SZ_64K, &sample);
+	assert(sample.nr_pages == 20 && sample.nr_accessed == 1);
+	if (pgtbl_hw_dirty()) {
+		/* 模拟硬件在写入时清除 AP[2] */
+		pte->pte &= ~AARCH64_MMU_PTE_RDONLY_MASK;
+		parse_pte_to_common(pte, L3, &cpte);
+		assert(cpte.dirty);
+		memset(&sample, 0, sizeof(sample));
+		harvest_range_in_pgtbl(pgtbl, 5 * SZ_1G, 4 * SZ_64K, &sample);
+		assert(sample.nr_dirty == 1 && (pte->pte & AARCH64_MMU_PTE_RDONLY_MASK));
+		/* 内核通过线性映射写入之后像硬件一样标记为脏 */
+		assert(mark_dirty_in_pgtbl(pgtbl, 5 * SZ_1G + 2 * SZ_64K) == 0);
+		assert(!(pte->pte & AARCH64_MMU_PTE_RDONLY_MASK) && (pte->pte & AARCH64_MMU_PTE_DBM_MASK));
+		memset(&sample, 0, sizeof(sample));
+		harvest_range_in_pgtbl(pgtbl, 5 * SZ_1G, 4 * SZ_64K, &sample);
+		assert(sample.nr_dirty == 1 && sample.nr_accessed == 1);
+		/* 去掉写权限或写时复制时清除 DBM，硬件不能再把页改为可写 */
+		assert(protect_range_in_pgtbl(pgtbl, 5 * SZ_1G + 2 * SZ_64K, SZ_4K, VMR_READ, NULL) == 0);
+		assert(!(pte->pte & AARCH64_MMU_PTE_DBM_MASK));
+		/* 拆开连续映射组时，硬件只在其中一项上设置的访问标志和脏状态合并到整组 */
+		assert(query_in_pgtbl(pgtbl, 5 * SZ_1G + 5 * SZ_4K, &pa, &pte) == 0);
+		assert(IS_PTE_CONT(pte->pte) && !(pte[-5].pte & AARCH64_MMU_PTE_AF_MASK));
+		pte->pte = (pte->pte | AARCH64_MMU_PTE_AF_MASK) & ~AARCH64_MMU_PTE_RDONLY_MASK;
+		assert(protect_range_in_pgtbl(pgtbl, 5 * SZ_1G + SZ_4K, SZ_4K, VMR_READ | VMR_WRITE, NULL) == 0);
+		assert(!pte_is_cont(pgtbl, 5 * SZ_1G));
+		for (int i = 0; i < CONT_PTES; i++) {
+			parse_pte_to_common(&pte[i - 5], L3, &cpte);
+			assert(cpte.access && cpte.dirty && cpte.perm == (VMR_READ | VMR_WRITE));
+		}
+		child = alloc_ptp();
+		assert(clone_range_in_pgtbl_cow(child, pgtbl, 5 * SZ_1G, SZ_64K, NULL, NULL) == 0);
+		assert(query_in_pgtbl(pgtbl, 5 * SZ_1G, &pa, &pte) == 0);
+		assert(!(pte->pte & AARCH64_MMU_PTE_DBM_MASK) && (pte->pte & AARCH64_MMU_PTE_SW_WRITE));
+		assert(unmap_range_in_pgtbl(child, 5 * SZ_1G, SZ_64K, NULL) == 0);
+		free_ptp(child);
+	}
+	assert(unmap_range_in_pgtbl(pgtbl, 5 * SZ_1G, 4 * SZ_64K, NULL) == 0);
+
+	/* 13. 批量映射不连续的页：物理连续并按64KB对齐的一组设置 Contiguous 位，跨越L3页表页时继续映射 */
+	buf = get_pages(5);
+	for (int i = 0; i < CONT_PTES; i++)
+		pages[i] = virt_to_page(buf) + i;
+	for (int i = CONT_PTES; i < ARRAY_SIZE(pages); i++)
+		pages[i] = virt_to_page(buf) + 35 - i;
+	assert(map_pages_in_pgtbl(pgtbl, 7 * SZ_1G, pages, ARRAY_SIZE(pages), VMR_READ | VMR_WRITE, NULL) == 0);
+	assert(map_pages_in_pgtbl(pgtbl, 7 * SZ_1G + SZ_2M - 2 * SZ_4K, pages + CONT_PTES, 4, VMR_READ, NULL) == 0);
+	check_mapping(pgtbl, 7 * SZ_1G, virt_to_phys(buf), SZ_64K, false);
+	assert(pte_is_cont(pgtbl, 7 * SZ_1G) && !pte_is_cont(pgtbl, 7 * SZ_1G + SZ_64K));
+	for (int i = CONT_PTES; i < ARRAY_SIZE(pages); i++) {
+		assert(query_in_pgtbl(pgtbl, 7 * SZ_1G + i * SZ_4K, &pa, NULL) == 0);
+		assert(pa == virt_to_phys(buf) + (35 - i) * SZ_4K);
+		assert(query_in_pgtbl(pgtbl, 7 * SZ_1G + SZ_2M + (i - CONT_PTES - 2) * SZ_4K, &pa2, NULL) == 0);
+		assert(pa2 == pa);
+	}
+	c.nr = 0;
+	assert(walk_range_in_pgtbl(pgtbl, 7 * SZ_1G + SZ_2M - 2 * SZ_4K, 4 * SZ_4K, collect_run, &c) == 0);
+	assert(c.nr == 4 && c.runs[0].flags == VMR_READ);
+	get_pgtbl_stats(pgtbl, &stats);
+	assert(stats.nr_ptps[3] == 2 && stats.nr_pages == 24 && stats.nr_cont_pages == CONT_PTES);
+	/* 不覆盖已有的映射，返回错误时之前的页已经映射 */
+	va = 7 * SZ_1G + SZ_2M - 3 * SZ_4K;
+	assert(map_pages_in_pgtbl(pgtbl, va, pages + CONT_PTES, 2, VMR_READ, NULL) == -EEXIST);
+	assert(query_in_pgtbl(pgtbl, va, &pa, NULL) == 0 && pa == virt_to_phys(buf) + 19 * SZ_4K);
+	assert(query_in_pgtbl(pgtbl, va + SZ_4K, &pa2, NULL) == 0 && pa2 == pa);
+	assert(map_pages_in_pgtbl(pgtbl, 7 * SZ_1G + SZ_4K, pages + CONT_PTES, 1, VMR_READ, NULL) == -EEXIST);
+	assert(pte_is_cont(pgtbl, 7 * SZ_1G));
+	/* 缺页处理只安装到空的页表项，已经被映射的位置保持不变，对应的页留给调用者释放 */
+	assert(unmap_range_in_pgtbl(pgtbl, 7 * SZ_1G + 2 * SZ_4K, SZ_4K, NULL) == 0);
+	for (int i = 0; i < 4; i++)
+		pages[i] = virt_to_page(buf) + 20 + i;
+	assert(install_pages_in_pgtbl(pgtbl, 7 * SZ_1G + SZ_4K, pages, 4, VMR_READ, NULL) == 0);
+	assert(pages[0] != NULL && pages[1] == NULL && pages[2] != NULL && pages[3] != NULL);
+	assert(query_in_pgtbl(pgtbl, 7 * SZ_1G + SZ_4K, &pa, NULL) == 0 && pa == virt_to_phys(buf) + SZ_4K);
+	assert(query_in_pgtbl(pgtbl, 7 * SZ_1G + 2 * SZ_4K, &pa, NULL) == 0 && pa == virt_to_phys(buf) + 21 * SZ_4K);
+	assert(unmap_range_in_pgtbl(pgtbl, 7 * SZ_1G, SZ_2M + 2 * SZ_4K, NULL) == 0);
+	free_pages(buf);
+
+	free_ptp(pgtbl);
+	ptp_cache_drain();
+	assert(get_free_mem_size_from_buddy() == free_mem);
+	kinfo("page table test passed\n");
+}
+
+static const char kernel_pgtbl_test_rodata[] = "rodata";
+static int kernel_pgtbl_test_data = 1;
+
+/**
+ * @brief: 返回内核页表中va所在映射段的属性，并检查va的页表项是全局的
+*/
+static vmr_prop_t kernel_pgtbl_prop(vaddr_t va, bool *block)
+{
+	struct collect_runs c = { .nr = 0 };
+	paddr_t pa;
+	pte_t *pte;
+
+	assert(query_in_pgtbl(get_kernel_pgtbl(), va, &pa, &pte) == 0 && pa == va - KBASE);
+	assert(!pte->l3_page.nG);
+	*block = !IS_PTE_TABLE(pte->pte);
+	assert(walk_range_in_pgtbl(get_kernel_pgtbl(), va, 1, collect_run, &c) == 0 && c.nr == 1);
+	return c.runs[0].flags;
+}
+
+void kernel_pgtbl_test(void)
+{
+	bool block;
+
+	/* 内核镜像按段设置权限，以页为粒度映射 */
+	assert(kernel_pgtbl_prop((vaddr_t)&kernel_pgtbl_test, &block) == (VMR_READ | VMR_EXEC) && !block);
+	assert(kernel_pgtbl_prop((vaddr_t)kernel_pgtbl_test_rodata, &block) == VMR_READ && !block);
+	assert(kernel_pgtbl_prop((vaddr_t)&kernel_pgtbl_test_data, &block) == (VMR_READ | VMR_WRITE) && !block);
+	kernel_pgtbl_test_data++;
+	/* 其余内存和外设使用块映射 */
+	assert(kernel_pgtbl_prop(KBASE + ROUND_UP((paddr_t)&img_end, SZ_2M), &block) == (VMR_READ | VMR_WRITE));
+	assert(block);
+	assert(kernel_pgtbl_prop(KBASE + PHYS_MEM_END, &block) == (VMR_READ | VMR_WRITE | VMR_DEVICE) && block);
+	assert(kernel_pgtbl_prop(KBASE + PERIPHERAL_END, &block) == (VMR_READ | VMR_WRITE | VMR_DEVICE) && block);
+	kinfo("kernel page table test passed\n");
+}
+
+/**
+ * @brief: 以页为步长遍历访问缓冲区，返回周期数和 L1 数据TLB缺失次数
+*/
+static void cont_bench_stride(void *pgtbl, u64 *cycles, u64 *refills)
+{
+	u64 start, start_refills;
+
+	set_page_table(virt_to_phys(pgtbl));
+	flush_tlb_all();
+
+	start_refills = pmu_read_event_counter(0);
+	start = pmu_read_real_cycle();
+	for (int round = 0; round < CONT_BENCH_ROUNDS; round++) {
+		for (vaddr_t va = CONT_BENCH_VA; va < CONT_BENCH_VA + CONT_BENCH_SIZE; va += PAGE_SIZE)
+			(void)*(volatile u64 *)va;
+	}
+	*cycles = pmu_read_real_cycle() - start;
+	*refills = pmu_read_event_counter(0) - start_refills;
+}
+
+/**
+ * @brief: 同一块物理内存分别以连续映射（设置 Contiguous 位）和相邻页两两交换的映射（无法设置 Contiguous 位）
+ *         映射到同一虚拟地址，对比按页步长访问时的TLB缺失次数
+*/
+void page_table_bench(void)
+{
+	void *buf = get_pages(CONT_BENCH_ORDER);
+	paddr_t pa = virt_to_phys(buf);
+	void *cont_pgtbl = get_pages(0);
+	void *page_pgtbl = get_pages(0);
+	u64 saved_ttbr0 = read_sysreg(ttbr0_el1);
+	u64 cont_cycles, cont_refills, page_cycles, page_refills;
+	long rss = 0;
+
+	memset(cont_pgtbl, 0, PAGE_SIZE);
+	memset(page_pgtbl, 0, PAGE_SIZE);
+	map_range_in_pgtbl_user(cont_pgtbl, CONT_BENCH_VA, pa, CONT_BENCH_SIZE, VMR_READ, &rss);
+	for (size_t off = 0; off < CONT_BENCH_SIZE; off += PAGE_SIZE) {
+		map_range_in_pgtbl_user(page_pgtbl, CONT_BENCH_VA + off, pa + (off ^ PAGE_SIZE), PAGE_SIZE, VMR_READ,
+					&rss);
+	}
+	assert(pte_is_cont(cont_pgtbl, CONT_BENCH_VA) && !pte_is_cont(page_pgtbl, CONT_BENCH_VA));
+
+	pmu_enable_event_counter(0, PMU_EVENT_L1D_TLB_REFILL);
+	cont_bench_stride(cont_pgtbl, &cont_cycles, &cont_refills);
+	cont_bench_stride(page_pgtbl, &page_cycles, &page_refills);
+
+	set_ttbr0_el1(saved_ttbr0);
+	flush_tlb_all();
+
+	unmap_range_in_pgtbl(cont_pgtbl, CONT_BENCH_VA, CONT_BENCH_SIZE, &rss);
+	unmap_range_in_pgtbl(page_pgtbl, CONT_BENCH_VA, CONT_BENCH_SIZE, &rss);
+	free_pages(cont_pgtbl);
+	free_pages(page_pgtbl);
+	free_pages(buf);
+
+	kinfo("contiguous hint bench: %d rounds over %lu KB, contiguous %lu cycles %lu tlb refills, "
+	      "4KB pages %lu cycles %lu tlb refills\n",
+	      CONT_BENCH_ROUNDS, CONT_BENCH_SIZE / 1024, cont_cycles, cont_refills, page_cycles, page_refills);
+}
@@ -0,0 +1,250 @@
+#include <common/macro.h>
+#include <common/types.h>
+#include <arch/sync.h>
+#include <arch/machine/smp.h>
+#include <arch/machine/registers.h>
+#include <arch/mm/page_table.h>
+#include <arch/mm/asid.h>
+#include <mm/mm.h>
+#include <mm/ptp_cache.h>
+#include <mm/tlb.h>
+
+/* TLBI 指令的操作数：bits[43:0] 为 VA[55:12]，bits[63:48] 为 ASID */
+#define TLBI_VA_MASK ((1UL << 44) - 1)
+#define TLBI_VA(va) (((va) >> PAGE_SHIFT) & TLBI_VA_MASK)
+#define TLBI_ASID_SHIFT (48)
+
+#define __tlbi(op, arg) asm volatile("tlbi " #op ", %0" ::"r"(arg) : "memory")
+#define __tlbi_all(op) asm volatile("tlbi " #op ::: "memory")
+
+void tlb_gather_init(struct tlb_gather *tlb, void *pgtbl)
+{
+	tlb->pgtbl = pgtbl;
+	tlb->freed_tables = false;
+	tlb->overflow = false;
+	tlb->nr_ranges = 0;
+	tlb->nr_pages = 0;
+	tlb->nr_free_pages = 0;
+	init_list_head(&tlb->free_list);
+	init_list_head(&tlb->free_tables);
+}
+
+/**
+ * @brief: 记录一段需要失效的虚拟地址范围，与上一段相邻或重叠时合并
+ * @param tlb: gather 结构
+ * @param start: 起始虚拟地址
+ * @param len: 长度
+*/
+void tlb_gather_add_range(struct tlb_gather *tlb, vaddr_t start, size_t len)
+{
+	vaddr_t va = ROUND_DOWN(start, PAGE_SIZE);
+	vaddr_t end = ROUND_UP(start + len, PAGE_SIZE);
+	struct tlb_range *last;
+
+	if (len == 0)
+		return;
+	tlb->nr_pages += (end - va) >> PAGE_SHIFT;
+	if (tlb->overflow)
+		return;
+
+	if (tlb->nr_ranges > 0) {
+		last = &tlb->ranges[tlb->nr_ranges - 1];
+		if (va <= last->end && end >= last->start) {
+			/* 重叠部分不应重复计数 */
+			tlb->nr_pages -= (MIN(end, last->end) - MAX(va, last->start)) >> PAGE_SHIFT;
+			last->start = MIN(va, last->start);
+			last->end = MAX(end, last->end);
+			return;
+		}
+	}
+
+	if (tlb->nr_ranges == TLB_GATHER_MAX_RANGES) {
+		tlb->overflow = true;
+		return;
+	}
+	tlb->ranges[tlb->nr_ranges].start = va;
+	tlb->ranges[tlb->nr_ranges].end = end;
+	tlb->nr_ranges++;
+}
+
+/**
+ * @brief: 暂存一个解除映射后要释放的页，在 tlb_gather_flush 失效TLB之后释放。数组满时挂在链表上
+ * @param tlb: gather 结构
+ * @param page: 要释放的页，已经不在伙伴系统的空闲链表上，page->node 可以借用
+*/
+void tlb_gather_free_page(struct tlb_gather *tlb, struct page *page)
+{
+	if (tlb->nr_free_pages == TLB_GATHER_MAX_PAGES)
+		list_append(&page->node, &tlb->free_list);
+	else
+		tlb->free_pages[tlb->nr_free_pages++] = page;
+}
+
+/**
+ * @brief: 暂存一个回收的页表页，在 tlb_gather_flush 失效TLB之后放回页表页缓存，并标记需要失效中间级条目
+ * @param tlb: gather 结构
+ * @param ptp: 页表页，所有页表项都已经无效，且已经从上一级页表中移除
+*/
+void tlb_gather_free_table(struct tlb_gather *tlb, void *ptp)
+{
+	list_append(&virt_to_page(ptp)->node, &tlb->free_tables);
+	tlb->freed_tables = true;
+}
+
+/**
+ * @brief: 释放暂存的页，链表上的页每次取出 TLB_GATHER_MAX_PAGES 个批量释放
+*/
+static void tlb_gather_free_pages(struct tlb_gather *tlb)
+{
+	struct page *page, *tmp;
+
+	while (tlb->nr_free_pages) {
+		buddy_free_pages_bulk(tlb->free_pages, tlb->nr_free_pages);
+		tlb->nr_free_pages = 0;
+		for_each_in_list_safe(page, tmp, node, &tlb->free_list) {
+			if (tlb->nr_free_pages == TLB_GATHER_MAX_PAGES)
+				break;
+			list_del(&page->node);
+			tlb->free_pages[tlb->nr_free_pages++] = page;
+		}
+	}
+
+	for_each_in_list_safe(page, tmp, node, &tlb->free_tables) {
+		list_del(&page->node);
+		free_ptp(page_to_virt(page));
+	}
+}
+
+/**
+ * @brief: 逐页失效记录的范围
+ * @param asid: 用户地址空间的ASID（已移到TLBI操作数的ASID位），kernel 为 true 时忽略
+ * @param kernel: 内核地址空间，失效所有ASID的条目
+ * @param local: 只失效当前CPU的TLB，不广播
+*/
+static void flush_tlb_pages(struct tlb_gather *tlb, u64 asid, bool kernel, bool local)
+{
+	bool last_level = !tlb->freed_tables;
+	vaddr_t va;
+
+	for (int i = 0; i < tlb->nr_ranges; i++) {
+		for (va = tlb->ranges[i].start; va != tlb->ranges[i].end; va += PAGE_SIZE) {
+			if (kernel) {
+				// vaale1is: 所有ASID、仅最后一级、广播到 Inner Shareable 域内的所有CPU
+				// vaae1is: 所有ASID、所有级别（包括页表遍历缓存中的中间级条目）
+				if (last_level)
+					__tlbi(vaale1is, TLBI_VA(va));
+				else
+					__tlbi(vaae1is, TLBI_VA(va));
+			} else if (local) {
+				if (last_level)
+					__tlbi(vale1, asid | TLBI_VA(va));
+				else
+					__tlbi(vae1, asid | TLBI_VA(va));
+			} else {
+				if (last_level)
+					__tlbi(vale1is, asid | TLBI_VA(va));
+				else
+					__tlbi(vae1is, asid | TLBI_VA(va));
+			}
+		}
+	}
+}
+
+/**
+ * @brief: 失效 tlb_gather 中记录的所有范围，然后清空记录，gather 可以继续使用。
+ *         调用者应先完成所有页表项的修改，这里只在开头做一次 dsb 保证页表写入对页表遍历可见，
+ *         最后用一次 dsb + isb 等待所有失效操作完成。
+ *         - 用户地址空间只失效其ASID的条目：没有CPU运行过时直接跳过；只在当前CPU上运行过时使用
+ *           不广播的TLBI；页数超过 TLB_FLUSH_PAGE_THRESHOLD 或范围过多时按ASID整体失效
+ *         - 内核地址空间的条目可能以任意ASID缓存，需要失效所有ASID，页数过多时失效整个TLB
+ *         失效完成后释放暂存的页和页表页
+ * @param tlb: gather 结构
+*/
+void tlb_gather_flush(struct tlb_gather *tlb)
+{
+	struct page *page = tlb->pgtbl ? virt_to_page(tlb->pgtbl) : NULL;
+	bool all = tlb->overflow || tlb->nr_pages > TLB_FLUSH_PAGE_THRESHOLD;
+	u32 cpu_mask;
+	bool local;
+	u64 asid;
+
+	if (tlb->nr_pages == 0)
+		goto out;
+
+	/* 先让页表项的修改对所有CPU可见，再读取 cpu_mask，与 set_page_table 中的顺序配对 */
+	dsb(ish);
+
+	/* 静态分配的内核页表不在伙伴系统中 */
+	if (page == NULL) {
+		if (all)
+			__tlbi_all(vmalle1is);
+		else
+			flush_tlb_pages(tlb, 0, true, false);
+		dsb(ish);
+		isb();
+		goto out;
+	}
+
+	cpu_mask = *(volatile u32 *)&page->cpu_mask;
+	if (cpu_mask == 0)
+		goto out;
+
+	local = cpu_mask == BIT(smp_get_cpu_id());
+	asid = context_id_to_asid(page->context_id) << TLBI_ASID_SHIFT;
+	if (all && local)
+		__tlbi(aside1, asid);
+	else if (all)
+		__tlbi(aside1is, asid);
+	else
+		flush_tlb_pages(tlb, asid, false, local);
+
+	if (local)
+		dsb(nsh);
+	else
+		dsb(ish);
+	isb();
+
+out:
+	tlb_gather_free_pages(tlb);
+	tlb_gather_init(tlb, tlb->pgtbl);
+}
+
+/**
+ * @brief: 在所有CPU上批量失效一段内核虚拟地址（所有ASID）的TLB条目
+ * @param start: 起始虚拟地址
+ * @param len: 长度
+ * @param last_level: 是否只失效最后一级页表项
+*/
+static void __flush_tlb_range(vaddr_t start, size_t len, bool last_level)
+{
+	struct tlb_gather tlb;
+
+	tlb_gather_init(&tlb, NULL);
+	tlb_gather_add_range(&tlb, start, len);
+	tlb.freed_tables = !last_level;
+	tlb_gather_flush(&tlb);
+}
+
+void flush_tlb_range(vaddr_t start, size_t len)
+{
+	__flush_tlb_range(start, len, true);
+}
+
+void flush_tlb_range_all_levels(vaddr_t start, size_t len)
+{
+	__flush_tlb_range(start, len, false);
+}
+
+/**
+ * @brief: 权限提升时不失效TLB（见 protect_range_in_pgtbl），TLB中可能仍缓存着旧的、权限更低的条目，
+ *         访问时会产生一次权限错误。失效本CPU上该地址的条目后重新执行出错的指令即可
+ * @param va: 出错的用户虚拟地址
+*/
+void flush_tlb_spurious_fault(vaddr_t va)
+{
+	u64 asid = read_sysreg(ttbr0_el1) & ~((1UL << TTBR_ASID_SHIFT) - 1);
+
+	__tlbi(vale1, asid | TLBI_VA(va));
+	dsb(nsh);
+	isb();
+}
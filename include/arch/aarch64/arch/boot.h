@@ -6,4 +6,16 @@
 extern char img_end;
 extern unsigned long boot_ttbr1_l0[];
 
+/*
+ * 链接脚本中定义的内核镜像各段的边界。init_end、_serial_end、_edata、_bss_end、img_end 为物理地址，
+ * _text_start、_text_end 为虚拟地址
+ */
+extern char init_end;
+extern char _text_start, _text_end;
+extern char _serial_end, _edata, _bss_end;
+
+/* 0x3F000000 ~ 0x40000000 为共享外设，0x40000000 ~ 0x100000000 为本地外设 */
+#define PERIPHERAL_END 0x40000000UL
+#define LOCAL_PERIPHERAL_END 0x100000000UL
+
 #endif /* ARCH_AARCH64_ARCH_BOOT_H */
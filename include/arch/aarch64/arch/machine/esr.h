@@ -83,6 +83,11 @@
 #define DFSC_PERM_FAULT_L2 0b001110
 #define DFSC_PERM_FAULT_L3 0b001111
 
+/* IFSC 和 DFSC 的转换错误、访问标志错误、权限错误编码相同 */
+#define IS_PERM_FAULT(fsc) ((fsc) >= DFSC_PERM_FAULT_L1 && (fsc) <= DFSC_PERM_FAULT_L3)
+#define IS_TRANS_FAULT(fsc) ((fsc) >= DFSC_TRANS_FAULT_L0 && (fsc) <= DFSC_TRANS_FAULT_L3)
+#define IS_ACCESS_FAULT(fsc) ((fsc) >= DFSC_ACCESS_FAULT_L1 && (fsc) <= DFSC_ACCESS_FAULT_L3)
+
 #define ESR_EL2_EC_UNKNOWN (0b000000)
 #define ESR_EL2_EC_WFx (0b000001)
 /* Unallocated EC: 0b02 */
@@ -48,9 +48,18 @@
  */
 #define PMCNTENSET_EL0_C (1 << 31)
 
+/**
+ * 通用事件编号（写入 PMXEVTYPER_EL0），更多事件参考 ARMv8 ARM D7.10
+ * - PMU_EVENT_L1D_TLB_REFILL：L1 数据TLB缺失
+ * - PMU_EVENT_L2D_TLB_REFILL：L2（统一）TLB缺失，需要进行页表遍历
+ */
+#define PMU_EVENT_L1D_TLB_REFILL (0x05)
+#define PMU_EVENT_L2D_TLB_REFILL (0x2d)
+
 void enable_cpu_cnt(void);
 void disable_cpu_cnt(void);
 void pmu_init(void);
+void pmu_enable_event_counter(u32 idx, u32 event);
 
 /**
  * @brief 读取 PMCCNTR_EL0 寄存器的值，返回当前 CPU 周期计数
@@ -63,6 +72,18 @@ static inline u64 pmu_read_real_cycle(void)
 	return tv;
 }
 
+/**
+ * @brief 读取第 idx 个事件计数器 PMEVCNTR<idx>_EL0 的值
+ */
+static inline u64 pmu_read_event_counter(u32 idx)
+{
+	u64 cnt;
+	asm volatile("msr pmselr_el0, %0" ::"r"((u64)idx));
+	asm volatile("isb");
+	asm volatile("mrs %0, pmxevcntr_el0" : "=r"(cnt));
+	return cnt;
+}
+
 /**
  * @brief 清除 PMCCNTR_EL0 寄存器的计数值，将其重置为 0
  * @note 这将清除当前的 CPU 周期计数
@@ -65,7 +65,39 @@
 #define SCTLR_EL2_RES1 \
 	((BIT(4)) | (BIT(5)) | (BIT(11)) | (BIT(16)) | (BIT(18)) | (BIT(22)) | (BIT(23)) | (BIT(28)) | (BIT(29)))
 
+/*
+ * ID_AA64MMFR0_EL1.ASIDBits [7:4]：0b0000 表示支持8位ASID，0b0010 表示支持16位ASID
+ */
+#define ID_AA64MMFR0_EL1_ASIDBITS_SHIFT 4
+#define ID_AA64MMFR0_EL1_ASIDBITS_MASK 0xf
+#define ID_AA64MMFR0_EL1_ASIDBITS_16 0b0010
+
+/* TTBRx_EL1 的 [63:48] 为ASID */
+#define TTBR_ASID_SHIFT 48
+
+/*
+ * ID_AA64MMFR1_EL1.HAFDBS [3:0]：0b0001 表示支持硬件更新访问标志，0b0010 表示同时支持硬件更新脏状态（DBM）
+ */
+#define ID_AA64MMFR1_EL1_HAFDBS_MASK 0xf
+#define ID_AA64MMFR1_EL1_HAFDBS_AF 0b0001
+#define ID_AA64MMFR1_EL1_HAFDBS_DBM 0b0010
+
+/* TCR_EL1.HA：硬件更新访问标志；TCR_EL1.HD：硬件更新脏状态，需要同时设置HA */
+#define TCR_EL1_HA BIT(39)
+#define TCR_EL1_HD BIT(40)
+
 #ifndef __ASM__
+/* 读取系统寄存器 */
+#define read_sysreg(reg)                                     \
+	({                                                   \
+		u64 __val;                                   \
+		asm volatile("mrs %0, " #reg : "=r"(__val)); \
+		__val;                                       \
+	})
+
+/* 写系统寄存器 */
+#define write_sysreg(val, reg) asm volatile("msr " #reg ", %0" ::"r"((u64)(val)))
+
 /* Types of the registers */
 enum reg_type {
 	X0 = 0, /* 0x00 */
@@ -0,0 +1,19 @@
+#ifndef ARCH_AARCH64_ARCH_MM_ASID_H
+#define ARCH_AARCH64_ARCH_MM_ASID_H
+
+#include <common/types.h>
+
+/*
+ * context_id 的低 asid_bits 位为ASID，其余高位为分配该ASID时的代（generation）。
+ * context_id 为0表示尚未分配ASID。ASID 0 保留给内核启动时的 boot_ttbr0_l0 使用。
+ */
+
+void init_asid(void);
+u64 asid_switch(u64 *context_id);
+u64 context_id_to_asid(u64 context_id);
+u32 get_asid_bits(void);
+
+void asid_test(void);
+void asid_bench(void);
+
+#endif /* ARCH_AARCH64_ARCH_MM_ASID_H */
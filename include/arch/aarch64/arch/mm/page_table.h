@@ -12,7 +12,9 @@
 /* Description bits in page table entries. */
 
 /* Read-write permission. */
+#define AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_NA (0)
 #define AARCH64_MMU_ATTR_PAGE_AP_HIGH_RW_EL0_RW (1)
+#define AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_NA (2)
 #define AARCH64_MMU_ATTR_PAGE_AP_HIGH_RO_EL0_RO (3)
 
 /* X: execution permission. U: unprivileged. P: privileged. */
@@ -32,6 +34,27 @@
 #define AARCH64_MMU_PTE_TABLE_MASK (1 << 1)
 #define IS_PTE_INVALID(pte) (!((pte) & AARCH64_MMU_PTE_INVALID_MASK))
 #define IS_PTE_TABLE(pte) (!!((pte) & AARCH64_MMU_PTE_TABLE_MASK))
+/* Contiguous bit: a hint that 16 adjacent L3 entries map one contiguous 64KB physical range. */
+#define AARCH64_MMU_PTE_CONT_MASK (1UL << 52)
+#define IS_PTE_CONT(pte) (!!((pte) & AARCH64_MMU_PTE_CONT_MASK))
+/* Access permission and execute-never bits of page and block descriptors. */
+#define AARCH64_MMU_PTE_AP_MASK (3UL << 6)
+#define AARCH64_MMU_PTE_PXN_MASK (1UL << 53)
+#define AARCH64_MMU_PTE_UXN_MASK (1UL << 54)
+/* AP[2]: read-only at all exception levels. */
+#define AARCH64_MMU_PTE_RDONLY_MASK (1UL << 7)
+/* Access flag: cleared by the working-set scanner, set by the hardware (TCR_EL1.HA) or the access flag fault. */
+#define AARCH64_MMU_PTE_AF_MASK (1UL << 10)
+/*
+ * Dirty bit modifier: with TCR_EL1.HD the hardware clears AP[2] on the first write instead of faulting.
+ * DBM with AP[2] set is a writable but clean page, DBM with AP[2] clear is a dirty page.
+ */
+#define AARCH64_MMU_PTE_DBM_MASK (1UL << 51)
+/* Software bits [58:55], ignored by the hardware. */
+/* The page is shared copy-on-write between address spaces and mapped read-only. */
+#define AARCH64_MMU_PTE_SW_COW (1UL << 55)
+/* With SW_COW: the mapping itself is writable, a write fault copies the page. */
+#define AARCH64_MMU_PTE_SW_WRITE (1UL << 56)
 
 /* PAGE_SIZE (4k) == (1 << (PAGE_SHIFT)) */
 #define PAGE_SHIFT (12)
@@ -50,6 +73,14 @@
 #define GET_L3_INDEX(addr) (((addr) >> L3_INDEX_SHIFT) & PTP_INDEX_MASK)
 
 #define PTP_ENTRIES (1UL << PAGE_ORDER)
+/* Number of L3 entries covered by one contiguous hint (4KB granule: 16 * 4KB = 64KB) */
+#define CONT_PTES (16)
+#define CONT_PTE_SIZE (CONT_PTES * PAGE_SIZE)
+/* Transparent huge pages of user anonymous memory are mapped by one L2 block (2MB). */
+#define HUGE_PAGE_ORDER (PAGE_ORDER)
+#define HUGE_PAGE_SIZE (1UL << (PAGE_SHIFT + HUGE_PAGE_ORDER))
+/* Entries in the Cortex-A53 main TLB, used to estimate the TLB reach of a page table. */
+#define TLB_MAIN_ENTRIES (512)
 /* Number of 4KB-pages that an Lx-block describes */
 #define L0_PER_ENTRY_PAGES ((PTP_ENTRIES) * (L1_PER_ENTRY_PAGES))
 #define L1_PER_ENTRY_PAGES ((PTP_ENTRIES) * (L2_PER_ENTRY_PAGES))
@@ -157,5 +188,6 @@ typedef struct {
 } ptp_t;
 
 void set_ttbr0_el1(paddr_t pgtbl);
+void set_ttbr1_el1(paddr_t pgtbl);
 
 #endif /* ARCH_AARCH64_ARCH_MM_PAGE_TABLE_H */
\ No newline at end of file
@@ -12,6 +12,12 @@
  *    +----DIRECT MAPPING_end----+  0xFFFFFF0040000000 (KBASE + PERIPHERAL_END)
  *    |        ......            |
  *    |                          |
+ *    +--------------------------+  0xFFFFFF8000000000 (VMALLOC_START)
+ *    |         vmalloc          |
+ *    |                          |
+ *    +--------------------------+  0xFFFFFF8040000000 (VMALLOC_END)
+ *    |        ......            |
+ *    |                          |
  *    +--------------------------+  0xFFFFFFFF00000000 (KSTACK_BASE)
  *    |       kernel stack       |
  *    |                          |
@@ -32,6 +38,15 @@
 #define PHYSICAL_ADDR_MASK (40)
 #endif // 内核基址
 
+#ifndef VMALLOC_START
+#define VMALLOC_START 0xFFFFFF8000000000
+#define VMALLOC_END 0xFFFFFF8040000000
+#endif // vmalloc 虚拟地址区域，与直接映射区域不重叠
+
+#ifndef USER_SPACE_END
+#define USER_SPACE_END 0x0001000000000000
+#endif // 用户态虚拟地址空间（TTBR0）的上界，T0SZ = 16
+
 #ifndef KSTACK_BASE
 #define KSTACK_BASE 0xFFFFFFFF00000000
 #define KSTACKx_ADDR(cpuid) ((cpuid) * 2 * CPU_STACK_SIZE + KSTACK_BASE)
@@ -101,6 +101,9 @@ static inline s64 atomic_exchange_64(s64 *ptr, s64 exchange)
 #define atomic_fetch_sub_64(ptr, val) __atomic_fetch_op(ptr, val, 64, x, sub)
 #define atomic_fetch_add_32(ptr, val) __atomic_fetch_op(ptr, val, 32, w, add)
 #define atomic_fetch_add_64(ptr, val) __atomic_fetch_op(ptr, val, 64, x, add)
+/* 原子或操作，将ptr指向的值与val按位或，并返回ptr原来的值 */
+#define atomic_fetch_or_32(ptr, val) __atomic_fetch_op(ptr, val, 32, w, orr)
+#define atomic_fetch_or_64(ptr, val) __atomic_fetch_op(ptr, val, 64, x, orr)
 
 static inline void spin_lock_init(spinlock_t *lock)
 {
@@ -131,4 +134,69 @@ static inline void spin_unlock(spinlock_t *lock)
 		     : "memory");
 }
 
+/*
+ * 读写自旋锁：cnt 为持有读锁的读者数，为 -1 时被写者持有。
+ * 读者之间只竞争一次CAS，不会互相等待；写者不优先，读者很多时写者可能等待较久
+ */
+typedef struct {
+	volatile int cnt;
+} rwlock_t;
+
+static inline void spin_rwlock_init(rwlock_t *rwlock)
+{
+	rwlock->cnt = 0;
+}
+
+static inline void spin_read_lock(rwlock_t *rwlock)
+{
+	int cnt;
+
+	for (;;) {
+		cnt = rwlock->cnt;
+		// ldaxr 保证 acquire 语义
+		if (cnt >= 0 && (int)atomic_cmpxchg_32(&rwlock->cnt, cnt, cnt + 1) == cnt)
+			break;
+	}
+	asm volatile("" ::: "memory");
+}
+
+static inline void spin_read_unlock(rwlock_t *rwlock)
+{
+	asm volatile("" ::: "memory");
+	// stlxr 保证 release 语义
+	atomic_fetch_sub_32(&rwlock->cnt, 1);
+}
+
+static inline void spin_write_lock(rwlock_t *rwlock)
+{
+	while ((int)atomic_cmpxchg_32(&rwlock->cnt, 0, -1) != 0)
+		;
+	asm volatile("" ::: "memory");
+}
+
+/* 尝试获取读锁/写锁，成功返回1，不等待 */
+static inline int spin_read_trylock(rwlock_t *rwlock)
+{
+	int cnt = rwlock->cnt;
+
+	if (cnt < 0 || (int)atomic_cmpxchg_32(&rwlock->cnt, cnt, cnt + 1) != cnt)
+		return 0;
+	asm volatile("" ::: "memory");
+	return 1;
+}
+
+static inline int spin_write_trylock(rwlock_t *rwlock)
+{
+	if ((int)atomic_cmpxchg_32(&rwlock->cnt, 0, -1) != 0)
+		return 0;
+	asm volatile("" ::: "memory");
+	return 1;
+}
+
+static inline void spin_write_unlock(rwlock_t *rwlock)
+{
+	asm volatile("" ::: "memory");
+	stlr_32(&rwlock->cnt, 0);
+}
+
 #endif /* ARCH_AARCH64_ARCH_SYNC_H */
@@ -12,6 +12,18 @@ struct lock {
 #define lock(lock) spin_lock((spinlock_t *)lock)
 #define unlock(lock) spin_unlock((spinlock_t *)lock)
 
+struct rwlock {
+	volatile int cnt;
+};
+
+#define rwlock_init(rwlock) spin_rwlock_init((rwlock_t *)rwlock)
+#define read_lock(rwlock) spin_read_lock((rwlock_t *)rwlock)
+#define read_unlock(rwlock) spin_read_unlock((rwlock_t *)rwlock)
+#define write_lock(rwlock) spin_write_lock((rwlock_t *)rwlock)
+#define write_unlock(rwlock) spin_write_unlock((rwlock_t *)rwlock)
+#define read_trylock(rwlock) spin_read_trylock((rwlock_t *)rwlock)
+#define write_trylock(rwlock) spin_write_trylock((rwlock_t *)rwlock)
+
 /* Global locks */
 extern struct lock big_kernel_lock;
 
@@ -3,7 +3,10 @@
 
 #include <common/types.h>
 
-static inline void memcpy(void *dst, const void *src, size_t size)
+/*
+ * 逐字节实现的通用版本，在没有体系结构优化实现时使用，也作为测试和性能对比的基准
+ */
+static inline void *memcpy_generic(void *dst, const void *src, size_t size)
 {
 	char *d = (char *)dst;
 	const char *s = (char *)src;
@@ -11,18 +14,53 @@ static inline void memcpy(void *dst, const void *src, size_t size)
 	while (size--) {
 		*d++ = *s++;
 	}
+	return dst;
 }
 
-static inline void memset(void *dst, char ch, size_t size)
+static inline void *memset_generic(void *dst, int ch, size_t size)
 {
 	char *p = (char *)dst;
 
 	while (size--) {
 		*p++ = ch;
 	}
+	return dst;
 }
 
-static inline int strcmp(const char *src, const char *dst)
+static inline int memcmp_generic(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *l = (const unsigned char *)s1, *r = (const unsigned char *)s2;
+	for (; n && *l == *r; n--, l++, r++)
+		;
+	return n ? *l - *r : 0;
+}
+
+#ifdef ARCH_HAS_MEMOPS
+/* 体系结构相关的优化实现，见 arch/<arch>/lib */
+void *memcpy(void *dst, const void *src, size_t size);
+void *memset(void *dst, int ch, size_t size);
+int memcmp(const void *s1, const void *s2, size_t n);
+#else
+static inline void *memcpy(void *dst, const void *src, size_t size)
+{
+	return memcpy_generic(dst, src, size);
+}
+
+static inline void *memset(void *dst, int ch, size_t size)
+{
+	return memset_generic(dst, ch, size);
+}
+
+static inline int memcmp(const void *s1, const void *s2, size_t n)
+{
+	return memcmp_generic(s1, s2, n);
+}
+#endif
+
+/*
+ * 逐字节扫描的字符串函数，作为测试和性能对比的基准
+ */
+static inline int strcmp_generic(const char *src, const char *dst)
 {
 	while (*src && *dst) {
 		if (*src == *dst) {
@@ -39,7 +77,7 @@ static inline int strcmp(const char *src, const char *dst)
 	return 1;
 }
 
-static inline int strncmp(const char *src, const char *dst, size_t size)
+static inline int strncmp_generic(const char *src, const char *dst, size_t size)
 {
 	size_t i;
 
@@ -51,7 +89,7 @@ static inline int strncmp(const char *src, const char *dst, size_t size)
 	return 0;
 }
 
-static inline size_t strlen(const char *src)
+static inline size_t strlen_generic(const char *src)
 {
 	size_t i = 0;
 
@@ -61,12 +99,9 @@ static inline size_t strlen(const char *src)
 	return i;
 }
 
-static inline int memcmp(const void *s1, const void *s2, size_t n)
-{
-	const unsigned char *l = (const unsigned char *)s1, *r = (const unsigned char *)s2;
-	for (; n && *l == *r; n--, l++, r++)
-		;
-	return n ? *l - *r : 0;
-}
+/* 每次读取一个对齐的 8 字节字的实现，见 lib/string.c */
+size_t strlen(const char *s);
+int strcmp(const char *s1, const char *s2);
+int strncmp(const char *s1, const char *s2, size_t n);
 
 #endif /* COMMON_UTILS_H */
@@ -10,6 +10,9 @@ extern unsigned char irq_handle_type[MAX_IRQ_NUM];
 /* in arch/xxx/irq/irq_entry.c */
 void arch_interrupt_init(void);
 
+/* in arch/xxx/irq/pgfault.c */
+void pgfault_test(void);
+
 /* in arch/xxx/plat/xxx/irq/irq.c */
 void plat_interrupt_init(void);
 void plat_handle_irq(void);
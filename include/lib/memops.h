@@ -0,0 +1,9 @@
+#ifndef LIB_MEMOPS_H
+#define LIB_MEMOPS_H
+
+/* 检查 memcpy/memset/memcmp 与逐字节实现的结果一致 */
+void memops_test(void);
+/* 对比 memcpy/memset/memcmp 与逐字节实现在不同大小下的吞吐 */
+void memops_bench(void);
+
+#endif /* LIB_MEMOPS_H */
@@ -0,0 +1,67 @@
+#ifndef LIB_RBTREE_H
+#define LIB_RBTREE_H
+
+#include <common/macro.h>
+#include <common/types.h>
+
+/*
+ * 侵入式红黑树：节点嵌入在使用者的结构体中，由使用者按自己的键查找插入位置，
+ * 然后调用 rb_link_node 和 rb_insert_color 完成插入和平衡。
+ *
+ * 支持附加信息（augmented rbtree）：每个节点可以保存由其子树计算出的值（如子树中的最大值），
+ * 使用者提供 rb_augment_fn 根据节点自身和左右孩子重新计算该值。插入和删除时先从变化的位置向上
+ * 更新到根，平衡过程中的每次旋转再更新被旋转的两个节点
+ */
+
+#define RB_RED (0)
+#define RB_BLACK (1)
+
+struct rb_node {
+	struct rb_node *parent;
+	struct rb_node *left;
+	struct rb_node *right;
+	int color;
+};
+
+struct rb_root {
+	struct rb_node *node;
+};
+
+/* 根据节点自身和左右孩子重新计算节点的附加信息 */
+typedef void (*rb_augment_fn)(struct rb_node *node);
+
+#define rb_entry(ptr, type, field) container_of(ptr, type, field)
+
+static inline void init_rb_root(struct rb_root *root)
+{
+	root->node = NULL;
+}
+
+/**
+ * @brief: 把新节点挂到查找得到的位置上，之后调用 rb_insert_color
+ * @param node: 新节点
+ * @param parent: 新节点的父节点，树为空时为NULL
+ * @param link: parent 中指向新节点的孩子指针，树为空时为 &root->node
+*/
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent, struct rb_node **link)
+{
+	node->parent = parent;
+	node->left = NULL;
+	node->right = NULL;
+	node->color = RB_RED;
+	*link = node;
+}
+
+void rb_insert_color(struct rb_root *root, struct rb_node *node, rb_augment_fn augment);
+void rb_erase(struct rb_root *root, struct rb_node *node, rb_augment_fn augment);
+void rb_augment_propagate(struct rb_node *node, rb_augment_fn augment);
+
+struct rb_node *rb_first(struct rb_root *root);
+struct rb_node *rb_last(struct rb_root *root);
+struct rb_node *rb_next(struct rb_node *node);
+struct rb_node *rb_prev(struct rb_node *node);
+
+/* 随机插入、删除后检查红黑树的性质、中序顺序和附加信息 */
+void rbtree_test(void);
+
+#endif /* LIB_RBTREE_H */
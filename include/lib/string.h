@@ -0,0 +1,9 @@
+#ifndef LIB_STRING_H
+#define LIB_STRING_H
+
+/* 检查 strlen/strcmp/strncmp 与逐字节实现的结果一致 */
+void string_test(void);
+/* 对比 strlen/strcmp/strncmp 与逐字节实现在不同长度下的开销 */
+void string_bench(void);
+
+#endif /* LIB_STRING_H */
@@ -0,0 +1,73 @@
+#ifndef MM_ARENA_H
+#define MM_ARENA_H
+
+#include <common/types.h>
+#include <common/macro.h>
+
+/*
+ * arena 适用于一批同生共死的短生命周期对象：从 get_pages() 取得的 chunk 中顺序 bump 分配，
+ * 对象本身不带任何头部，也不能单独释放，只能通过 arena_restore 回滚到某个检查点或者
+ * arena_release 一次性全部释放
+ */
+
+/* 默认 chunk 为 4 个页 */
+#define ARENA_DEFAULT_CHUNK_ORDER (2)
+#define ARENA_DEFAULT_ALIGN (sizeof(long))
+
+/* 每个 chunk 起始处的头部，chunk 之间按分配顺序逆序链接 */
+struct arena_chunk {
+	struct arena_chunk *prev;
+	int order;
+};
+
+struct arena {
+	struct arena_chunk *current;
+	/* 当前 chunk 中下一次分配的位置和 chunk 的结束位置 */
+	vaddr_t ptr;
+	vaddr_t end;
+	int chunk_order;
+};
+
+/* 检查点，记录保存时 arena 的分配位置 */
+struct arena_mark {
+	struct arena_chunk *chunk;
+	vaddr_t ptr;
+};
+
+void arena_init(struct arena *arena, int chunk_order);
+void *__arena_alloc_slow(struct arena *arena, size_t size, size_t align);
+void arena_restore(struct arena *arena, struct arena_mark mark);
+void arena_release(struct arena *arena);
+
+/*
+ * @align: 必须是2的幂
+ */
+static inline void *arena_alloc_aligned(struct arena *arena, size_t size, size_t align)
+{
+	vaddr_t addr = ROUND_UP(arena->ptr, align);
+
+	if (likely(addr >= arena->ptr && addr <= arena->end && size <= arena->end - addr)) {
+		arena->ptr = addr + size;
+		return (void *)addr;
+	}
+	return __arena_alloc_slow(arena, size, align);
+}
+
+static inline void *arena_alloc(struct arena *arena, size_t size)
+{
+	return arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGN);
+}
+
+/*
+ * 检查点可以嵌套，但只能按保存的逆序回滚：回滚到外层检查点之后，内层的检查点随之失效
+ */
+static inline struct arena_mark arena_save(struct arena *arena)
+{
+	struct arena_mark mark = { arena->current, arena->ptr };
+	return mark;
+}
+
+void arena_test(void);
+void arena_bench(void);
+
+#endif /* MM_ARENA_H */
@@ -56,17 +56,41 @@ struct mem_region {
 	struct free_list free_lists[BUDDY_MAX_ORDER];
 };
 
+struct anon_vma;
+
 /* `struct page` is the metadata of one physical 4k page. */
 struct page {
 	struct list_head node; /* Free list */
 	int allocated;
 	int order;
 	void *slab;
+	/* 该页作为用户页表根页时，保存分配给它的ASID及其所属的代（generation） */
+	u64 context_id;
+	/* 该页作为用户页表根页时，运行过该地址空间的CPU，TLB中可能缓存了它的条目 */
+	u32 cpu_mask;
+	/*
+	 * 用户页表中映射该页的次数，只统计生命周期由页表管理的页（写时复制时分配的页），
+	 * 最后一个映射解除时释放。为0表示该页由建立映射的调用者管理
+	 */
+	s32 refcount;
+	/* 页表管理的匿名页的反向映射：所属的 anon_vma 和映射它的虚拟地址，见 mm/rmap.h */
+	struct anon_vma *anon_vma;
+	vaddr_t rmap_va;
+	/*
+	 * 该页作为页表页时，保护其中的页表项（split page-table lock）。持有 vmspace 读锁的缺页处理
+	 * 只锁住要修改的页表页，不同区域上的缺页可以在多个CPU上并发处理
+	 */
+	struct lock ptl;
 };
 
 void init_buddy();
 struct page *buddy_get_pages(int order);
 void buddy_free_pages(struct page *page);
+int buddy_get_pages_bulk(int order, int nr, struct page **pages);
+void buddy_free_pages_bulk(struct page **pages, int nr);
+int buddy_expand_pages(struct page *page, int new_order);
+void buddy_shrink_pages(struct page *page, int new_order);
+void buddy_split_pages(struct page *page);
 
 void *page_to_virt(struct page *page);
 struct page *virt_to_page(void *ptr);
@@ -10,8 +10,10 @@ void free_pages(void *addr);
 
 void *kmalloc(size_t size);
 void *kzalloc(size_t size);
+void *krealloc(void *ptr, size_t new_size);
 
 void kfree(void *ptr);
 void kmalloc_test();
+void krealloc_test();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef MM_MEMPOOL_H
+#define MM_MEMPOOL_H
+
+#include <common/types.h>
+#include <common/list.h>
+#include <common/lock.h>
+
+/*
+ * mempool 为中断处理、内存回收等不能失败的路径预留一定数量的对象。分配时优先走正常的
+ * slab/伙伴系统，只有正常路径失败时才动用预留；预留被消耗后，池子会被挂到待补充链表上，
+ * 由定时中断异步补满，因此关键路径上不会出现等待内存的情况
+ */
+enum mempool_type {
+	MEMPOOL_SLAB = 0,
+	MEMPOOL_PAGES,
+};
+
+struct mempool {
+	enum mempool_type type;
+	/* MEMPOOL_SLAB: slab 块的 order；MEMPOOL_PAGES: 伙伴系统的 order */
+	int order;
+
+	/* 预留对象的数量下限 */
+	int min_nr;
+	/* 当前预留的对象数量 */
+	int curr_nr;
+	void **elements;
+	struct lock lock;
+
+	/* 挂在 mempool_refill_list 上，等待定时中断补充 */
+	struct list_head refill_node;
+	bool refill_pending;
+};
+
+struct mempool *mempool_create_slab(size_t size, int min_nr);
+struct mempool *mempool_create_pages(int order, int min_nr);
+void mempool_destroy(struct mempool *pool);
+
+void *mempool_alloc(struct mempool *pool);
+void mempool_free(void *element, struct mempool *pool);
+
+void mempool_refill_pending(void);
+
+void mempool_test(void);
+
+#endif /* MM_MEMPOOL_H */
@@ -0,0 +1,27 @@
+#ifndef MM_MIGRATE_H
+#define MM_MIGRATE_H
+
+#include <common/types.h>
+
+/*
+ * 页迁移：把匿名页的内容和所有映射搬到另一个物理页，然后释放原来的页。用于内存规整、拼装大页等
+ *
+ * 一批页的迁移分为三步：
+ * 1. 通过反向映射找到每个页的所有映射，获取这些地址空间的写锁，使所有映射失效，
+ *    每个地址空间只失效一次TLB
+ * 2. 此时没有CPU能再访问原来的页，复制内容
+ * 3. 以原来的属性（包括访问标志和脏状态）把页表项指向新的页，释放地址空间的锁
+ * 第1步中任一地址空间的锁正被持有时整批放弃，返回 -EAGAIN，页表不变
+ */
+
+/* 一批最多迁移的页数、涉及的地址空间数和映射数，超过时分成多批 */
+#define MIGRATE_BATCH_PAGES (16)
+#define MIGRATE_BATCH_VMS (8)
+#define MIGRATE_BATCH_MAPPINGS (64)
+
+struct page;
+
+int migrate_page(struct page *old, struct page *new);
+int migrate_pages(struct page **old, struct page **new, int nr);
+
+#endif /* MM_MIGRATE_H */
@@ -12,6 +12,8 @@
 
 /* Execute once during kernel init. */
 void mm_init(void *physmem_info);
+/* 内存管理相关的性能测试，依赖PMU的周期计数器 */
+void mm_bench(void);
 
 /* Return the size of free memory in the buddy and slab allocator. */
 unsigned long get_free_mem_size(void);
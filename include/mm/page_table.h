@@ -5,9 +5,73 @@
 #include <uapi/memory.h>
 
 void set_page_table(paddr_t pgtbl);
+void *get_kernel_pgtbl(void);
+void init_kernel_pgtbl(void);
+void *get_current_user_pgtbl(void);
 
 int map_range_in_pgtbl_kernel(void *pgtbl, vaddr_t va, paddr_t pa, size_t len, vmr_prop_t flags);
 
 int map_range_in_pgtbl_user(void *pgtbl, vaddr_t va, paddr_t pa, size_t len, vmr_prop_t flags, long *rss);
 
+struct page;
+int map_pages_in_pgtbl(void *pgtbl, vaddr_t va, struct page **pages, unsigned long n, vmr_prop_t flags, long *rss);
+int install_pages_in_pgtbl(void *pgtbl, vaddr_t va, struct page **pages, unsigned long n, vmr_prop_t flags,
+			   long *rss);
+
+int unmap_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, long *rss);
+
+struct tlb_gather;
+int unmap_range_in_pgtbl_gather(void *pgtbl, vaddr_t va, size_t len, long *rss, struct tlb_gather *tlb);
+
+int protect_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, vmr_prop_t flags, long *rss);
+
+int clone_range_in_pgtbl_cow(void *dst, void *src, vaddr_t va, size_t len, long *rss, long *src_rss);
+int handle_cow_fault(void *pgtbl, vaddr_t va, long *rss);
+
+bool huge_range_unmapped_in_pgtbl(void *pgtbl, vaddr_t va);
+int map_huge_page_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa, vmr_prop_t flags, long *rss);
+int split_huge_page_in_pgtbl(void *pgtbl, vaddr_t va, long *rss);
+struct anon_vma;
+int collapse_huge_page_in_pgtbl(void *pgtbl, vaddr_t va, struct anon_vma *anon_vma, long *rss);
+
+int take_pte_in_pgtbl(void *pgtbl, vaddr_t va, u64 *saved, struct tlb_gather *tlb);
+void restore_pte_in_pgtbl(void *pgtbl, vaddr_t va, u64 saved, paddr_t pa);
+
+int query_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t *pa, pte_t **entry);
+
+/* 页表中一段虚拟地址和物理地址都连续、属性相同的映射 */
+struct pgtbl_run {
+	vaddr_t va;
+	paddr_t pa;
+	size_t len;
+	vmr_prop_t flags;
+};
+
+typedef int (*pgtbl_run_fn)(struct pgtbl_run *run, void *arg);
+
+int walk_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, pgtbl_run_fn fn, void *arg);
+void dump_pgtbl(void *pgtbl, vaddr_t va, size_t len);
+void get_pgtbl_stats(void *pgtbl, struct pgtbl_stats *stats);
+void print_pgtbl_stats(void *pgtbl);
+
+/* 一次工作集采样中统计到的页数 */
+struct pgtbl_ws_sample {
+	/* 已映射的普通内存页 */
+	unsigned long nr_pages;
+	/* 上次采样之后被访问过的页 */
+	unsigned long nr_accessed;
+	/* 上次采样之后被写入过的页，只在 pgtbl_hw_dirty() 时统计 */
+	unsigned long nr_dirty;
+};
+
+void init_hw_access_dirty(void);
+bool pgtbl_hw_dirty(void);
+void harvest_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, struct pgtbl_ws_sample *sample);
+int handle_access_fault(void *pgtbl, vaddr_t va);
+int mark_dirty_in_pgtbl(void *pgtbl, vaddr_t va);
+
+void page_table_test(void);
+void kernel_pgtbl_test(void);
+void page_table_bench(void);
+
 #endif
\ No newline at end of file
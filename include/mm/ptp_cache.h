@@ -0,0 +1,22 @@
+#ifndef MM_PTP_CACHE_H
+#define MM_PTP_CACHE_H
+
+#include <common/types.h>
+
+/*
+ * 页表页缓存：每个CPU缓存一些已经清零的页，分配页表页时直接从本CPU的缓存中取，不需要获取伙伴系统的锁，
+ * 也不需要清零。缓存为空时一次从伙伴系统批量取 PTP_CACHE_BATCH 个页并清零，
+ * 回收的页表页放回缓存，缓存满时一次把 PTP_CACHE_BATCH 个页还给伙伴系统
+ */
+
+/* 每次补充或归还的页数 */
+#define PTP_CACHE_BATCH (16)
+/* 每个CPU最多缓存的页数 */
+#define PTP_CACHE_MAX (4 * PTP_CACHE_BATCH)
+
+void *alloc_ptp(void);
+void free_ptp(void *ptp);
+void ptp_cache_drain(void);
+unsigned long ptp_cache_nr_pages(void);
+
+#endif /* MM_PTP_CACHE_H */
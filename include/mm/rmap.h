@@ -0,0 +1,67 @@
+#ifndef MM_RMAP_H
+#define MM_RMAP_H
+
+#include <common/types.h>
+#include <common/list.h>
+#include <common/lock.h>
+
+/*
+ * 反向映射：从物理页找到映射它的所有页表项（参考 Linux 的 anon_vma）
+ *
+ * 匿名区域中缺页分配的页记录它所属的 anon_vma 和映射的虚拟地址（page->anon_vma、page->rmap_va）。
+ * 建立区域时创建新的 anon_vma；复制地址空间时子区域也有自己的 anon_vma，作为父区域的 anon_vma 的子节点，
+ * 子地址空间中之后分配的页只属于子区域的 anon_vma。写时复制不改变虚拟地址，复制得到的页与原来的页属于
+ * 同一个 anon_vma。可能映射一个页的区域都挂在它的 anon_vma 为根的子树上，查找一个页的所有映射时，
+ * 只需在子树上每个包含该虚拟地址的区域的页表中查找这个地址。
+ *
+ * 每个页额外占用两个字，每个区域一个链表节点和一个 anon_vma。某个 anon_vma 的子树只包含从它复制出来的、
+ * 仍然存在的区域（以及它们的祖先），销毁地址空间后对应的节点随最后一个页一起释放；
+ * 父区域的页的反向映射要遍历所有仍然存在的后代，子地址空间中新分配的页只需遍历子地址空间及其后代
+ */
+
+struct anon_vma {
+	/* 挂着以它为 anon_vma 的区域（vmregion->anon_node） */
+	struct list_head vmr_list;
+	/* 复制地址空间时为子区域创建的 anon_vma 挂在父区域的 anon_vma 的 children 上 */
+	struct anon_vma *parent;
+	struct anon_vma *root;
+	struct list_head children;
+	struct list_head sibling;
+	/* 链接的区域数、指向它的页数加上子 anon_vma 数，为0时释放 */
+	s32 refcount;
+	/* 只使用根的锁，保护整棵树上的 vmr_list 和 children */
+	struct lock lock;
+};
+
+static inline void anon_vma_lock(struct anon_vma *anon_vma)
+{
+	lock(&anon_vma->root->lock);
+}
+
+static inline void anon_vma_unlock(struct anon_vma *anon_vma)
+{
+	unlock(&anon_vma->root->lock);
+}
+
+struct page;
+struct vmregion;
+struct vmspace;
+
+/* 对页的每个映射调用一次，调用时持有 vms->lock，返回非0时停止遍历 */
+typedef int (*rmap_fn)(struct vmspace *vms, vaddr_t va, void *arg);
+
+int anon_vma_prepare(struct vmregion *vmr);
+int anon_vma_fork(struct vmregion *vmr, struct vmregion *parent);
+void anon_vma_split(struct vmregion *vmr, struct vmregion *new, vaddr_t at);
+void anon_vma_unlink(struct vmregion *vmr);
+struct anon_vma *anon_vma_next(struct anon_vma *pos, struct anon_vma *top);
+
+void page_add_anon_rmap(struct page *page, struct anon_vma *anon_vma, vaddr_t va);
+void page_remove_anon_rmap(struct page *page);
+void put_anon_page(struct page *page);
+
+int rmap_walk(struct page *page, rmap_fn fn, void *arg);
+int page_mapcount(struct page *page);
+int try_to_unmap(struct page *page);
+
+#endif /* MM_RMAP_H */
@@ -0,0 +1,66 @@
+#ifndef MM_TLB_H
+#define MM_TLB_H
+
+#include <common/types.h>
+#include <common/list.h>
+
+struct page;
+
+/* 超过该页数时不再逐页失效，直接失效整个ASID（内核地址空间则失效整个TLB） */
+#define TLB_FLUSH_PAGE_THRESHOLD (64)
+/* tlb_gather 最多记录的不连续范围数，超过后按整个地址空间失效 */
+#define TLB_GATHER_MAX_RANGES (8)
+/* tlb_gather 的数组中最多暂存的待释放页数，超过后挂在链表上，同样在失效TLB之后释放 */
+#define TLB_GATHER_MAX_PAGES (32)
+
+/* 失效当前CPU上所有的TLB条目，定义在 tools.S 中 */
+void flush_tlb_all(void);
+
+/* 在所有CPU上失效[start, start + len)范围内所有ASID的最后一级TLB条目 */
+void flush_tlb_range(vaddr_t start, size_t len);
+
+/* 同上，但同时失效中间级页表项的缓存，用于回收页表页之后 */
+void flush_tlb_range_all_levels(vaddr_t start, size_t len);
+
+/* 只失效当前CPU上当前ASID中va的最后一级TLB条目，用于处理权限提升后残留旧条目造成的假权限错误 */
+void flush_tlb_spurious_fault(vaddr_t va);
+
+struct tlb_range {
+	vaddr_t start;
+	vaddr_t end;
+};
+
+/*
+ * 一次页表操作（如解除多段映射）中需要失效的TLB范围。
+ * 调用者修改页表项时用 tlb_gather_add_range 记录范围，全部修改完成后调用一次 tlb_gather_flush，
+ * 根据范围大小选择逐页失效、按ASID失效或失效整个TLB，并且只在运行过该地址空间的CPU上失效
+ */
+struct tlb_gather {
+	/* 用户页表基址（虚拟地址）。为NULL或内核页表时需要失效所有ASID */
+	void *pgtbl;
+	/* 回收了页表页，需要同时失效中间级页表项的缓存 */
+	bool freed_tables;
+	/* 范围数超过 TLB_GATHER_MAX_RANGES，不再记录具体范围 */
+	bool overflow;
+	int nr_ranges;
+	unsigned long nr_pages;
+	struct tlb_range ranges[TLB_GATHER_MAX_RANGES];
+	/*
+	 * 解除映射后要释放的页，其他CPU可能仍通过TLB访问它们，必须在失效TLB之后才能释放。
+	 * 数组放不下的页通过 page->node 挂在 free_list 上，不能为了腾出空间提前失效：
+	 * 此时调用者可能还没有记录这些页的范围
+	 */
+	int nr_free_pages;
+	struct page *free_pages[TLB_GATHER_MAX_PAGES];
+	struct list_head free_list;
+	/* 回收的页表页，其他CPU的页表遍历可能仍在读取它们，同样在失效TLB之后才放回页表页缓存 */
+	struct list_head free_tables;
+};
+
+void tlb_gather_init(struct tlb_gather *tlb, void *pgtbl);
+void tlb_gather_add_range(struct tlb_gather *tlb, vaddr_t start, size_t len);
+void tlb_gather_free_page(struct tlb_gather *tlb, struct page *page);
+void tlb_gather_free_table(struct tlb_gather *tlb, void *ptp);
+void tlb_gather_flush(struct tlb_gather *tlb);
+
+#endif /* MM_TLB_H */
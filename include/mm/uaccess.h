@@ -0,0 +1,16 @@
+#ifndef MM_UACCESS_H
+#define MM_UACCESS_H
+
+#include <common/types.h>
+
+/*
+ * 内核与当前用户地址空间（TTBR0 指向的页表）之间的数据拷贝。通过一次页表遍历得到用户缓冲区
+ * 对应的物理内存段，再经由内核的直接映射区域拷贝。用户地址非法时返回 -EFAULT，而不会在内核中触发缺页
+ */
+
+int copy_from_user(void *dst, const void *usrc, size_t len);
+int copy_to_user(void *udst, const void *src, size_t len);
+
+void uaccess_test(void);
+
+#endif /* MM_UACCESS_H */
@@ -0,0 +1,28 @@
+#ifndef MM_VMALLOC_H
+#define MM_VMALLOC_H
+
+#include <common/types.h>
+#include <common/list.h>
+
+/*
+ * vmalloc 分配的是虚拟地址连续、物理地址不连续的内核内存，每一页都单独从伙伴系统中
+ * 以 order-0 分配，因此不受物理内存碎片的影响，可以分配超过 4MB 的大块内存
+ */
+struct vmap_area {
+	/* 按起始地址排序，挂在 vmap_area_list 上 */
+	struct list_head node;
+	vaddr_t va_start;
+	/* 映射的大小，不包括末尾的 guard page */
+	size_t size;
+	/* 后备物理页 */
+	struct page **pages;
+	unsigned long nr_pages;
+};
+
+void init_vmalloc(void);
+void *vmalloc(size_t size);
+void vfree(void *addr);
+
+void vmalloc_test(void);
+
+#endif /* MM_VMALLOC_H */
@@ -0,0 +1,112 @@
+#ifndef MM_VMSPACE_H
+#define MM_VMSPACE_H
+
+#include <common/types.h>
+#include <common/list.h>
+#include <common/lock.h>
+#include <lib/rbtree.h>
+#include <mm/page_table.h>
+#include <uapi/memory.h>
+
+/*
+ * 用户地址空间：一组互不重叠的虚拟内存区域（vmregion）和对应的用户页表。
+ * 目前只支持匿名内存（PMO_ANONYM）：建立区域时不分配物理页，第一次访问触发缺页时才分配并映射，
+ * 同时顺带映射相邻的若干页（fault-around），顺序访问时缺页次数随之减少。
+ * 缺页分配的页由页表管理（page->refcount），解除映射时释放。
+ * 区域完整覆盖的2MB第一次访问时直接用一个L2块映射的透明大页，已经逐页映射的2MB由后台收拢为大页。
+ * 区域同时挂在按地址排序的链表和红黑树上：链表用于顺序遍历，红黑树用于按地址查找区域和查找空闲的地址范围，
+ * 区域很多时缺页和建立映射也不需要线性扫描
+ */
+
+/* 默认每次缺页映射的页数 */
+#define FAULT_AROUND_PAGES_DEFAULT (16)
+
+/* 不指定地址建立区域时，从 VMS_MAP_BASE 开始查找空闲的地址范围 */
+#define VMS_MAP_BASE (0x100000000UL)
+
+/* 工作集采样的周期（定时器中断次数），TICK_MS 为10ms时每秒采样一次当前地址空间 */
+#define WS_SCAN_INTERVAL_TICKS (100)
+/* 定时器中断中每次最多采样的地址范围，一轮采样分多次中断完成，限制每次中断处理的耗时 */
+#define WS_SCAN_TICK_SIZE (4 * HUGE_PAGE_SIZE)
+/*
+ * 每 THP_COLLAPSE_INTERVAL_SCANS 轮工作集采样之后收拢一次大页，每次最多收拢 THP_COLLAPSE_PAGES 个，
+ * 最多检查 THP_COLLAPSE_CHECKS 个2MB，下次从上次停下的地方继续
+ */
+#define THP_COLLAPSE_INTERVAL_SCANS (4)
+#define THP_COLLAPSE_PAGES (1)
+#define THP_COLLAPSE_CHECKS (8)
+/* 工作集估计值的指数加权平均中，新的采样占 1 / 2^WS_EWMA_SHIFT */
+#define WS_EWMA_SHIFT (2)
+
+struct vmregion {
+	/* 按起始地址排序，挂在 vmspace->vmr_list 上 */
+	struct list_head node;
+	/* 以起始地址为键，挂在 vmspace->vmr_tree 上 */
+	struct rb_node rb;
+	/* 区域之前 VMS_MAP_BASE 以上的空闲大小，以及子树中各区域的 gap 的最大值 */
+	size_t gap;
+	size_t subtree_gap;
+	vaddr_t start;
+	size_t size;
+	vmr_prop_t perm;
+	/* 所属的地址空间 */
+	struct vmspace *vms;
+	/* 反向映射：挂在 anon_vma->vmr_list 上 */
+	struct anon_vma *anon_vma;
+	struct list_head anon_node;
+};
+
+struct vmspace {
+	struct list_head vmr_list;
+	struct rb_root vmr_tree;
+	/*
+	 * 最近一次查找到的区域，顺序访问时连续的缺页落在同一个区域中。
+	 * 持有读锁的缺页处理也会更新它，删除区域时（持有写锁）清除
+	 */
+	struct vmregion *vmr_cache;
+	/* 用户页表基址（虚拟地址） */
+	void *pgtbl;
+	/* 已映射的物理内存和页表页的大小 */
+	long rss;
+	/* 处理过的缺页次数 */
+	unsigned long nr_faults;
+	/* 工作集统计 */
+	struct ws_stats ws;
+	/* 定时器中断中分批进行的一轮采样：是否正在进行、下一批的起始地址和已经累加的结果 */
+	bool ws_scanning;
+	vaddr_t ws_scan_va;
+	struct pgtbl_ws_sample ws_sample;
+	/* 后台收拢大页时下一个检查的地址 */
+	vaddr_t collapse_va;
+	/*
+	 * 保护 vmr_list、vmr_tree 和页表的结构。缺页处理持有读锁，在多个CPU上并发修改页表项（见 install_pages_in_pgtbl）；
+	 * 建立、解除映射、复制地址空间和采样工作集持有写锁
+	 */
+	struct rwlock lock;
+};
+
+struct vmspace *create_vmspace(void);
+void destroy_vmspace(struct vmspace *vms);
+struct vmspace *clone_vmspace(struct vmspace *src);
+
+int vmspace_map_anonymous(struct vmspace *vms, vaddr_t va, size_t len, vmr_prop_t perm);
+int vmspace_map_anonymous_anywhere(struct vmspace *vms, size_t len, vmr_prop_t perm, vaddr_t *va);
+int vmspace_unmap(struct vmspace *vms, vaddr_t va, size_t len);
+int vmspace_protect(struct vmspace *vms, vaddr_t va, size_t len, vmr_prop_t perm);
+struct vmregion *find_vmregion(struct vmspace *vms, vaddr_t va);
+
+void switch_vmspace(struct vmspace *vms);
+struct vmspace *get_current_vmspace(void);
+
+int handle_anon_fault(struct vmspace *vms, vaddr_t va, vmr_prop_t access);
+void set_fault_around_pages(unsigned long nr_pages);
+void set_thp_enabled(bool enabled);
+int vmspace_collapse_huge_pages(struct vmspace *vms, int max);
+
+void vmspace_scan_ws(struct vmspace *vms);
+void vmspace_ws_tick(void);
+void vmspace_get_ws_stats(struct vmspace *vms, struct ws_stats *stats);
+
+void vmspace_test(void);
+
+#endif /* MM_VMSPACE_H */
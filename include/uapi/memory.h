@@ -38,6 +38,32 @@ struct free_mem_info {
 	unsigned long free_mem_size; // in bytes
 	unsigned long total_mem_size; // in bytes
 };
+
+/* 地址空间的工作集统计，由内核周期性地采样页表项的访问标志和脏状态得到 */
+struct ws_stats {
+	unsigned long nr_scans; // 采样次数
+	unsigned long resident_pages; // 最近一次采样时已映射的页数
+	unsigned long accessed_pages; // 最近一个采样周期内被访问过的页数
+	unsigned long dirty_pages; // 最近一个采样周期内被写入过的页数，只在设置了 WS_DIRTY_TRACKED 时有效
+	unsigned long idle_pages; // 最近一个采样周期内没有被访问过的页数
+	unsigned long ws_pages; // 工作集大小的估计值，为各周期被访问页数的指数加权平均
+	unsigned long flags;
+};
+
+/* 页表的内存占用和映射粒度统计 */
+struct pgtbl_stats {
+	unsigned long nr_ptps[4]; // 各级页表页数，下标为级别 L0 ~ L3
+	unsigned long nr_l1_blocks; // 1GB 块映射数
+	unsigned long nr_l2_blocks; // 2MB 块映射数
+	unsigned long nr_pages; // 4KB 页映射数
+	unsigned long nr_cont_pages; // 其中设置了 Contiguous 位（64KB 连续映射）的页数
+	unsigned long mapped_size; // 映射的总大小（字节）
+	unsigned long nr_tlb_entries; // 缓存全部映射最少需要的TLB条目数
+	unsigned long tlb_reach; // 估计的TLB覆盖范围（字节），见 get_pgtbl_stats
+};
 #endif
 
+/* ws_stats.flags */
+#define WS_DIRTY_TRACKED (1 << 0)
+
 #endif /* UAPI_MEMORY_H */
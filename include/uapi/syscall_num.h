@@ -95,4 +95,10 @@
 #define KMK_SYS_futex 57
 #define KMK_SYS_set_tid_address 58
 
+/* - working set */
+#define KMK_SYS_get_ws_stats 59
+
+/* - page table */
+#define KMK_SYS_get_pgtbl_stats 61
+
 #endif /* UAPI_SYSCALL_NUM_H */
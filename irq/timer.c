@@ -4,6 +4,8 @@
 #include <common/kprint.h>
 #include <common/list.h>
 #include <common/lock.h>
+#include <mm/mempool.h>
+#include <mm/vmspace.h>
 
 struct time_state time_states[PLAT_CPU_NUM];
 
@@ -25,4 +27,8 @@ void timer_init(void)
 void handle_timer_irq(void)
 {
 	plat_set_init_timer();
+
+	/* 目前只有EL0会被中断，此时内核不持有分配器的锁，可以安全地补充mempool的预留 */
+	mempool_refill_pending();
+	vmspace_ws_tick();
 }
\ No newline at end of file
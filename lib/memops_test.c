@@ -0,0 +1,140 @@
+#include <arch/machine/pmu.h>
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <lib/memops.h>
+
+#define MEMOPS_BUF_SIZE (16 * 1024)
+/* 缓冲区前后各留出一段，检查越界写 */
+#define MEMOPS_GUARD 64
+#define MEMOPS_GUARD_BYTE 0x5a
+#define MEMOPS_BENCH_BYTES (4UL * 1024 * 1024)
+
+static char memops_dst[MEMOPS_BUF_SIZE + 2 * MEMOPS_GUARD] ALIGN(64);
+static char memops_src[MEMOPS_BUF_SIZE + 2 * MEMOPS_GUARD] ALIGN(64);
+
+static const size_t memops_large_sizes[] = { 255, 256, 257, 1023, 1024, 4095, 4096, 4097, 8191, MEMOPS_BUF_SIZE };
+
+static void fill_buffers(void)
+{
+	for (int i = 0; i < sizeof(memops_dst); i++) {
+		memops_dst[i] = MEMOPS_GUARD_BYTE;
+		memops_src[i] = (char)(i * 7 + 3);
+	}
+}
+
+/* 逐字节检查，不依赖被测试的函数 */
+static void check_range(const char *dst, size_t size, const char *expected, int ch)
+{
+	for (char *p = memops_dst; p < dst; p++)
+		assert(*p == MEMOPS_GUARD_BYTE);
+	for (size_t i = 0; i < size; i++)
+		assert(dst[i] == (expected ? expected[i] : (char)ch));
+	for (const char *p = dst + size; p < memops_dst + sizeof(memops_dst); p++)
+		assert(*p == MEMOPS_GUARD_BYTE);
+}
+
+static void test_one_size(size_t size)
+{
+	static const int offsets[] = { 0, 1, 7, 8, 15 };
+	char *dst, *src;
+	int diff;
+
+	for (int i = 0; i < ARRAY_SIZE(offsets); i++) {
+		for (int j = 0; j < ARRAY_SIZE(offsets); j++) {
+			dst = memops_dst + MEMOPS_GUARD - offsets[i];
+			src = memops_src + MEMOPS_GUARD - offsets[j];
+
+			fill_buffers();
+			assert(memcpy(dst, src, size) == dst);
+			check_range(dst, size, src, 0);
+			assert(memcmp(dst, src, size) == 0);
+			if (size > 0) {
+				/* 最后一个字节不同，比较结果的符号要与逐字节实现一致 */
+				dst[size - 1] ^= 0x80;
+				diff = memcmp(dst, src, size);
+				assert(diff != 0 && (diff > 0) == (memcmp_generic(dst, src, size) > 0));
+				dst[size / 2] ^= 0x01;
+				diff = memcmp(src, dst, size);
+				assert(diff != 0 && (diff > 0) == (memcmp_generic(src, dst, size) > 0));
+			}
+
+			if (j == 0) {
+				fill_buffers();
+				assert(memset(dst, 0, size) == dst);
+				check_range(dst, size, NULL, 0);
+				fill_buffers();
+				memset(dst, 0x1a5, size);
+				check_range(dst, size, NULL, 0xa5);
+			}
+		}
+	}
+}
+
+void memops_test(void)
+{
+	for (size_t size = 0; size <= 130; size++)
+		test_one_size(size);
+	for (int i = 0; i < ARRAY_SIZE(memops_large_sizes); i++)
+		test_one_size(memops_large_sizes[i]);
+
+	kinfo("memops test passed\n");
+}
+
+/*
+ * 逐字节的基准实现编译成单独的、不内联的函数，并且禁止编译器把其中的循环识别为 memcpy/memset 调用，
+ * 否则测到的是优化实现，或者结果没有被使用的调用被整个删除
+ */
+#define BENCH_BASELINE __attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+
+static BENCH_BASELINE void *bench_memcpy_generic(void *dst, const void *src, size_t size)
+{
+	return memcpy_generic(dst, src, size);
+}
+
+static BENCH_BASELINE void *bench_memset_generic(void *dst, int ch, size_t size)
+{
+	return memset_generic(dst, ch, size);
+}
+
+static BENCH_BASELINE int bench_memcmp_generic(const void *s1, const void *s2, size_t n)
+{
+	return memcmp_generic(s1, s2, n);
+}
+
+/* 每次调用的结果都写入这里，编译器不能删除调用 */
+static volatile u64 bench_sink;
+
+/* 每种大小都操作 MEMOPS_BENCH_BYTES 字节，输出每个字节消耗的周期数（放大100倍） */
+#define BENCH_LOOP(size, expr)                                                          \
+	({                                                                              \
+		u64 __start = pmu_read_real_cycle();                                    \
+		for (unsigned long __n = 0; __n < MEMOPS_BENCH_BYTES; __n += (size))    \
+			bench_sink = (u64)(expr);                                       \
+		(pmu_read_real_cycle() - __start) * 100 / MEMOPS_BENCH_BYTES;           \
+	})
+
+void memops_bench(void)
+{
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096, MEMOPS_BUF_SIZE };
+	char *dst = memops_dst + MEMOPS_GUARD;
+	char *src = memops_src + MEMOPS_GUARD;
+
+	kinfo("memops bench: cycles per 100 bytes, generic / optimized\n");
+	for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+		size_t size = sizes[i];
+		u64 cpy_g = BENCH_LOOP(size, bench_memcpy_generic(dst, src, size));
+		u64 cpy_o = BENCH_LOOP(size, memcpy(dst, src, size));
+		u64 set_g = BENCH_LOOP(size, bench_memset_generic(dst, 0, size));
+		u64 set_o = BENCH_LOOP(size, memset(dst, 0, size));
+		u64 cmp_g, cmp_o;
+
+		/* 比较两个内容相同的缓冲区，每次都要扫描全部字节 */
+		memcpy(dst, src, size);
+		cmp_g = BENCH_LOOP(size, bench_memcmp_generic(dst, src, size));
+		cmp_o = BENCH_LOOP(size, memcmp(dst, src, size));
+
+		kinfo("size %5lu: memcpy %lu / %lu, memset %lu / %lu, memcmp %lu / %lu\n", size, cpy_g, cpy_o, set_g,
+		      set_o, cmp_g, cmp_o);
+	}
+}
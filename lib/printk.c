@@ -1,5 +1,6 @@
 #include <common/types.h>
 #include <common/macro.h>
+#include <common/utils.h>
 #include <io/uart.h>
 
 #define PRINT_BUF_LEN 64
@@ -19,12 +20,10 @@ enum flags { PAD_ZERO = 1, PAD_RIGHT = 2 };
 static int prints(char **out, const char *string, int width, int flags)
 {
 	int pc = 0, padchar = ' ';
+	/* 只扫描一次字符串，输出时直接使用长度 */
+	size_t len = strlen(string);
 
 	if (width > 0) {
-		int len = 0;
-		const char *ptr;
-		for (ptr = string; *ptr; ++ptr)
-			++len;
 		if (len >= width)
 			width = 0;
 		else
@@ -38,8 +37,8 @@ static int prints(char **out, const char *string, int width, int flags)
 			++pc;
 		}
 	}
-	for (; *string; ++string) {
-		simple_outputchar(out, *string);
+	for (size_t i = 0; i < len; ++i) {
+		simple_outputchar(out, string[i]);
 		++pc;
 	}
 	for (; width > 0; --width) {
@@ -0,0 +1,296 @@
+#include <common/macro.h>
+#include <lib/rbtree.h>
+
+static bool is_red(struct rb_node *node)
+{
+	return node && node->color == RB_RED;
+}
+
+/* 用new替换old在其父节点（或根）中的位置 */
+static void replace_child(struct rb_root *root, struct rb_node *old, struct rb_node *new)
+{
+	struct rb_node *parent = old->parent;
+
+	if (!parent)
+		root->node = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+	if (new)
+		new->parent = parent;
+}
+
+/*
+ *     x                y
+ *    / \              / \
+ *   a   y    ==>     x   c
+ *      / \          / \
+ *     b   c        a   b
+ */
+static void rotate_left(struct rb_root *root, struct rb_node *x, rb_augment_fn augment)
+{
+	struct rb_node *y = x->right;
+
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+	replace_child(root, x, y);
+	y->left = x;
+	x->parent = y;
+	/* 只有x和y的子树发生了变化，先更新下面的x */
+	if (augment) {
+		augment(x);
+		augment(y);
+	}
+}
+
+static void rotate_right(struct rb_root *root, struct rb_node *x, rb_augment_fn augment)
+{
+	struct rb_node *y = x->left;
+
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+	replace_child(root, x, y);
+	y->right = x;
+	x->parent = y;
+	if (augment) {
+		augment(x);
+		augment(y);
+	}
+}
+
+/**
+ * @brief: 从node开始向上直到根，重新计算每个节点的附加信息。
+ *         节点自身用于计算附加信息的值（而不是树的结构）变化之后也需要调用
+*/
+void rb_augment_propagate(struct rb_node *node, rb_augment_fn augment)
+{
+	if (!augment)
+		return;
+	for (; node; node = node->parent)
+		augment(node);
+}
+
+/**
+ * @brief: 插入 rb_link_node 挂好的节点后恢复红黑树的性质
+ * @param root: 树根
+ * @param node: 新节点
+ * @param augment: 附加信息的计算函数，可以为NULL
+*/
+void rb_insert_color(struct rb_root *root, struct rb_node *node, rb_augment_fn augment)
+{
+	struct rb_node *parent, *gparent, *uncle;
+
+	/* 旋转时只更新被旋转的节点，要求孩子的附加信息已经正确 */
+	rb_augment_propagate(node, augment);
+
+	while (is_red(parent = node->parent)) {
+		/* 红色节点不是根，一定有父节点 */
+		gparent = parent->parent;
+		if (parent == gparent->left) {
+			uncle = gparent->right;
+			if (is_red(uncle)) {
+				parent->color = RB_BLACK;
+				uncle->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->right) {
+				rotate_left(root, parent, augment);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rotate_right(root, gparent, augment);
+		} else {
+			uncle = gparent->left;
+			if (is_red(uncle)) {
+				parent->color = RB_BLACK;
+				uncle->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->left) {
+				rotate_right(root, parent, augment);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rotate_left(root, gparent, augment);
+		}
+	}
+	root->node->color = RB_BLACK;
+}
+
+/**
+ * @brief: 删除黑色节点后恢复红黑树的性质
+ * @param node: 替代被删除节点的位置的节点，可以为NULL
+ * @param parent: node 的父节点
+*/
+static void erase_fixup(struct rb_root *root, struct rb_node *node, struct rb_node *parent, rb_augment_fn augment)
+{
+	struct rb_node *sibling;
+
+	while (node != root->node && !is_red(node)) {
+		/* node 所在的一侧少一个黑色节点，另一侧一定不为空 */
+		if (node == parent->left) {
+			sibling = parent->right;
+			if (is_red(sibling)) {
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				rotate_left(root, parent, augment);
+				sibling = parent->right;
+			}
+			if (!is_red(sibling->left) && !is_red(sibling->right)) {
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!is_red(sibling->right)) {
+				sibling->left->color = RB_BLACK;
+				sibling->color = RB_RED;
+				rotate_right(root, sibling, augment);
+				sibling = parent->right;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->right->color = RB_BLACK;
+			rotate_left(root, parent, augment);
+		} else {
+			sibling = parent->left;
+			if (is_red(sibling)) {
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				rotate_right(root, parent, augment);
+				sibling = parent->left;
+			}
+			if (!is_red(sibling->left) && !is_red(sibling->right)) {
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!is_red(sibling->left)) {
+				sibling->right->color = RB_BLACK;
+				sibling->color = RB_RED;
+				rotate_left(root, sibling, augment);
+				sibling = parent->left;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->left->color = RB_BLACK;
+			rotate_right(root, parent, augment);
+		}
+		node = root->node;
+	}
+	if (node)
+		node->color = RB_BLACK;
+}
+
+/**
+ * @brief: 从树中删除节点
+ * @param root: 树根
+ * @param node: 要删除的节点
+ * @param augment: 附加信息的计算函数，可以为NULL
+*/
+void rb_erase(struct rb_root *root, struct rb_node *node, rb_augment_fn augment)
+{
+	struct rb_node *child, *parent, *succ;
+	int color;
+
+	if (!node->left || !node->right) {
+		child = node->left ? node->left : node->right;
+		parent = node->parent;
+		color = node->color;
+		replace_child(root, node, child);
+	} else {
+		/* 有两个孩子时用后继节点替代它，后继节点没有左孩子 */
+		succ = node->right;
+		while (succ->left)
+			succ = succ->left;
+		child = succ->right;
+		color = succ->color;
+		if (succ->parent == node) {
+			parent = succ;
+		} else {
+			parent = succ->parent;
+			replace_child(root, succ, child);
+			succ->right = node->right;
+			succ->right->parent = succ;
+		}
+		replace_child(root, node, succ);
+		succ->left = node->left;
+		succ->left->parent = succ;
+		succ->color = node->color;
+	}
+
+	/* 结构变化的最低位置是parent，它到根路径上的节点的子树都变了 */
+	rb_augment_propagate(parent, augment);
+	if (color == RB_BLACK)
+		erase_fixup(root, child, parent, augment);
+}
+
+struct rb_node *rb_first(struct rb_root *root)
+{
+	struct rb_node *node = root->node;
+
+	if (!node)
+		return NULL;
+	while (node->left)
+		node = node->left;
+	return node;
+}
+
+struct rb_node *rb_last(struct rb_root *root)
+{
+	struct rb_node *node = root->node;
+
+	if (!node)
+		return NULL;
+	while (node->right)
+		node = node->right;
+	return node;
+}
+
+/**
+ * @brief: 中序遍历中的下一个节点，没有时返回NULL
+*/
+struct rb_node *rb_next(struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->right) {
+		node = node->right;
+		while (node->left)
+			node = node->left;
+		return node;
+	}
+	while ((parent = node->parent) && node == parent->right)
+		node = parent;
+	return parent;
+}
+
+/**
+ * @brief: 中序遍历中的前一个节点，没有时返回NULL
+*/
+struct rb_node *rb_prev(struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->left) {
+		node = node->left;
+		while (node->right)
+			node = node->right;
+		return node;
+	}
+	while ((parent = node->parent) && node == parent->left)
+		node = parent;
+	return parent;
+}
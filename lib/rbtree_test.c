@@ -0,0 +1,139 @@
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <lib/rbtree.h>
+
+#define RBTREE_TEST_NODES 512
+/* 与 RBTREE_TEST_NODES 互素，i * RBTREE_TEST_STEP 遍历所有的键 */
+#define RBTREE_TEST_STEP 271
+
+/* 附加信息为子树中 value 的最大值 */
+struct rbtree_test_node {
+	struct rb_node rb;
+	unsigned long key;
+	unsigned long value;
+	unsigned long subtree_max;
+	bool in_tree;
+};
+
+/* 在mm初始化之前运行，不能动态分配 */
+static struct rbtree_test_node rbtree_nodes[RBTREE_TEST_NODES];
+
+static unsigned long subtree_max(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct rbtree_test_node, rb)->subtree_max : 0;
+}
+
+static void test_augment(struct rb_node *node)
+{
+	struct rbtree_test_node *n = rb_entry(node, struct rbtree_test_node, rb);
+
+	n->subtree_max = MAX(n->value, MAX(subtree_max(node->left), subtree_max(node->right)));
+}
+
+static void test_insert(struct rb_root *root, struct rbtree_test_node *n)
+{
+	struct rb_node **link = &root->node, *parent = NULL;
+
+	while (*link) {
+		parent = *link;
+		if (n->key < rb_entry(parent, struct rbtree_test_node, rb)->key)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	rb_link_node(&n->rb, parent, link);
+	rb_insert_color(root, &n->rb, test_augment);
+	n->in_tree = true;
+}
+
+/**
+ * @brief: 检查以node为根的子树：没有相邻的红色节点，附加信息正确
+ * @return: 子树的黑高
+*/
+static int check_subtree(struct rb_node *node, struct rb_node *parent)
+{
+	struct rbtree_test_node *n;
+	int left, right;
+
+	if (!node)
+		return 1;
+	n = rb_entry(node, struct rbtree_test_node, rb);
+	assert(node->parent == parent);
+	if (node->color == RB_RED)
+		assert(!parent || parent->color == RB_BLACK);
+	left = check_subtree(node->left, node);
+	right = check_subtree(node->right, node);
+	assert(left == right);
+	assert(n->subtree_max == MAX(n->value, MAX(subtree_max(node->left), subtree_max(node->right))));
+	return left + (node->color == RB_BLACK);
+}
+
+static void check_tree(struct rb_root *root, int expected)
+{
+	struct rbtree_test_node *n, *last = NULL;
+	struct rb_node *node;
+	int count = 0;
+
+	assert(!root->node || root->node->color == RB_BLACK);
+	check_subtree(root->node, NULL);
+
+	/* 正向和反向遍历都按键有序，且恰好是树中的节点 */
+	for (node = rb_first(root); node; node = rb_next(node)) {
+		n = rb_entry(node, struct rbtree_test_node, rb);
+		assert(n->in_tree);
+		assert(!last || last->key < n->key);
+		last = n;
+		count++;
+	}
+	assert(count == expected);
+	for (node = rb_last(root); node; node = rb_prev(node))
+		count--;
+	assert(count == 0);
+}
+
+void rbtree_test(void)
+{
+	struct rb_root root;
+	int nr = 0;
+
+	init_rb_root(&root);
+	check_tree(&root, 0);
+
+	for (int i = 0; i < RBTREE_TEST_NODES; i++) {
+		rbtree_nodes[i].key = (i * RBTREE_TEST_STEP) % RBTREE_TEST_NODES;
+		rbtree_nodes[i].value = (i * 7919UL) % 1009;
+		test_insert(&root, &rbtree_nodes[i]);
+		nr++;
+		if (i % 64 == 0)
+			check_tree(&root, nr);
+	}
+	check_tree(&root, nr);
+
+	/* 删除一半的节点，包括有两个孩子的内部节点和根 */
+	for (int i = 0; i < RBTREE_TEST_NODES; i += 2) {
+		rb_erase(&root, &rbtree_nodes[i].rb, test_augment);
+		rbtree_nodes[i].in_tree = false;
+		nr--;
+		if (i % 64 == 0)
+			check_tree(&root, nr);
+	}
+	check_tree(&root, nr);
+
+	/* 修改节点的值后向上更新附加信息 */
+	rbtree_nodes[1].value = 5000;
+	rb_augment_propagate(&rbtree_nodes[1].rb, test_augment);
+	check_tree(&root, nr);
+	assert(subtree_max(root.node) == 5000);
+
+	/* 删除剩余的节点，树重新变为空 */
+	for (int i = 1; i < RBTREE_TEST_NODES; i += 2) {
+		rb_erase(&root, &rbtree_nodes[i].rb, test_augment);
+		rbtree_nodes[i].in_tree = false;
+		nr--;
+	}
+	check_tree(&root, 0);
+	assert(root.node == NULL);
+
+	kinfo("rbtree test passed\n");
+}
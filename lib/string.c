@@ -0,0 +1,120 @@
+#include <common/types.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <arch/mm/page_table.h>
+
+/*
+ * 每次读取 8 字节，用 has_zero 判断其中是否有 '\0'。按字对齐的读取不会跨页，因此即使读到了
+ * 字符串结束之后的字节也不会访问未映射的页；两个字符串无法同时对齐时，另一个字符串的非对齐
+ * 读取在跨页时退回逐字节比较。内核运行在小端序下
+ */
+
+#define WORD_SIZE sizeof(u64)
+#define WORD_MASK (WORD_SIZE - 1)
+#define ONE_BYTES 0x0101010101010101UL
+#define HIGH_BYTES 0x8080808080808080UL
+#define STRING_PAGE_SIZE (1UL << PAGE_SHIFT)
+
+/* 按字读取的是 char 数组，类型与实际对象不同，需要 may_alias 避免违反严格别名规则 */
+typedef u64 __attribute__((may_alias)) word_t;
+
+struct unaligned_u64 {
+	word_t val;
+} __attribute__((packed, may_alias));
+
+/* 非零表示 x 中有 0 字节，最低的置位所在的字节就是第一个 0 字节 */
+static inline u64 has_zero(u64 x)
+{
+	return (x - ONE_BYTES) & ~x & HIGH_BYTES;
+}
+
+static inline u64 load_unaligned(const void *p)
+{
+	return ((const struct unaligned_u64 *)p)->val;
+}
+
+static inline bool word_crosses_page(const void *p)
+{
+	return ((vaddr_t)p & (STRING_PAGE_SIZE - 1)) > STRING_PAGE_SIZE - WORD_SIZE;
+}
+
+size_t strlen(const char *s)
+{
+	const word_t *w = (const word_t *)ROUND_DOWN((vaddr_t)s, WORD_SIZE);
+	unsigned int off = (vaddr_t)s & WORD_MASK;
+	u64 x, zero;
+
+	/* 起始地址之前的字节置为 0xff，不会被当作字符串的结束 */
+	x = *w;
+	if (off)
+		x |= ~0UL >> (64 - 8 * off);
+	while (!(zero = has_zero(x)))
+		x = *++w;
+
+	return (const char *)w + (__builtin_ctzl(zero) >> 3) - s;
+}
+
+/*
+ * 比较 s1 与 s2 各自的下一个字，相同且不含 '\0' 时返回 true。s1 必须按字对齐
+ */
+static inline bool word_equal(const unsigned char *s1, const unsigned char *s2)
+{
+	u64 w1;
+
+	if (unlikely(word_crosses_page(s2)))
+		return false;
+	w1 = *(const word_t *)s1;
+	return w1 == load_unaligned(s2) && !has_zero(w1);
+}
+
+int strcmp(const char *s1, const char *s2)
+{
+	const unsigned char *a = (const unsigned char *)s1, *b = (const unsigned char *)s2;
+
+	for (; (vaddr_t)a & WORD_MASK; a++, b++) {
+		if (*a != *b || *a == '\0')
+			return *a - *b;
+	}
+
+	for (;;) {
+		if (likely(word_equal(a, b))) {
+			a += WORD_SIZE;
+			b += WORD_SIZE;
+			continue;
+		}
+		/* 字中有不同的字节或者 '\0'，或者 b 的读取会跨页 */
+		for (int i = 0; i < WORD_SIZE; i++, a++, b++) {
+			if (*a != *b || *a == '\0')
+				return *a - *b;
+		}
+	}
+}
+
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+	const unsigned char *a = (const unsigned char *)s1, *b = (const unsigned char *)s2;
+
+	for (; n && ((vaddr_t)a & WORD_MASK); n--, a++, b++) {
+		if (*a != *b || *a == '\0')
+			return *a - *b;
+	}
+
+	for (; n >= WORD_SIZE; n -= WORD_SIZE) {
+		if (likely(word_equal(a, b))) {
+			a += WORD_SIZE;
+			b += WORD_SIZE;
+			continue;
+		}
+		for (int i = 0; i < WORD_SIZE; i++, a++, b++) {
+			if (*a != *b || *a == '\0')
+				return *a - *b;
+		}
+	}
+
+	for (; n; n--, a++, b++) {
+		if (*a != *b || *a == '\0')
+			return *a - *b;
+	}
+
+	return 0;
+}
@@ -0,0 +1,115 @@
+#include <arch/machine/pmu.h>
+#include <arch/mm/page_table.h>
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <lib/string.h>
+
+#define STRING_BUF_SIZE (2UL << PAGE_SHIFT)
+#define STRING_MAX_LEN 80
+#define STRING_BENCH_ROUNDS 1000
+
+static char string_buf1[STRING_BUF_SIZE] ALIGN(1UL << PAGE_SHIFT);
+static char string_buf2[STRING_BUF_SIZE] ALIGN(1UL << PAGE_SHIFT);
+
+static char *make_string(char *buf, size_t offset, size_t len)
+{
+	char *s = buf + offset;
+
+	for (size_t i = 0; i < len; i++)
+		s[i] = 'a' + (i % 26);
+	s[len] = '\0';
+	return s;
+}
+
+static int sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+static void test_at(size_t off1, size_t off2, size_t len)
+{
+	char *s1 = make_string(string_buf1, off1, len);
+	char *s2 = make_string(string_buf2, off2, len);
+
+	assert(strlen(s1) == len && strlen(s2) == len);
+	assert(strcmp(s1, s2) == 0 && strncmp(s1, s2, len + 8) == 0);
+
+	for (size_t i = 0; i < len; i++) {
+		s2[i]++;
+		assert(sign(strcmp(s1, s2)) == sign(strcmp_generic(s1, s2)));
+		assert(sign(strcmp(s2, s1)) == sign(strcmp_generic(s2, s1)));
+		assert(strncmp(s1, s2, i) == 0);
+		assert(sign(strncmp(s1, s2, i + 1)) == sign(strncmp_generic(s1, s2, i + 1)));
+		s2[i]--;
+	}
+
+	/* 前缀 */
+	if (len > 0) {
+		s2[len - 1] = '\0';
+		assert(strcmp(s1, s2) > 0 && strcmp(s2, s1) < 0);
+		assert(strncmp(s1, s2, len - 1) == 0 && strncmp(s1, s2, len) > 0);
+	}
+}
+
+void string_test(void)
+{
+	char *s;
+
+	for (size_t len = 0; len <= STRING_MAX_LEN; len++) {
+		for (size_t off1 = 0; off1 < 8; off1++)
+			for (size_t off2 = 0; off2 < 8; off2 += 3)
+				test_at(off1, off2, len);
+	}
+
+	/* 字符串紧贴页的末尾，不能读到下一页 */
+	for (size_t len = 0; len <= STRING_MAX_LEN; len++) {
+		size_t end = (1UL << PAGE_SHIFT) - 1;
+		test_at(end - len, end - len, len);
+		test_at(end - len, len % 8, len);
+		test_at(len % 8, end - len, len);
+	}
+
+	/* 按无符号字节比较 */
+	s = make_string(string_buf1, 0, 16);
+	make_string(string_buf2, 0, 16);
+	s[9] = (char)0x80;
+	assert(strcmp(s, string_buf2) > 0 && strncmp(string_buf2, s, 16) < 0);
+
+	kinfo("string test passed\n");
+}
+
+/* 每次调用的结果都写入这里，编译器不能删除调用 */
+static volatile u64 string_bench_sink;
+
+void string_bench(void)
+{
+	static const size_t lens[] = { 8, 32, 128, 1024 };
+	u64 start, len_g, len_o, cmp_g, cmp_o;
+
+	kinfo("string bench: cycles per call, generic / word-at-a-time\n");
+	for (int i = 0; i < ARRAY_SIZE(lens); i++) {
+		char *s1 = make_string(string_buf1, 1, lens[i]);
+		char *s2 = make_string(string_buf2, 1, lens[i]);
+
+		start = pmu_read_real_cycle();
+		for (int r = 0; r < STRING_BENCH_ROUNDS; r++)
+			string_bench_sink = strlen_generic(s1);
+		len_g = (pmu_read_real_cycle() - start) / STRING_BENCH_ROUNDS;
+		start = pmu_read_real_cycle();
+		for (int r = 0; r < STRING_BENCH_ROUNDS; r++)
+			string_bench_sink = strlen(s1);
+		len_o = (pmu_read_real_cycle() - start) / STRING_BENCH_ROUNDS;
+
+		start = pmu_read_real_cycle();
+		for (int r = 0; r < STRING_BENCH_ROUNDS; r++)
+			string_bench_sink = strcmp_generic(s1, s2);
+		cmp_g = (pmu_read_real_cycle() - start) / STRING_BENCH_ROUNDS;
+		start = pmu_read_real_cycle();
+		for (int r = 0; r < STRING_BENCH_ROUNDS; r++)
+			string_bench_sink = strcmp(s1, s2);
+		cmp_o = (pmu_read_real_cycle() - start) / STRING_BENCH_ROUNDS;
+
+		kinfo("len %4lu: strlen %lu / %lu, strcmp %lu / %lu\n", lens[i], len_g, len_o, cmp_g, cmp_o);
+	}
+}
@@ -0,0 +1,88 @@
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/arena.h>
+
+#define ARENA_CHUNK_HEADER_SIZE ROUND_UP(sizeof(struct arena_chunk), ARENA_DEFAULT_ALIGN)
+
+static inline vaddr_t arena_chunk_end(struct arena_chunk *chunk)
+{
+	return (vaddr_t)chunk + BUDDY_CHUNK_SIZE(chunk->order);
+}
+
+/*
+ * @chunk_order: 每次向伙伴系统申请的 chunk 大小
+ */
+void arena_init(struct arena *arena, int chunk_order)
+{
+	BUG_ON(chunk_order < 0 || chunk_order >= BUDDY_MAX_ORDER);
+
+	arena->current = NULL;
+	arena->ptr = 0;
+	arena->end = 0;
+	arena->chunk_order = chunk_order;
+}
+
+/*
+ * 当前 chunk 放不下时申请新的 chunk，超过 chunk 大小的对象会独占一个更大的 chunk。
+ * 旧 chunk 剩余的空间不再使用
+ */
+void *__arena_alloc_slow(struct arena *arena, size_t size, size_t align)
+{
+	struct arena_chunk *chunk;
+	size_t need;
+	int order;
+	vaddr_t addr;
+
+	if (unlikely(align & (align - 1))) {
+		kwarn("arena_alloc: align %lu is not a power of 2\n", align);
+		return NULL;
+	}
+
+	/* 伙伴系统的 chunk 不保证按 chunk 大小对齐，按最坏情况预留对齐所需的空间 */
+	need = ARENA_CHUNK_HEADER_SIZE + align - 1 + size;
+	if (need < size || need > BUDDY_CHUNK_SIZE(BUDDY_MAX_ORDER - 1)) {
+		kwarn("arena_alloc: size %lu is too large\n", size);
+		return NULL;
+	}
+	order = MAX(arena->chunk_order, size_to_page_order(need));
+
+	chunk = get_pages(order);
+	if (!chunk)
+		return NULL;
+	chunk->prev = arena->current;
+	chunk->order = order;
+	arena->current = chunk;
+
+	addr = ROUND_UP((vaddr_t)chunk + ARENA_CHUNK_HEADER_SIZE, align);
+	arena->ptr = addr + size;
+	arena->end = arena_chunk_end(chunk);
+
+	return (void *)addr;
+}
+
+/*
+ * 释放检查点之后申请的所有 chunk，并恢复分配位置。花费只和 chunk 的数量有关，与对象数量无关
+ */
+void arena_restore(struct arena *arena, struct arena_mark mark)
+{
+	struct arena_chunk *chunk;
+
+	while (arena->current != mark.chunk) {
+		BUG_ON(arena->current == NULL);
+		chunk = arena->current;
+		arena->current = chunk->prev;
+		free_pages(chunk);
+	}
+
+	arena->ptr = mark.ptr;
+	arena->end = mark.chunk ? arena_chunk_end(mark.chunk) : 0;
+}
+
+void arena_release(struct arena *arena)
+{
+	struct arena_mark empty = { NULL, 0 };
+
+	arena_restore(arena, empty);
+}
@@ -0,0 +1,88 @@
+#include <arch/machine/pmu.h>
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <mm/mm.h>
+#include <mm/slab.h>
+#include <mm/arena.h>
+
+#define ARENA_BENCH_OBJS 4096
+#define ARENA_BENCH_OBJ_SIZE 64
+#define ARENA_BENCH_ROUNDS 16
+
+static void *bench_objs[ARENA_BENCH_OBJS];
+
+void arena_test(void)
+{
+	struct arena arena;
+	struct arena_mark outer, inner;
+	unsigned long free_mem = get_free_mem_size_from_buddy();
+	char *a, *b, *c;
+	u64 *big;
+
+	arena_init(&arena, ARENA_DEFAULT_CHUNK_ORDER);
+
+	/* 1. 对象之间没有头部，连续分配的对象紧挨着 */
+	a = arena_alloc(&arena, 24);
+	b = arena_alloc(&arena, 24);
+	assert(a != NULL && b == a + 24);
+	assert(IS_ALIGNED((vaddr_t)a, ARENA_DEFAULT_ALIGN));
+
+	/* 2. 对齐 */
+	c = arena_alloc_aligned(&arena, 1, 256);
+	assert(IS_ALIGNED((vaddr_t)c, 256));
+	c = arena_alloc_aligned(&arena, 100, 2 * PAGE_SIZE);
+	assert(c != NULL && IS_ALIGNED((vaddr_t)c, 2 * PAGE_SIZE));
+
+	/* 3. 嵌套检查点，回滚后重新分配得到相同的地址 */
+	outer = arena_save(&arena);
+	a = arena_alloc(&arena, 128);
+	inner = arena_save(&arena);
+	for (int i = 0; i < 1000; i++)
+		assert(arena_alloc(&arena, 200) != NULL);
+	arena_restore(&arena, inner);
+	assert(arena_alloc(&arena, 8) == (void *)inner.ptr);
+	arena_restore(&arena, outer);
+	assert(arena_alloc(&arena, 128) == a);
+
+	/* 4. 超过 chunk 大小的对象 */
+	big = arena_alloc(&arena, BUDDY_CHUNK_SIZE(ARENA_DEFAULT_CHUNK_ORDER) * 3);
+	assert(big != NULL);
+	for (unsigned long i = 0; i < BUDDY_CHUNK_SIZE(ARENA_DEFAULT_CHUNK_ORDER) * 3 / sizeof(u64); i += 64)
+		big[i] = i;
+	assert(arena_alloc(&arena, BUDDY_CHUNK_SIZE(BUDDY_MAX_ORDER)) == NULL);
+
+	/* 5. 一次性释放全部内存 */
+	arena_release(&arena);
+	assert(arena.current == NULL);
+	assert(get_free_mem_size_from_buddy() == free_mem);
+
+	kinfo("arena test passed\n");
+}
+
+/*
+ * 比较 ARENA_BENCH_OBJS 个对象的 slab 分配/释放与 arena 分配/整体释放的开销
+ */
+void arena_bench(void)
+{
+	struct arena arena;
+	u64 start, slab_cycles = 0, arena_cycles = 0;
+
+	for (int round = 0; round < ARENA_BENCH_ROUNDS; round++) {
+		start = pmu_read_real_cycle();
+		for (int i = 0; i < ARENA_BENCH_OBJS; i++)
+			bench_objs[i] = slab_alloc(ARENA_BENCH_OBJ_SIZE);
+		for (int i = 0; i < ARENA_BENCH_OBJS; i++)
+			slab_free(bench_objs[i]);
+		slab_cycles += pmu_read_real_cycle() - start;
+
+		start = pmu_read_real_cycle();
+		arena_init(&arena, ARENA_DEFAULT_CHUNK_ORDER);
+		for (int i = 0; i < ARENA_BENCH_OBJS; i++)
+			bench_objs[i] = arena_alloc(&arena, ARENA_BENCH_OBJ_SIZE);
+		arena_release(&arena);
+		arena_cycles += pmu_read_real_cycle() - start;
+	}
+
+	kinfo("arena bench: %d x %dB objects, slab %lu cycles, arena %lu cycles per round\n", ARENA_BENCH_OBJS,
+	      ARENA_BENCH_OBJ_SIZE, slab_cycles / ARENA_BENCH_ROUNDS, arena_cycles / ARENA_BENCH_ROUNDS);
+}
@@ -3,6 +3,7 @@
 #include <common/macro.h>
 #include <common/kprint.h>
 #include <common/utils.h>
+#include <common/errno.h>
 #include <mm/buddy.h>
 #include <mm/mm.h>
 
@@ -211,29 +212,34 @@ void init_buddy()
 	populate_page(memory_region_g.free_lists, memory_region_g.page_arrry, npages);
 }
 
-void buddy_free_pages(struct page *page)
+/* 调用者需持有 free_lists_lock */
+static void __buddy_free_pages(struct page *page)
 {
 	struct page *merge_page = NULL;
 	int order = 0;
 	struct free_list *free_list = NULL;
 
-	lock(&memory_region_g.free_lists_lock);
 	page->allocated = 0;
 	merge_page = merge_chunk(page);
 	order = merge_page->order;
 	free_list = &memory_region_g.free_lists[order];
 	list_add(&merge_page->node, &free_list->free_list);
 	free_list->nr_free++;
+}
+
+void buddy_free_pages(struct page *page)
+{
+	lock(&memory_region_g.free_lists_lock);
+	__buddy_free_pages(page);
 	unlock(&memory_region_g.free_lists_lock);
 }
 
-struct page *buddy_get_pages(int order)
+/* 调用者需持有 free_lists_lock */
+static struct page *__buddy_get_pages(int order)
 {
 	struct page *page = NULL;
 	struct free_list *free_list = NULL;
 
-	lock(&memory_region_g.free_lists_lock);
-
 	free_list = &memory_region_g.free_lists[order];
 	if (free_list->nr_free == 0) {
 		page = split_chunk(order + 1);
@@ -255,13 +261,163 @@ struct page *buddy_get_pages(int order)
 	BUG_ON(page->allocated == 1);
 	BUG_ON(page->order != order);
 	page->allocated = 1;
+	page->context_id = 0;
+	page->cpu_mask = 0;
+	page->refcount = 0;
 
 no_page:
+	return page;
+}
+
+struct page *buddy_get_pages(int order)
+{
+	struct page *page;
+
+	lock(&memory_region_g.free_lists_lock);
+	page = __buddy_get_pages(order);
 	unlock(&memory_region_g.free_lists_lock);
 
 	return page;
 }
 
+/**
+ * @brief: 在一次加锁中分配最多nr个order阶的内存块，用于批量补充缓存
+ * @param order: 内存块的阶
+ * @param nr: 最多分配的个数
+ * @param pages: 返回分配到的内存块
+ * @return: 实际分配到的个数，内存不足时可能小于nr
+*/
+int buddy_get_pages_bulk(int order, int nr, struct page **pages)
+{
+	int i;
+
+	lock(&memory_region_g.free_lists_lock);
+	for (i = 0; i < nr; i++) {
+		pages[i] = __buddy_get_pages(order);
+		if (pages[i] == NULL)
+			break;
+	}
+	unlock(&memory_region_g.free_lists_lock);
+
+	return i;
+}
+
+/**
+ * @brief: 在一次加锁中释放nr个内存块
+*/
+void buddy_free_pages_bulk(struct page **pages, int nr)
+{
+	lock(&memory_region_g.free_lists_lock);
+	for (int i = 0; i < nr; i++)
+		__buddy_free_pages(pages[i]);
+	unlock(&memory_region_g.free_lists_lock);
+}
+
+/*
+ * @page: 已分配chunk的首页，当前阶为page->order
+ * @new_order: 期望扩展到的阶
+ * @return: 如果后续的buddy chunk都空闲，原地合并并返回0，否则不做任何修改并返回-ENOMEM
+ *
+ * 只有当page位于每一级合并后chunk的前半部分、且后半部分的buddy恰好是同阶的空闲chunk时，
+ * 才能原地扩展，此时起始地址不变，调用者无需搬移数据
+ */
+int buddy_expand_pages(struct page *page, int new_order)
+{
+	struct page *chunk_buddy = NULL;
+	struct free_list *free_list = NULL;
+	int order = 0;
+	int err = 0;
+
+	BUG_ON(page == NULL || page->allocated == 0);
+	if (new_order >= BUDDY_MAX_ORDER) {
+		return -EINVAL;
+	}
+
+	lock(&memory_region_g.free_lists_lock);
+
+	/* 先检查每一级的buddy是否满足条件，避免扩展到一半失败后需要回滚 */
+	for (order = page->order; order < new_order; order++) {
+		if (!IS_ALIGNED((unsigned long)page_to_virt(page), BUDDY_CHUNK_SIZE(order + 1))) {
+			err = -ENOMEM;
+			goto out;
+		}
+		chunk_buddy = page + BUDDY_CHUNK_PAGES_COUNT(order);
+		if (page_to_pfn(chunk_buddy) >= memory_region_g.page_num || chunk_buddy->allocated == 1 ||
+		    chunk_buddy->order != order) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	/* 将各级buddy从free_list中摘下，并入当前chunk */
+	for (order = page->order; order < new_order; order++) {
+		chunk_buddy = page + BUDDY_CHUNK_PAGES_COUNT(order);
+		free_list = &memory_region_g.free_lists[order];
+		list_del(&chunk_buddy->node);
+		free_list->nr_free--;
+	}
+	page->order = new_order;
+
+out:
+	unlock(&memory_region_g.free_lists_lock);
+	return err;
+}
+
+/*
+ * @page: 已分配chunk的首页
+ * @new_order: 缩小后的阶，必须不大于page->order
+ *
+ * 原地缩小chunk，将多余的后半部分逐级还给伙伴系统。被释放的部分的buddy就是仍在
+ * 使用的前半部分，因此无需尝试合并
+ */
+void buddy_shrink_pages(struct page *page, int new_order)
+{
+	struct page *chunk_buddy = NULL;
+	struct free_list *free_list = NULL;
+	int order = 0;
+
+	BUG_ON(page == NULL || page->allocated == 0);
+	BUG_ON(new_order < 0 || new_order > page->order);
+
+	lock(&memory_region_g.free_lists_lock);
+	for (order = page->order - 1; order >= new_order; order--) {
+		chunk_buddy = page + BUDDY_CHUNK_PAGES_COUNT(order);
+		chunk_buddy->order = order;
+		chunk_buddy->allocated = 0;
+		chunk_buddy->slab = NULL;
+		free_list = &memory_region_g.free_lists[order];
+		list_add(&chunk_buddy->node, &free_list->free_list);
+		free_list->nr_free++;
+	}
+	page->order = new_order;
+	unlock(&memory_region_g.free_lists_lock);
+}
+
+/*
+ * @page: 已分配chunk的首页
+ *
+ * 把已分配的chunk拆成 2^order 个已分配的单页，之后每一页单独释放，全部释放后在伙伴系统中重新合并。
+ * 用于透明大页：整块映射，解除映射时逐页释放
+ */
+void buddy_split_pages(struct page *page)
+{
+	unsigned long npages;
+
+	BUG_ON(page == NULL || page->allocated == 0);
+
+	lock(&memory_region_g.free_lists_lock);
+	npages = BUDDY_CHUNK_PAGES_COUNT(page->order);
+	for (unsigned long i = 0; i < npages; i++) {
+		page[i].allocated = 1;
+		page[i].order = 0;
+		page[i].slab = NULL;
+		page[i].context_id = 0;
+		page[i].cpu_mask = 0;
+		page[i].refcount = 0;
+	}
+	unlock(&memory_region_g.free_lists_lock);
+}
+
 void *page_to_virt(struct page *page)
 {
 	return (void *)(memory_region_g.start_addr + page_to_pfn(page) * PAGE_SIZE);
@@ -1,6 +1,7 @@
 #include <mm/kmalloc.h>
 #include <mm/slab.h>
 #include <mm/buddy.h>
+#include <mm/mm.h>
 #include <common/utils.h>
 
 #define ZERO_SIZE_PTR ((void *)(-1UL))
@@ -70,7 +71,7 @@ void *kzalloc(size_t size)
 	void *addr;
 
 	addr = kmalloc(size);
-	if (!IS_VALID_PTR(addr)) {
+	if (IS_VALID_PTR(addr)) {
 		memset(addr, 0, size);
 	}
 	return addr;
@@ -99,6 +100,62 @@ void kfree(void *ptr)
 	}
 }
 
+/*
+ * @ptr: kmalloc返回的指针，为NULL时等价于kmalloc
+ * @new_size: 新的大小，为0时等价于kfree
+ * @return: 调整大小后的指针，失败时返回NULL且原内存块保持不变
+ *
+ * 如果新大小仍在原内存块的实际大小（slab块大小或buddy chunk大小）之内，直接返回原指针，
+ * 对于buddy分配的内存块会把多余的部分还给伙伴系统；需要增长时先尝试原地合并相邻的空闲
+ * buddy，都不行才重新分配并搬移数据
+ */
+void *krealloc(void *ptr, size_t new_size)
+{
+	struct page *page;
+	void *new_ptr;
+	size_t old_real_size, new_real_size;
+	int new_order;
+
+	if (!IS_VALID_PTR(ptr))
+		return kmalloc(new_size);
+
+	if (unlikely(new_size == 0)) {
+		kfree(ptr);
+		return ZERO_SIZE_PTR;
+	}
+
+	page = virt_to_page(ptr);
+	if (!page) {
+		kwarn("ptr %p is not a valid pointer\n", ptr);
+		return NULL;
+	}
+
+	if (page->slab) {
+		old_real_size = slab_order_to_size(((struct slab_header *)page->slab)->order);
+		if (new_size <= old_real_size)
+			return ptr;
+	} else {
+		old_real_size = BUDDY_CHUNK_SIZE(page->order);
+		new_order = size_to_page_order(new_size);
+		if (new_size <= old_real_size) {
+			if (new_order < page->order)
+				buddy_shrink_pages(page, new_order);
+			return ptr;
+		}
+		if (new_order > 0 && buddy_expand_pages(page, new_order) == 0)
+			return ptr;
+	}
+
+	new_ptr = __kmalloc(new_size, &new_real_size);
+	if (!new_ptr)
+		return NULL;
+
+	memcpy(new_ptr, ptr, MIN(old_real_size, new_size));
+	kfree(ptr);
+
+	return new_ptr;
+}
+
 void kmalloc_test()
 {
 	size_t free_buddy_size_before = get_free_mem_size_from_buddy();
@@ -118,3 +175,56 @@ void kmalloc_test()
 	assert(free_buddy_size_after == free_buddy_size_before); // 确保释放的内存和分配的内存一致
 	kinfo("kmalloc test passed\n");
 }
+
+static void fill_pattern(void *ptr, size_t size, u8 seed)
+{
+	for (size_t i = 0; i < size; i++)
+		((u8 *)ptr)[i] = (u8)(i + seed);
+}
+
+static bool check_pattern(void *ptr, size_t size, u8 seed)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (((u8 *)ptr)[i] != (u8)(i + seed))
+			return false;
+	}
+	return true;
+}
+
+void krealloc_test()
+{
+	size_t free_buddy_size_before = get_free_mem_size_from_buddy();
+	void *ptr, *new_ptr;
+
+	/* 仍在同一个slab块内，指针不变 */
+	ptr = kmalloc(100);
+	fill_pattern(ptr, 100, 1);
+	assert(krealloc(ptr, 128) == ptr);
+	assert(krealloc(ptr, 10) == ptr);
+
+	/* 跨slab块增长，数据被搬移 */
+	new_ptr = krealloc(ptr, 1500);
+	assert(new_ptr != NULL && check_pattern(new_ptr, 100, 1));
+	fill_pattern(new_ptr, 1500, 2);
+
+	/* 从slab增长到buddy */
+	ptr = krealloc(new_ptr, 3 * PAGE_SIZE);
+	assert(ptr != NULL && check_pattern(ptr, 1500, 2));
+	fill_pattern(ptr, 3 * PAGE_SIZE, 3);
+
+	/* buddy内存块逐步增长，无论是否原地扩展，数据都应保持不变 */
+	for (int order = 3; order < BUDDY_MAX_ORDER; order++) {
+		new_ptr = krealloc(ptr, BUDDY_CHUNK_SIZE(order));
+		assert(new_ptr != NULL && check_pattern(new_ptr, 3 * PAGE_SIZE, 3));
+		ptr = new_ptr;
+	}
+
+	/* 缩小时指针不变，多余的页还给伙伴系统 */
+	assert(krealloc(ptr, 5 * PAGE_SIZE) == ptr);
+	assert(virt_to_page(ptr)->order == 3);
+	assert(check_pattern(ptr, 3 * PAGE_SIZE, 3));
+
+	assert(krealloc(ptr, 0) == ZERO_SIZE_PTR);
+	assert(get_free_mem_size_from_buddy() == free_buddy_size_before);
+	kinfo("krealloc test passed\n");
+}
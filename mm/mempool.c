@@ -0,0 +1,288 @@
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/mempool.h>
+
+/* 预留不足、等待补充的 mempool */
+static struct list_head mempool_refill_list = { &mempool_refill_list, &mempool_refill_list };
+static struct lock mempool_refill_lock = { 0 };
+
+/* 走正常分配路径，不打印 OOM 警告，失败由调用者回退到预留 */
+static void *mempool_alloc_element(struct mempool *pool)
+{
+	struct page *page;
+
+	if (pool->type == MEMPOOL_SLAB)
+		return slab_alloc(slab_order_to_size(pool->order));
+
+	page = buddy_get_pages(pool->order);
+	return page ? page_to_virt(page) : NULL;
+}
+
+static void mempool_free_element(struct mempool *pool, void *element)
+{
+	if (pool->type == MEMPOOL_SLAB)
+		slab_free(element);
+	else
+		buddy_free_pages(virt_to_page(element));
+}
+
+/*
+ * @return: 0 on success, -ENOMEM 如果预留没能补满
+ */
+static int mempool_fill(struct mempool *pool)
+{
+	void *element;
+
+	lock(&pool->lock);
+	while (pool->curr_nr < pool->min_nr) {
+		/* 分配时不持有池子的锁，mempool_free 可以在此期间放回对象 */
+		unlock(&pool->lock);
+		element = mempool_alloc_element(pool);
+		if (!element)
+			return -ENOMEM;
+		lock(&pool->lock);
+		if (pool->curr_nr < pool->min_nr) {
+			pool->elements[pool->curr_nr++] = element;
+		} else {
+			unlock(&pool->lock);
+			mempool_free_element(pool, element);
+			return 0;
+		}
+	}
+	unlock(&pool->lock);
+
+	return 0;
+}
+
+static void mempool_queue_refill(struct mempool *pool)
+{
+	lock(&mempool_refill_lock);
+	if (!pool->refill_pending) {
+		pool->refill_pending = true;
+		list_append(&pool->refill_node, &mempool_refill_list);
+	}
+	unlock(&mempool_refill_lock);
+}
+
+static struct mempool *mempool_create(enum mempool_type type, int order, int min_nr)
+{
+	struct mempool *pool;
+
+	BUG_ON(min_nr <= 0);
+
+	pool = kmalloc(sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pool->elements = kmalloc(min_nr * sizeof(void *));
+	if (!pool->elements) {
+		kfree(pool);
+		return NULL;
+	}
+	pool->type = type;
+	pool->order = order;
+	pool->min_nr = min_nr;
+	pool->curr_nr = 0;
+	pool->refill_pending = false;
+	lock_init(&pool->lock);
+	init_list_head(&pool->refill_node);
+
+	if (mempool_fill(pool) != 0) {
+		mempool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * @size: 对象大小，必须落在 slab 的大小范围内
+ * @min_nr: 预留对象的数量
+ */
+struct mempool *mempool_create_slab(size_t size, int min_nr)
+{
+	int order = size_to_slab_order(size);
+
+	if (order == -1) {
+		kwarn("mempool_create_slab: invalid size %lu\n", size);
+		return NULL;
+	}
+	return mempool_create(MEMPOOL_SLAB, order, min_nr);
+}
+
+/*
+ * @order: 每个对象为 2^order 个连续物理页
+ * @min_nr: 预留对象的数量
+ */
+struct mempool *mempool_create_pages(int order, int min_nr)
+{
+	if (order < 0 || order >= BUDDY_MAX_ORDER) {
+		kwarn("mempool_create_pages: invalid order %d\n", order);
+		return NULL;
+	}
+	return mempool_create(MEMPOOL_PAGES, order, min_nr);
+}
+
+void mempool_destroy(struct mempool *pool)
+{
+	lock(&mempool_refill_lock);
+	if (pool->refill_pending) {
+		list_del(&pool->refill_node);
+		pool->refill_pending = false;
+	}
+	unlock(&mempool_refill_lock);
+
+	while (pool->curr_nr > 0)
+		mempool_free_element(pool, pool->elements[--pool->curr_nr]);
+	kfree(pool->elements);
+	kfree(pool);
+}
+
+/*
+ * @return: 对象地址；只有在正常分配失败且预留也已耗尽时才返回NULL
+ */
+void *mempool_alloc(struct mempool *pool)
+{
+	void *element;
+
+	element = mempool_alloc_element(pool);
+	if (likely(element))
+		return element;
+
+	lock(&pool->lock);
+	if (pool->curr_nr == 0) {
+		unlock(&pool->lock);
+		mempool_queue_refill(pool);
+		return NULL;
+	}
+	element = pool->elements[--pool->curr_nr];
+	unlock(&pool->lock);
+
+	mempool_queue_refill(pool);
+	return element;
+}
+
+/*
+ * 预留不足时优先放回预留，否则还给正常的分配器
+ */
+void mempool_free(void *element, struct mempool *pool)
+{
+	if (unlikely(element == NULL))
+		return;
+
+	lock(&pool->lock);
+	if (pool->curr_nr < pool->min_nr) {
+		pool->elements[pool->curr_nr++] = element;
+		unlock(&pool->lock);
+		return;
+	}
+	unlock(&pool->lock);
+
+	mempool_free_element(pool, element);
+}
+
+/*
+ * 由定时中断调用，把预留不足的 mempool 补满。内存仍然紧张时补不满的池子留在链表上，
+ * 下一个 tick 再试
+ */
+void mempool_refill_pending(void)
+{
+	struct mempool *pool;
+
+	lock(&mempool_refill_lock);
+	while (!list_empty(&mempool_refill_list)) {
+		pool = list_first_entry(&mempool_refill_list, struct mempool, refill_node);
+		list_del(&pool->refill_node);
+		pool->refill_pending = false;
+		unlock(&mempool_refill_lock);
+
+		if (mempool_fill(pool) != 0) {
+			mempool_queue_refill(pool);
+			return;
+		}
+
+		lock(&mempool_refill_lock);
+	}
+	unlock(&mempool_refill_lock);
+}
+
+/* 耗尽伙伴系统的所有空闲页，空闲页通过首个字串成链表 */
+static void *exhaust_buddy(void)
+{
+	void *head = NULL;
+	struct page *page;
+
+	for (int order = BUDDY_MAX_ORDER - 1; order >= 0; order--) {
+		while ((page = buddy_get_pages(order)) != NULL) {
+			*(void **)page_to_virt(page) = head;
+			head = page_to_virt(page);
+		}
+	}
+	return head;
+}
+
+static void release_buddy(void *head)
+{
+	void *next;
+
+	while (head) {
+		next = *(void **)head;
+		buddy_free_pages(virt_to_page(head));
+		head = next;
+	}
+}
+
+void mempool_test(void)
+{
+	struct mempool *slab_pool, *page_pool;
+	void *objs[16];
+	void *exhausted;
+	unsigned long free_mem;
+
+	/* 1. 内存充足时走正常路径，预留保持不变 */
+	slab_pool = mempool_create_slab(100, 4);
+	assert(slab_pool != NULL && slab_pool->curr_nr == 4);
+	for (int i = 0; i < 16; i++) {
+		objs[i] = mempool_alloc(slab_pool);
+		assert(objs[i] != NULL);
+	}
+	assert(slab_pool->curr_nr == 4 && !slab_pool->refill_pending);
+	for (int i = 0; i < 16; i++)
+		mempool_free(objs[i], slab_pool);
+	mempool_destroy(slab_pool);
+
+	free_mem = get_free_mem_size_from_buddy();
+
+	/* 2. 伙伴系统耗尽后从预留中分配，预留用完才返回NULL */
+	page_pool = mempool_create_pages(0, 4);
+	assert(page_pool != NULL);
+	exhausted = exhaust_buddy();
+	for (int i = 0; i < 4; i++) {
+		objs[i] = mempool_alloc(page_pool);
+		assert(objs[i] != NULL);
+	}
+	assert(page_pool->curr_nr == 0 && page_pool->refill_pending);
+	assert(mempool_alloc(page_pool) == NULL);
+
+	/* 3. 内存紧张时补充失败，池子留在待补充链表上 */
+	mempool_refill_pending();
+	assert(page_pool->curr_nr == 0 && page_pool->refill_pending);
+
+	/* 4. 释放的对象优先放回预留 */
+	mempool_free(objs[0], page_pool);
+	assert(page_pool->curr_nr == 1);
+
+	/* 5. 内存恢复后异步补满 */
+	release_buddy(exhausted);
+	mempool_refill_pending();
+	assert(page_pool->curr_nr == 4 && !page_pool->refill_pending);
+	for (int i = 1; i < 4; i++)
+		mempool_free(objs[i], page_pool);
+	assert(page_pool->curr_nr == 4);
+	mempool_destroy(page_pool);
+
+	assert(get_free_mem_size_from_buddy() == free_mem);
+	kinfo("mempool test passed\n");
+}
@@ -0,0 +1,226 @@
+#include <common/errno.h>
+#include <common/kprint.h>
+#include <common/lock.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <arch/sync.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/tlb.h>
+#include <mm/vmspace.h>
+#include <mm/rmap.h>
+#include <mm/migrate.h>
+
+/* 待迁移页的一个映射 */
+struct migrate_mapping {
+	struct vmspace *vms;
+	vaddr_t va;
+	/* 失效前的页表项 */
+	u64 pte;
+};
+
+struct migrate_batch {
+	/* 持有写锁的地址空间 */
+	int nr_vms;
+	struct vmspace *vms[MIGRATE_BATCH_VMS];
+	/* 批次中第i个页的映射为 mappings[first[i], first[i + 1]) */
+	int nr_mappings;
+	struct migrate_mapping mappings[MIGRATE_BATCH_MAPPINGS];
+	int first[MIGRATE_BATCH_PAGES + 1];
+	struct tlb_gather tlb;
+};
+
+static bool batch_has_vms(struct migrate_batch *batch, struct vmspace *vms)
+{
+	for (int i = 0; i < batch->nr_vms; i++) {
+		if (batch->vms[i] == vms)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief: 释放批次中从第from个开始的地址空间的写锁
+*/
+static void batch_unlock_vms(struct migrate_batch *batch, int from)
+{
+	while (batch->nr_vms > from)
+		write_unlock(&batch->vms[--batch->nr_vms]->lock);
+}
+
+/**
+ * @brief: 找到页的所有映射加入批次，并持有这些地址空间的写锁。之后这些地址空间不会再建立或解除该页的映射，
+ *         也不会被复制，因此不会出现新的映射
+ * @return: 0 on success, -EINVAL 如果不是由页表管理的匿名页, -EAGAIN 如果某个地址空间的锁正被持有,
+ *          -ENOSPC 如果批次放不下, -ENOMEM 如果无法拆分大页。失败时撤销该页加入的映射和锁
+*/
+static int collect_mappings(struct migrate_batch *batch, struct page *page)
+{
+	struct anon_vma *anon_vma = page->anon_vma, *av;
+	paddr_t page_pa = virt_to_phys(page_to_virt(page));
+	vaddr_t va = page->rmap_va;
+	int nr_vms = batch->nr_vms;
+	int nr_mappings = batch->nr_mappings;
+	struct vmregion *vmr;
+	struct vmspace *vms;
+	bool locked;
+	paddr_t pa;
+	int ret = 0;
+
+	if (page->refcount == 0 || anon_vma == NULL)
+		return -EINVAL;
+
+	anon_vma_lock(anon_vma);
+	for (av = anon_vma; av && !ret; av = anon_vma_next(av, anon_vma)) {
+		for_each_in_list(vmr, struct vmregion, anon_node, &av->vmr_list) {
+			if (va - vmr->start >= vmr->size)
+				continue;
+			vms = vmr->vms;
+			locked = batch_has_vms(batch, vms);
+			/* 与 __rmap_walk 相同，持有 anon_vma 的锁时只尝试获取 vms->lock */
+			if (!locked && !write_trylock(&vms->lock)) {
+				ret = -EAGAIN;
+				break;
+			}
+			if (query_in_pgtbl(vms->pgtbl, va, &pa, NULL) != 0 || pa != page_pa) {
+				if (!locked)
+					write_unlock(&vms->lock);
+				continue;
+			}
+			if ((!locked && batch->nr_vms == MIGRATE_BATCH_VMS) ||
+			    batch->nr_mappings == MIGRATE_BATCH_MAPPINGS) {
+				if (!locked)
+					write_unlock(&vms->lock);
+				ret = -ENOSPC;
+				break;
+			}
+			/* 大页中的一页单独迁移，先拆分为页映射 */
+			ret = split_huge_page_in_pgtbl(vms->pgtbl, va, &vms->rss);
+			if (ret) {
+				if (!locked)
+					write_unlock(&vms->lock);
+				break;
+			}
+			if (!locked)
+				batch->vms[batch->nr_vms++] = vms;
+			batch->mappings[batch->nr_mappings].vms = vms;
+			batch->mappings[batch->nr_mappings].va = va;
+			batch->nr_mappings++;
+		}
+	}
+	anon_vma_unlock(anon_vma);
+
+	if (ret) {
+		batch_unlock_vms(batch, nr_vms);
+		batch->nr_mappings = nr_mappings;
+	}
+	return ret;
+}
+
+/**
+ * @brief: 迁移收集好映射的一批页，完成后释放地址空间的锁和调用者持有的原来的页的引用
+*/
+static void migrate_batch(struct migrate_batch *batch, struct page **old, struct page **new, int nr)
+{
+	struct migrate_mapping *m;
+	struct vmspace *vms;
+	int nr_mapped;
+	paddr_t pa;
+	int ret;
+
+	/* 1. 所有映射失效之后，每个地址空间只失效一次TLB */
+	for (int i = 0; i < batch->nr_vms; i++) {
+		vms = batch->vms[i];
+		tlb_gather_init(&batch->tlb, vms->pgtbl);
+		for (int j = 0; j < batch->nr_mappings; j++) {
+			m = &batch->mappings[j];
+			if (m->vms != vms)
+				continue;
+			/* 收集映射时已经拆分了大页 */
+			ret = take_pte_in_pgtbl(vms->pgtbl, m->va, &m->pte, &batch->tlb);
+			BUG_ON(ret != 0);
+		}
+		tlb_gather_flush(&batch->tlb);
+	}
+
+	/* 2. 没有CPU能再访问原来的页 */
+	for (int i = 0; i < nr; i++)
+		memcpy(page_to_virt(new[i]), page_to_virt(old[i]), PAGE_SIZE);
+
+	/* 3. 映射转移到新的页，新的页继承原来的页的反向映射 */
+	for (int i = 0; i < nr; i++) {
+		pa = virt_to_phys(page_to_virt(new[i]));
+		for (int j = batch->first[i]; j < batch->first[i + 1]; j++) {
+			m = &batch->mappings[j];
+			restore_pte_in_pgtbl(m->vms->pgtbl, m->va, m->pte, pa);
+		}
+		nr_mapped = batch->first[i + 1] - batch->first[i];
+		new[i]->refcount = nr_mapped;
+		if (nr_mapped)
+			page_add_anon_rmap(new[i], old[i]->anon_vma, old[i]->rmap_va);
+		atomic_fetch_sub_32(&old[i]->refcount, nr_mapped);
+	}
+	batch_unlock_vms(batch, 0);
+
+	for (int i = 0; i < nr; i++) {
+		/* 已经没有映射的页不需要新的页 */
+		if (new[i]->refcount == 0)
+			free_pages(page_to_virt(new[i]));
+		put_anon_page(old[i]);
+	}
+}
+
+/**
+ * @brief: 迁移一组匿名页：old[i] 的内容和所有映射转移到 new[i]，然后释放 old[i]。
+ *         每批最多 MIGRATE_BATCH_PAGES 个页，同一批中每个地址空间只失效一次TLB
+ * @param old: 要迁移的页，调用者持有每个页的一个引用，迁移成功后该引用被释放
+ * @param new: 从伙伴系统分配的空闲页，迁移成功后由页表管理
+ * @param nr: 页数
+ * @return: 迁移成功的页数n，old[0, n) 已经迁移，其余的页和 new 仍归调用者所有；
+ *          第一个页就失败时返回 -EINVAL, -EAGAIN（某个地址空间正被修改，稍后重试）, -ENOSPC, -ENOMEM
+*/
+int migrate_pages(struct page **old, struct page **new, int nr)
+{
+	struct migrate_batch *batch;
+	int done = 0;
+	int ret = 0;
+	int n;
+
+	batch = kmalloc(sizeof(*batch));
+	if (!batch)
+		return -ENOMEM;
+
+	while (done < nr) {
+		batch->nr_vms = 0;
+		batch->nr_mappings = 0;
+		for (n = 0; n < MIN(nr - done, MIGRATE_BATCH_PAGES); n++) {
+			batch->first[n] = batch->nr_mappings;
+			ret = collect_mappings(batch, old[done + n]);
+			if (ret)
+				break;
+		}
+		batch->first[n] = batch->nr_mappings;
+		if (n > 0) {
+			migrate_batch(batch, old + done, new + done, n);
+			done += n;
+		}
+		/* 放不下的页留给下一批 */
+		if (n == 0 || (ret && ret != -ENOSPC))
+			break;
+	}
+
+	kfree(batch);
+	return done > 0 ? done : ret;
+}
+
+/**
+ * @brief: 迁移一个匿名页，见 migrate_pages
+ * @return: 0 on success, -EINVAL, -EAGAIN, -ENOSPC, -ENOMEM
+*/
+int migrate_page(struct page *old, struct page *new)
+{
+	int ret = migrate_pages(&old, &new, 1);
+
+	return ret < 0 ? ret : 0;
+}
@@ -3,6 +3,10 @@
 #include <mm/buddy.h>
 #include <mm/slab.h>
 #include <mm/kmalloc.h>
+#include <mm/vmalloc.h>
+#include <mm/mempool.h>
+#include <mm/arena.h>
+#include <mm/vmspace.h>
 
 struct mem_region memory_region_g = { 0 };
 
@@ -17,6 +21,23 @@ void mm_init(void *physmem_info)
 	init_slab();
 	kinfo("Slab allocator initialized.\n");
 	print_slab_info();
+
+	/* 3. 初始化vmalloc */
+	init_vmalloc();
+	kinfo("Vmalloc initialized.\n");
+
 	test_slab();
 	kmalloc_test();
+	krealloc_test();
+	page_table_test();
+	vmalloc_test();
+	mempool_test();
+	arena_test();
+	vmspace_test();
+}
+
+void mm_bench(void)
+{
+	arena_bench();
+	page_table_bench();
 }
\ No newline at end of file
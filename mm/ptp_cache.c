@@ -0,0 +1,111 @@
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/utils.h>
+#include <arch/machine/smp.h>
+#include <mm/mm.h>
+#include <mm/ptp_cache.h>
+
+/*
+ * 内核运行时不开中断，每个CPU只访问自己的缓存，因此不需要加锁
+ */
+struct ptp_cache {
+	int nr;
+	void *pages[PTP_CACHE_MAX];
+} __attribute__((aligned(64)));
+
+static struct ptp_cache ptp_caches[PLAT_CPU_NUM];
+
+/**
+ * @brief: 从伙伴系统批量取 PTP_CACHE_BATCH 个页，清零后放入缓存
+ * @return: 取到的页数
+*/
+static int ptp_cache_refill(struct ptp_cache *cache)
+{
+	struct page *pages[PTP_CACHE_BATCH];
+	int nr;
+
+	nr = buddy_get_pages_bulk(0, PTP_CACHE_BATCH, pages);
+	for (int i = 0; i < nr; i++) {
+		cache->pages[cache->nr] = page_to_virt(pages[i]);
+		memset(cache->pages[cache->nr], 0, PAGE_SIZE);
+		cache->nr++;
+	}
+	return nr;
+}
+
+/**
+ * @brief: 把缓存中最后nr个页还给伙伴系统
+*/
+static void ptp_cache_shrink(struct ptp_cache *cache, int nr)
+{
+	struct page *pages[PTP_CACHE_BATCH];
+	int n;
+
+	while (nr > 0) {
+		n = MIN(nr, PTP_CACHE_BATCH);
+		for (int i = 0; i < n; i++)
+			pages[i] = virt_to_page(cache->pages[--cache->nr]);
+		buddy_free_pages_bulk(pages, n);
+		nr -= n;
+	}
+}
+
+/**
+ * @brief: 分配一个已经清零的页表页
+ * @return: 页表页的虚拟地址，内存不足时返回NULL
+*/
+void *alloc_ptp(void)
+{
+	struct ptp_cache *cache = &ptp_caches[smp_get_cpu_id()];
+	struct page *page;
+	void *ptp;
+
+	if (cache->nr == 0 && ptp_cache_refill(cache) == 0) {
+		kwarn("[OOM] Cannot get page table page from Buddy!\n");
+		return NULL;
+	}
+
+	ptp = cache->pages[--cache->nr];
+	/* 该页之前可能作为用户页表的根页使用过 */
+	page = virt_to_page(ptp);
+	page->context_id = 0;
+	page->cpu_mask = 0;
+	lock_init(&page->ptl);
+	return ptp;
+}
+
+/**
+ * @brief: 回收页表页，放回本CPU的缓存
+ * @param ptp: 页表页，所有页表项都必须已经无效（即全0），这样再次分配时不需要清零
+*/
+void free_ptp(void *ptp)
+{
+	struct ptp_cache *cache = &ptp_caches[smp_get_cpu_id()];
+
+	BUG_ON(virt_to_page(ptp) == NULL);
+	if (cache->nr == PTP_CACHE_MAX)
+		ptp_cache_shrink(cache, PTP_CACHE_BATCH);
+	cache->pages[cache->nr++] = ptp;
+}
+
+/**
+ * @brief: 把本CPU缓存的页表页全部还给伙伴系统
+*/
+void ptp_cache_drain(void)
+{
+	struct ptp_cache *cache = &ptp_caches[smp_get_cpu_id()];
+
+	ptp_cache_shrink(cache, cache->nr);
+}
+
+/**
+ * @brief: 所有CPU上缓存的页表页数量
+*/
+unsigned long ptp_cache_nr_pages(void)
+{
+	unsigned long nr = 0;
+
+	for (int cpu = 0; cpu < PLAT_CPU_NUM; cpu++)
+		nr += ptp_caches[cpu].nr;
+	return nr;
+}
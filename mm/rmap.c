@@ -0,0 +1,278 @@
+#include <common/errno.h>
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <arch/sync.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/vmspace.h>
+#include <mm/rmap.h>
+
+static void get_anon_vma(struct anon_vma *anon_vma)
+{
+	atomic_fetch_add_32(&anon_vma->refcount, 1);
+}
+
+/**
+ * @brief: 放弃 anon_vma 的一个引用，最后一个引用释放时从父节点的 children 中移除，并放弃对父节点的引用。
+ *         调用者不能持有 anon_vma 的锁
+*/
+static void put_anon_vma(struct anon_vma *anon_vma)
+{
+	struct anon_vma *parent;
+
+	while (anon_vma && atomic_fetch_sub_32(&anon_vma->refcount, 1) == 1) {
+		parent = anon_vma->parent;
+		if (parent) {
+			anon_vma_lock(anon_vma);
+			list_del(&anon_vma->sibling);
+			anon_vma_unlock(anon_vma);
+		}
+		kfree(anon_vma);
+		anon_vma = parent;
+	}
+}
+
+/**
+ * @brief: 将区域加入 anon_vma
+*/
+static void anon_vma_link(struct vmregion *vmr, struct anon_vma *anon_vma)
+{
+	get_anon_vma(anon_vma);
+	vmr->anon_vma = anon_vma;
+	anon_vma_lock(anon_vma);
+	list_append(&vmr->anon_node, &anon_vma->vmr_list);
+	anon_vma_unlock(anon_vma);
+}
+
+/**
+ * @brief: 创建一个 anon_vma，parent 不为NULL时作为它的子节点，与它共用根的锁
+*/
+static struct anon_vma *anon_vma_alloc(struct anon_vma *parent)
+{
+	struct anon_vma *anon_vma = kmalloc(sizeof(*anon_vma));
+
+	if (!anon_vma)
+		return NULL;
+	init_list_head(&anon_vma->vmr_list);
+	init_list_head(&anon_vma->children);
+	anon_vma->refcount = 0;
+	anon_vma->parent = parent;
+	if (parent) {
+		get_anon_vma(parent);
+		anon_vma->root = parent->root;
+		anon_vma_lock(parent);
+		list_append(&anon_vma->sibling, &parent->children);
+		anon_vma_unlock(parent);
+	} else {
+		anon_vma->root = anon_vma;
+		lock_init(&anon_vma->lock);
+	}
+	return anon_vma;
+}
+
+/**
+ * @brief: 为新建立的区域创建 anon_vma
+ * @return: 0 on success, -ENOMEM
+*/
+int anon_vma_prepare(struct vmregion *vmr)
+{
+	struct anon_vma *anon_vma = anon_vma_alloc(NULL);
+
+	if (!anon_vma)
+		return -ENOMEM;
+	anon_vma_link(vmr, anon_vma);
+	return 0;
+}
+
+/**
+ * @brief: 复制地址空间时为子区域创建自己的 anon_vma，挂在父区域的 anon_vma 下。
+ *         父区域已有的页通过父区域的 anon_vma 的子树仍能找到子区域中的映射
+ * @param vmr: 子区域
+ * @param parent: 被复制的父区域
+ * @return: 0 on success, -ENOMEM
+*/
+int anon_vma_fork(struct vmregion *vmr, struct vmregion *parent)
+{
+	struct anon_vma *anon_vma = anon_vma_alloc(parent->anon_vma);
+
+	if (!anon_vma)
+		return -ENOMEM;
+	anon_vma_link(vmr, anon_vma);
+	return 0;
+}
+
+/**
+ * @brief: 把区域vmr在at处拆分为两个区域，后一半由new表示并加入同一个 anon_vma，页的反向映射不变。
+ *         在 anon_vma 的锁内同时修改两个区域的范围，反向映射的遍历不会漏掉或重复找到某个映射
+ * @param vmr: 被拆分的区域，之后为[vmr->start, at)
+ * @param new: 未加入任何 anon_vma 的新区域，之后为[at, 原来的结束地址)
+ * @param at: 拆分的地址，在区域内部
+*/
+void anon_vma_split(struct vmregion *vmr, struct vmregion *new, vaddr_t at)
+{
+	struct anon_vma *anon_vma = vmr->anon_vma;
+
+	get_anon_vma(anon_vma);
+	new->anon_vma = anon_vma;
+	anon_vma_lock(anon_vma);
+	new->start = at;
+	new->size = vmr->start + vmr->size - at;
+	vmr->size = at - vmr->start;
+	list_append(&new->anon_node, &anon_vma->vmr_list);
+	anon_vma_unlock(anon_vma);
+}
+
+/**
+ * @brief: 将区域移出 anon_vma，调用者需已经解除该区域的所有映射。之后区域可以被释放
+*/
+void anon_vma_unlink(struct vmregion *vmr)
+{
+	struct anon_vma *anon_vma = vmr->anon_vma;
+
+	anon_vma_lock(anon_vma);
+	list_del(&vmr->anon_node);
+	anon_vma_unlock(anon_vma);
+	vmr->anon_vma = NULL;
+	put_anon_vma(anon_vma);
+}
+
+/**
+ * @brief: 按先序遍历以top为根的子树，调用者持有 anon_vma 的锁
+ * @return: pos 之后的下一个节点, NULL 如果已经遍历完
+*/
+struct anon_vma *anon_vma_next(struct anon_vma *pos, struct anon_vma *top)
+{
+	if (!list_empty(&pos->children))
+		return list_entry(pos->children.next, struct anon_vma, sibling);
+	for (; pos != top; pos = pos->parent) {
+		if (pos->sibling.next != &pos->parent->children)
+			return list_entry(pos->sibling.next, struct anon_vma, sibling);
+	}
+	return NULL;
+}
+
+/**
+ * @brief: 记录页所属的 anon_vma 和映射它的虚拟地址，页在释放之前一直持有 anon_vma 的引用
+ * @param anon_vma: 可以为NULL，此时该页没有反向映射
+*/
+void page_add_anon_rmap(struct page *page, struct anon_vma *anon_vma, vaddr_t va)
+{
+	if (anon_vma)
+		get_anon_vma(anon_vma);
+	page->anon_vma = anon_vma;
+	page->rmap_va = va;
+}
+
+/**
+ * @brief: 页的最后一个引用释放时调用，放弃 anon_vma 的引用
+*/
+void page_remove_anon_rmap(struct page *page)
+{
+	if (page->anon_vma) {
+		put_anon_vma(page->anon_vma);
+		page->anon_vma = NULL;
+	}
+}
+
+/**
+ * @brief: 释放一个由页表管理的页（refcount 不为0）的引用，最后一个引用释放时释放该页。
+ *         用于没有映射的页，例如调用者为了 try_to_unmap 额外持有的引用
+*/
+void put_anon_page(struct page *page)
+{
+	if (atomic_fetch_sub_32(&page->refcount, 1) == 1) {
+		page_remove_anon_rmap(page);
+		free_pages(page_to_virt(page));
+	}
+}
+
+/**
+ * @brief: 对页的每个映射调用fn
+ * @param write: 持有 vms->lock 的写锁调用fn，否则持有读锁
+ * @return: fn 的返回值, -EAGAIN 如果某个地址空间的锁正被持有
+ *
+ * 加锁顺序为 anon_vma 的锁然后 vms->lock，与复制地址空间等持有 vms->lock 再链接区域的路径相反，
+ * 因此这里只尝试获取 vms->lock，失败时返回 -EAGAIN 由调用者稍后重试
+*/
+static int __rmap_walk(struct page *page, rmap_fn fn, void *arg, bool write)
+{
+	struct anon_vma *anon_vma = page->anon_vma, *av;
+	paddr_t page_pa = virt_to_phys(page_to_virt(page));
+	vaddr_t va = page->rmap_va;
+	struct vmregion *vmr;
+	struct vmspace *vms;
+	paddr_t pa;
+	int ret = 0;
+
+	/* 调用者持有页的引用，页的 anon_vma 不会被释放 */
+	if (!anon_vma)
+		return 0;
+
+	anon_vma_lock(anon_vma);
+	for (av = anon_vma; av && !ret; av = anon_vma_next(av, anon_vma)) {
+		for_each_in_list(vmr, struct vmregion, anon_node, &av->vmr_list) {
+			if (va - vmr->start >= vmr->size)
+				continue;
+			vms = vmr->vms;
+			if (write ? !write_trylock(&vms->lock) : !read_trylock(&vms->lock)) {
+				ret = -EAGAIN;
+				break;
+			}
+			/* 同一个地址上可能已经是写时复制得到的另一个页，或者还没有映射 */
+			if (query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0 && pa == page_pa)
+				ret = fn(vms, va, arg);
+			if (write)
+				write_unlock(&vms->lock);
+			else
+				read_unlock(&vms->lock);
+			if (ret)
+				break;
+		}
+	}
+	anon_vma_unlock(anon_vma);
+	return ret;
+}
+
+/**
+ * @brief: 对页的每个映射调用fn，调用时持有该地址空间的读锁。调用者需持有页的一个引用
+ * @return: fn 的返回值, -EAGAIN 如果某个地址空间正被修改
+*/
+int rmap_walk(struct page *page, rmap_fn fn, void *arg)
+{
+	return __rmap_walk(page, fn, arg, false);
+}
+
+static int count_one(struct vmspace *vms, vaddr_t va, void *arg)
+{
+	(*(int *)arg)++;
+	return 0;
+}
+
+/**
+ * @brief: 统计页的映射数。调用者需持有页的一个引用
+ * @return: 映射数, -EAGAIN 如果某个地址空间正被修改
+*/
+int page_mapcount(struct page *page)
+{
+	int nr = 0;
+	int ret;
+
+	ret = rmap_walk(page, count_one, &nr);
+	return ret < 0 ? ret : nr;
+}
+
+static int unmap_one(struct vmspace *vms, vaddr_t va, void *arg)
+{
+	return unmap_range_in_pgtbl(vms->pgtbl, va, PAGE_SIZE, &vms->rss);
+}
+
+/**
+ * @brief: 在所有地址空间中解除页的映射。之后访问这些地址会重新缺页，调用者（如页迁移）负责在此之前
+ *         保存页的内容。调用者需持有页的一个引用，否则解除最后一个映射时页会被释放
+ * @return: 0 on success, -EAGAIN 如果某个地址空间正被修改，此时部分映射可能已经解除
+*/
+int try_to_unmap(struct page *page)
+{
+	return __rmap_walk(page, unmap_one, NULL, true);
+}
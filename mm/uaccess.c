@@ -0,0 +1,204 @@
+#include <arch/mmu.h>
+#include <arch/sync.h>
+#include <common/macro.h>
+#include <common/kprint.h>
+#include <common/errno.h>
+#include <common/utils.h>
+#include <mm/common_pte.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/ptp_cache.h>
+#include <mm/uaccess.h>
+#include <mm/vmspace.h>
+
+struct uaccess_ctx {
+	/* 下一段映射应当开始的用户虚拟地址，用于发现空洞 */
+	vaddr_t next_va;
+	char *kbuf;
+	bool to_user;
+	/* 遇到写时复制的映射时停止遍历，记录其长度 */
+	size_t cow_len;
+};
+
+/* uaccess_run 遇到写时复制的映射，需要先复制再继续 */
+#define UACCESS_COW (1)
+
+static int uaccess_run(struct pgtbl_run *run, void *arg)
+{
+	struct uaccess_ctx *ctx = arg;
+	void *kaddr = (void *)phys_to_virt(run->pa);
+
+	if (run->va != ctx->next_va)
+		return -EFAULT;
+	if (!(run->flags & (ctx->to_user ? VMR_WRITE : VMR_READ)) || (run->flags & VMR_DEVICE))
+		return -EFAULT;
+	/* 通过线性映射直接写入会修改共享的页 */
+	if (ctx->to_user && (run->flags & VMR_COW)) {
+		ctx->cow_len = run->len;
+		return UACCESS_COW;
+	}
+
+	if (ctx->to_user)
+		memcpy(kaddr, ctx->kbuf, run->len);
+	else
+		memcpy(ctx->kbuf, kaddr, run->len);
+	ctx->kbuf += run->len;
+	ctx->next_va += run->len;
+	return 0;
+}
+
+/**
+ * @brief: 在内核缓冲区和当前用户地址空间之间拷贝数据
+ * @param uva: 用户虚拟地址
+ * @param kbuf: 内核缓冲区
+ * @param len: 长度
+ * @param to_user: 拷贝方向
+ * @return: 0 on success, -EFAULT 如果用户缓冲区有未映射的部分或者权限不足，此时可能已经拷贝了一部分
+ *
+ * 写入写时复制的页之前，像用户态写入触发缺页一样先复制这些页，再从该处继续。
+ * 通过线性映射写入不会更新用户页表项，写入的页由 mark_dirty_in_pgtbl 标记为脏。
+ * 当前CPU使用 vmspace 时像缺页处理一样持有其读锁，拷贝期间页和页表页不会被其他CPU解除映射、迁移或释放
+*/
+static int copy_user(vaddr_t uva, char *kbuf, size_t len, bool to_user)
+{
+	struct uaccess_ctx ctx = { .next_va = uva, .kbuf = kbuf, .to_user = to_user };
+	struct vmspace *vms = get_current_vmspace();
+	void *pgtbl = get_current_user_pgtbl();
+	long rss = 0;
+	vaddr_t va;
+	int ret;
+
+	if (len == 0)
+		return 0;
+	if (uva >= USER_SPACE_END || len > USER_SPACE_END - uva)
+		return -EFAULT;
+
+	if (vms)
+		read_lock(&vms->lock);
+	while ((ret = walk_range_in_pgtbl(pgtbl, ctx.next_va, uva + len - ctx.next_va, uaccess_run, &ctx)) ==
+	       UACCESS_COW) {
+		for (va = ROUND_DOWN(ctx.next_va, PAGE_SIZE); va < ctx.next_va + ctx.cow_len; va += PAGE_SIZE) {
+			if (handle_cow_fault(pgtbl, va, &rss) < 0) {
+				ret = -EFAULT;
+				goto out;
+			}
+		}
+	}
+	if (ret == 0 && ctx.next_va != uva + len)
+		ret = -EFAULT;
+out:
+	/* 写入之后再标记，和工作集采样并发时采样要么看到已经标记的脏页，要么在标记之前清除 */
+	if (to_user) {
+		for (va = ROUND_DOWN(uva, PAGE_SIZE); va < ctx.next_va; va += PAGE_SIZE)
+			mark_dirty_in_pgtbl(pgtbl, va);
+	}
+	if (vms) {
+		atomic_fetch_add_64(&vms->rss, rss);
+		read_unlock(&vms->lock);
+	}
+	return ret;
+}
+
+int copy_from_user(void *dst, const void *usrc, size_t len)
+{
+	return copy_user((vaddr_t)usrc, dst, len, false);
+}
+
+int copy_to_user(void *udst, const void *src, size_t len)
+{
+	return copy_user((vaddr_t)udst, (char *)src, len, true);
+}
+
+#define UACCESS_TEST_VA (0x10000000UL)
+
+void uaccess_test(void)
+{
+	void *saved_pgtbl = get_current_user_pgtbl();
+	void *pgtbl = get_pages(0);
+	char *pages = get_pages(2);
+	char *kbuf = kmalloc(4 * PAGE_SIZE);
+	char *kbuf2 = kmalloc(4 * PAGE_SIZE);
+	paddr_t pa = virt_to_phys(pages);
+	unsigned long free_mem;
+	struct pgtbl_ws_sample sample;
+	struct common_pte_t cpte;
+	paddr_t child_pa;
+	pte_t *pte;
+	void *child;
+	long rss = 0;
+
+	memset(pgtbl, 0, PAGE_SIZE);
+	/* 由页表管理，复制地址空间时写时复制，解除映射时释放 */
+	buddy_split_pages(virt_to_page(pages));
+	for (int i = 0; i < 4; i++)
+		virt_to_page(pages)[i].refcount = 1;
+	/* 第0页单独一段，第1、2页物理连续合并为一段，第3页只读，第4页未映射 */
+	map_range_in_pgtbl_user(pgtbl, UACCESS_TEST_VA, pa + 2 * PAGE_SIZE, PAGE_SIZE, VMR_READ | VMR_WRITE, &rss);
+	map_range_in_pgtbl_user(pgtbl, UACCESS_TEST_VA + PAGE_SIZE, pa, 2 * PAGE_SIZE, VMR_READ | VMR_WRITE, &rss);
+	map_range_in_pgtbl_user(pgtbl, UACCESS_TEST_VA + 3 * PAGE_SIZE, pa + 3 * PAGE_SIZE, PAGE_SIZE, VMR_READ, &rss);
+	set_page_table(virt_to_phys(pgtbl));
+	assert(get_current_user_pgtbl() == pgtbl);
+
+	for (int i = 0; i < 4 * PAGE_SIZE; i++)
+		kbuf[i] = (char)(i * 7 + 1);
+	memset(pages, 0, 4 * PAGE_SIZE);
+
+	/* 1. 跨越不连续物理页的拷贝 */
+	assert(copy_to_user((void *)(UACCESS_TEST_VA + 100), kbuf, 3 * PAGE_SIZE - 100) == 0);
+	assert(memcmp(pages + 2 * PAGE_SIZE + 100, kbuf, PAGE_SIZE - 100) == 0);
+	assert(memcmp(pages, kbuf + PAGE_SIZE - 100, 2 * PAGE_SIZE) == 0);
+	memset(kbuf2, 0, 4 * PAGE_SIZE);
+	assert(copy_from_user(kbuf2, (void *)(UACCESS_TEST_VA + 100), 4 * PAGE_SIZE - 100) == 0);
+	assert(memcmp(kbuf2, kbuf, 3 * PAGE_SIZE - 100) == 0);
+
+	/* 2. 只读页、未映射的空洞和超出用户地址空间的范围 */
+	assert(copy_to_user((void *)(UACCESS_TEST_VA + 3 * PAGE_SIZE), kbuf, 1) == -EFAULT);
+	assert(copy_from_user(kbuf2, (void *)(UACCESS_TEST_VA + 3 * PAGE_SIZE), PAGE_SIZE + 1) == -EFAULT);
+	assert(copy_from_user(kbuf2, (void *)(UACCESS_TEST_VA - 1), 2) == -EFAULT);
+	assert(copy_from_user(kbuf2, (void *)(USER_SPACE_END - 1), 2) == -EFAULT);
+	/* PROT_NONE 的页用户态不能访问，内核也不能代替用户访问 */
+	assert(protect_range_in_pgtbl(pgtbl, UACCESS_TEST_VA, PAGE_SIZE, 0, &rss) == 0);
+	assert(copy_to_user((void *)UACCESS_TEST_VA, kbuf, 1) == -EFAULT);
+	assert(copy_from_user(kbuf2, (void *)UACCESS_TEST_VA, 1) == -EFAULT);
+	assert(protect_range_in_pgtbl(pgtbl, UACCESS_TEST_VA, PAGE_SIZE, VMR_READ | VMR_WRITE, &rss) == 0);
+
+	/* 3. 写入采样后的干净页时标记为脏，读取不标记 */
+	memset(&sample, 0, sizeof(sample));
+	harvest_range_in_pgtbl(pgtbl, UACCESS_TEST_VA, PAGE_SIZE, &sample);
+	assert(query_in_pgtbl(pgtbl, UACCESS_TEST_VA, &child_pa, &pte) == 0);
+	assert(copy_from_user(kbuf2, (void *)UACCESS_TEST_VA, 1) == 0);
+	parse_pte_to_common(pte, L3, &cpte);
+	assert(!cpte.access && cpte.dirty == !pgtbl_hw_dirty());
+	/* 跨越两页写入原来的内容 */
+	assert(copy_to_user((void *)(UACCESS_TEST_VA + PAGE_SIZE - 1), kbuf + PAGE_SIZE - 101, 2) == 0);
+	parse_pte_to_common(pte, L3, &cpte);
+	assert(cpte.access && cpte.dirty);
+
+	/* 4. 写入写时复制的页时先复制该页，父地址空间的页保持不变，解除映射时释放复制的页 */
+	ptp_cache_drain();
+	free_mem = get_free_mem_size_from_buddy();
+	child = alloc_ptp();
+	assert(clone_range_in_pgtbl_cow(child, pgtbl, UACCESS_TEST_VA, 4 * PAGE_SIZE, NULL, NULL) == 0);
+	set_page_table(virt_to_phys(child));
+	memset(kbuf2, 0x5a, PAGE_SIZE);
+	assert(copy_to_user((void *)(UACCESS_TEST_VA + 100), kbuf2, PAGE_SIZE) == 0);
+	assert(memcmp(pages + 2 * PAGE_SIZE + 100, kbuf, PAGE_SIZE - 100) == 0);
+	assert(query_in_pgtbl(child, UACCESS_TEST_VA + PAGE_SIZE, &child_pa, NULL) == 0 && child_pa != pa);
+	assert(copy_from_user(kbuf2 + PAGE_SIZE, (void *)(UACCESS_TEST_VA + 100), PAGE_SIZE) == 0);
+	assert(memcmp(kbuf2, kbuf2 + PAGE_SIZE, PAGE_SIZE) == 0);
+	assert(copy_to_user((void *)(UACCESS_TEST_VA + 3 * PAGE_SIZE), kbuf, 1) == -EFAULT);
+	set_page_table(virt_to_phys(pgtbl));
+	assert(unmap_range_in_pgtbl(child, UACCESS_TEST_VA, 4 * PAGE_SIZE, NULL) == 0);
+	free_ptp(child);
+	ptp_cache_drain();
+	assert(get_free_mem_size_from_buddy() == free_mem);
+
+	set_page_table(virt_to_phys(saved_pgtbl));
+	unmap_range_in_pgtbl(pgtbl, UACCESS_TEST_VA, 4 * PAGE_SIZE, &rss);
+	assert(rss == 0);
+	free_pages(pgtbl);
+	kfree(kbuf);
+	kfree(kbuf2);
+	kinfo("uaccess test passed\n");
+}
@@ -0,0 +1,213 @@
+#include <arch/mmu.h>
+#include <common/macro.h>
+#include <common/kprint.h>
+#include <common/errno.h>
+#include <common/lock.h>
+#include <common/utils.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/ptp_cache.h>
+#include <mm/vmalloc.h>
+
+/* 每个区域之后保留一个不映射的页，越界访问会直接触发缺页异常，而不是踩到相邻的区域 */
+#define VMAP_GUARD_SIZE PAGE_SIZE
+
+static struct list_head vmap_area_list;
+static struct lock vmap_area_lock;
+
+void init_vmalloc(void)
+{
+	init_list_head(&vmap_area_list);
+	lock_init(&vmap_area_lock);
+}
+
+/*
+ * @area: 待插入的区域，area->size 已经设置好
+ * @return: 0 on success, -ENOMEM 如果 vmalloc 区域中没有足够大的空洞
+ *
+ * 按地址顺序首次适配，找到第一个足够大的空洞后插入到对应位置，保持链表有序
+ */
+static int alloc_vmap_area(struct vmap_area *area)
+{
+	struct vmap_area *tmp = NULL;
+	struct list_head *prev = &vmap_area_list;
+	vaddr_t addr = VMALLOC_START;
+	size_t size = area->size + VMAP_GUARD_SIZE;
+
+	lock(&vmap_area_lock);
+	for_each_in_list(tmp, struct vmap_area, node, &vmap_area_list) {
+		if (addr + size <= tmp->va_start)
+			break;
+		addr = tmp->va_start + tmp->size + VMAP_GUARD_SIZE;
+		prev = &tmp->node;
+	}
+	if (addr + size > VMALLOC_END) {
+		unlock(&vmap_area_lock);
+		return -ENOMEM;
+	}
+	area->va_start = addr;
+	list_add(&area->node, prev);
+	unlock(&vmap_area_lock);
+
+	return 0;
+}
+
+static struct vmap_area *find_vmap_area(vaddr_t addr)
+{
+	struct vmap_area *tmp = NULL;
+
+	lock(&vmap_area_lock);
+	for_each_in_list(tmp, struct vmap_area, node, &vmap_area_list) {
+		if (tmp->va_start == addr) {
+			unlock(&vmap_area_lock);
+			return tmp;
+		}
+	}
+	unlock(&vmap_area_lock);
+
+	return NULL;
+}
+
+static void remove_vmap_area(struct vmap_area *area)
+{
+	lock(&vmap_area_lock);
+	list_del(&area->node);
+	unlock(&vmap_area_lock);
+}
+
+static void free_area_pages(struct vmap_area *area, unsigned long nr_pages)
+{
+	for (unsigned long i = 0; i < nr_pages; i++)
+		buddy_free_pages(area->pages[i]);
+}
+
+/*
+ * @size: 分配的大小，向上对齐到页
+ * @return: 虚拟地址连续的内核内存，失败返回NULL
+ */
+void *vmalloc(size_t size)
+{
+	struct vmap_area *area;
+	void *pgtbl = get_kernel_pgtbl();
+	unsigned long i;
+
+	if (size == 0 || size > VMALLOC_END - VMALLOC_START)
+		return NULL;
+
+	area = kmalloc(sizeof(*area));
+	if (!area)
+		return NULL;
+	area->size = ROUND_UP(size, PAGE_SIZE);
+	area->nr_pages = area->size / PAGE_SIZE;
+	area->pages = kmalloc(area->nr_pages * sizeof(struct page *));
+	if (!area->pages)
+		goto free_area;
+
+	for (i = 0; i < area->nr_pages; i++) {
+		area->pages[i] = buddy_get_pages(0);
+		if (!area->pages[i]) {
+			kwarn("[OOM] vmalloc cannot get page from Buddy!\n");
+			goto free_pages;
+		}
+	}
+
+	if (alloc_vmap_area(area) != 0) {
+		kwarn("vmalloc area is exhausted, size %lu\n", size);
+		goto free_pages;
+	}
+
+	/* 新建映射不需要失效TLB。无法分配页表页时解除已经建立的部分映射，再把区域和页都释放 */
+	if (map_pages_in_pgtbl(pgtbl, area->va_start, area->pages, area->nr_pages, VMR_READ | VMR_WRITE, NULL) != 0) {
+		kwarn("[OOM] vmalloc cannot map area, size %lu\n", size);
+		/* 同 vfree，解除映射失败时只能泄漏区域和页 */
+		if (unmap_range_in_pgtbl(pgtbl, area->va_start, area->size, NULL) != 0)
+			return NULL;
+		remove_vmap_area(area);
+		goto free_pages;
+	}
+
+	return (void *)area->va_start;
+
+free_pages:
+	free_area_pages(area, i);
+	kfree(area->pages);
+free_area:
+	kfree(area);
+	return NULL;
+}
+
+/*
+ * @addr: vmalloc 返回的地址
+ *
+ * 先一次性解除整个区域的映射（unmap_range_in_pgtbl 在最后统一批量失效TLB），
+ * 确保没有CPU还能通过旧的TLB条目访问这些页之后，再把物理页还给伙伴系统
+ */
+void vfree(void *addr)
+{
+	struct vmap_area *area;
+
+	if (addr == NULL)
+		return;
+
+	area = find_vmap_area((vaddr_t)addr);
+	if (!area) {
+		kwarn("vfree: %p is not allocated by vmalloc\n", addr);
+		return;
+	}
+
+	/* 解除映射失败时部分页可能仍被映射，页和区域都不能再使用，保留在链表上避免地址被再次分配 */
+	if (unmap_range_in_pgtbl(get_kernel_pgtbl(), area->va_start, area->size, NULL) != 0) {
+		kwarn("vfree: cannot unmap %p, leak %lu pages\n", addr, area->nr_pages);
+		return;
+	}
+	remove_vmap_area(area);
+	free_area_pages(area, area->nr_pages);
+	kfree(area->pages);
+	kfree(area);
+}
+
+void vmalloc_test(void)
+{
+	unsigned long free_mem_after_first_round = 0;
+	/* 超过伙伴系统单次分配上限 (4MB) 的大小 */
+	size_t size = 3 * BUDDY_CHUNK_SIZE(BUDDY_MAX_ORDER - 1) + 3 * PAGE_SIZE;
+	void *small[8];
+
+	for (int round = 0; round < 2; round++) {
+		u64 *ptr = vmalloc(size);
+		assert(ptr != NULL);
+		assert((vaddr_t)ptr >= VMALLOC_START && (vaddr_t)ptr + size <= VMALLOC_END);
+		for (unsigned long i = 0; i < size / sizeof(u64); i += PAGE_SIZE / sizeof(u64) / 4)
+			ptr[i] = i;
+		for (unsigned long i = 0; i < size / sizeof(u64); i += PAGE_SIZE / sizeof(u64) / 4)
+			assert(ptr[i] == i);
+
+		/* 小区域交错释放，检查空洞能被复用 */
+		for (int i = 0; i < 8; i++) {
+			small[i] = vmalloc((i + 1) * PAGE_SIZE);
+			assert(small[i] != NULL);
+			memset(small[i], i, (i + 1) * PAGE_SIZE);
+		}
+		for (int i = 0; i < 8; i += 2)
+			vfree(small[i]);
+		for (int i = 0; i < 8; i += 2) {
+			small[i] = vmalloc((i + 1) * PAGE_SIZE);
+			assert(small[i] != NULL);
+		}
+		for (int i = 0; i < 8; i++)
+			vfree(small[i]);
+
+		vfree(ptr);
+
+		/*
+		 * 页表页在 vfree 时回收到页表页缓存，先还给伙伴系统。第一轮中 slab 可能新分配并保留 slab 页，
+		 * 第二轮之后空闲内存应保持不变
+		 */
+		ptp_cache_drain();
+		if (round == 0)
+			free_mem_after_first_round = get_free_mem_size_from_buddy();
+	}
+	assert(get_free_mem_size_from_buddy() == free_mem_after_first_round);
+	kinfo("vmalloc test passed\n");
+}
@@ -0,0 +1,823 @@
+#include <arch/mmu.h>
+#include <arch/machine/smp.h>
+#include <common/macro.h>
+#include <common/kprint.h>
+#include <common/errno.h>
+#include <common/lock.h>
+#include <common/utils.h>
+#include <arch/sync.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/ptp_cache.h>
+#include <mm/rmap.h>
+#include <mm/vmspace.h>
+
+/* fault-around 每次批量映射的最多页数 */
+#define FAULT_AROUND_BATCH (16)
+
+/* 各CPU上当前使用的地址空间 */
+static struct vmspace *current_vmspaces[PLAT_CPU_NUM];
+/* 每次缺页映射的页数，为2的幂 */
+static unsigned long fault_around_pages = FAULT_AROUND_PAGES_DEFAULT;
+/* 区域完整覆盖的2MB是否用透明大页映射 */
+static bool thp_enabled = true;
+/* 各CPU距离上次采样工作集的定时器中断次数 */
+static unsigned long ws_ticks[PLAT_CPU_NUM];
+
+static size_t subtree_gap(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct vmregion, rb)->subtree_gap : 0;
+}
+
+static void vmr_augment(struct rb_node *node)
+{
+	struct vmregion *vmr = rb_entry(node, struct vmregion, rb);
+
+	vmr->subtree_gap = MAX(vmr->gap, MAX(subtree_gap(node->left), subtree_gap(node->right)));
+}
+
+static struct vmregion *vmr_prev(struct vmspace *vms, struct vmregion *vmr)
+{
+	return vmr->node.prev == &vms->vmr_list ? NULL : container_of(vmr->node.prev, struct vmregion, node);
+}
+
+static struct vmregion *vmr_next(struct vmspace *vms, struct vmregion *vmr)
+{
+	return vmr->node.next == &vms->vmr_list ? NULL : container_of(vmr->node.next, struct vmregion, node);
+}
+
+/**
+ * @brief: 根据前一个区域重新计算 vmr->gap，之后需要向上更新红黑树的附加信息
+*/
+static void vmr_update_gap(struct vmspace *vms, struct vmregion *vmr)
+{
+	struct vmregion *prev = vmr_prev(vms, vmr);
+	vaddr_t low = prev ? MAX(prev->start + prev->size, VMS_MAP_BASE) : VMS_MAP_BASE;
+
+	vmr->gap = vmr->start > low ? vmr->start - low : 0;
+}
+
+/**
+ * @brief: 把区域[vmr->start, vmr->start + vmr->size)加入地址空间的链表和红黑树，调用者需持有写锁
+ * @return: 0 on success, -EEXIST 如果与已有区域重叠
+*/
+static int vmr_insert(struct vmspace *vms, struct vmregion *vmr)
+{
+	struct rb_node **link = &vms->vmr_tree.node, *parent = NULL;
+	struct list_head *prev = &vms->vmr_list;
+	struct vmregion *cur, *next;
+
+	while (*link) {
+		parent = *link;
+		cur = rb_entry(parent, struct vmregion, rb);
+		if (vmr->start + vmr->size <= cur->start) {
+			link = &parent->left;
+		} else if (vmr->start >= cur->start + cur->size) {
+			/* 向右走过的最后一个区域就是插入位置的前一个区域 */
+			prev = &cur->node;
+			link = &parent->right;
+		} else {
+			return -EEXIST;
+		}
+	}
+
+	list_add(&vmr->node, prev);
+	vmr_update_gap(vms, vmr);
+	rb_link_node(&vmr->rb, parent, link);
+	rb_insert_color(&vms->vmr_tree, &vmr->rb, vmr_augment);
+
+	/* 后一个区域之前的空闲范围缩小了 */
+	next = vmr_next(vms, vmr);
+	if (next) {
+		vmr_update_gap(vms, next);
+		rb_augment_propagate(&next->rb, vmr_augment);
+	}
+	return 0;
+}
+
+/**
+ * @brief: 把区域移出地址空间的链表和红黑树，调用者需持有写锁
+*/
+static void vmr_erase(struct vmspace *vms, struct vmregion *vmr)
+{
+	struct vmregion *next = vmr_next(vms, vmr);
+
+	list_del(&vmr->node);
+	rb_erase(&vms->vmr_tree, &vmr->rb, vmr_augment);
+	if (next) {
+		vmr_update_gap(vms, next);
+		rb_augment_propagate(&next->rb, vmr_augment);
+	}
+	if (vms->vmr_cache == vmr)
+		vms->vmr_cache = NULL;
+}
+
+static struct vmregion *alloc_vmregion(struct vmspace *vms, size_t len, vmr_prop_t perm)
+{
+	struct vmregion *vmr = kmalloc(sizeof(*vmr));
+
+	if (!vmr)
+		return NULL;
+	vmr->size = len;
+	vmr->perm = perm;
+	vmr->vms = vms;
+	if (anon_vma_prepare(vmr) < 0) {
+		kfree(vmr);
+		return NULL;
+	}
+	return vmr;
+}
+
+static void free_vmregion(struct vmregion *vmr)
+{
+	anon_vma_unlink(vmr);
+	kfree(vmr);
+}
+
+/**
+ * @brief: 创建一个空的地址空间
+ * @return: 地址空间，内存不足时返回NULL
+*/
+struct vmspace *create_vmspace(void)
+{
+	struct vmspace *vms = kmalloc(sizeof(*vms));
+
+	if (!vms)
+		return NULL;
+	vms->pgtbl = alloc_ptp();
+	if (!vms->pgtbl) {
+		kfree(vms);
+		return NULL;
+	}
+	init_list_head(&vms->vmr_list);
+	init_rb_root(&vms->vmr_tree);
+	vms->vmr_cache = NULL;
+	vms->rss = 0;
+	vms->nr_faults = 0;
+	memset(&vms->ws, 0, sizeof(vms->ws));
+	vms->ws_scanning = false;
+	vms->collapse_va = 0;
+	rwlock_init(&vms->lock);
+	return vms;
+}
+
+/**
+ * @brief: 解除所有区域的映射并释放地址空间，调用者需保证没有CPU正在使用它。
+ *         反向映射的遍历仍可能通过 anon_vma 找到这些区域，因此解除映射时持有写锁，区域移出 anon_vma 后才释放
+*/
+void destroy_vmspace(struct vmspace *vms)
+{
+	struct vmregion *vmr, *tmp;
+
+	for_each_in_list_safe(vmr, tmp, node, &vms->vmr_list) {
+		write_lock(&vms->lock);
+		unmap_range_in_pgtbl(vms->pgtbl, vmr->start, vmr->size, &vms->rss);
+		vmr_erase(vms, vmr);
+		write_unlock(&vms->lock);
+		free_vmregion(vmr);
+	}
+	/* 所有映射都属于某个区域，解除之后根页表页已经为空 */
+	free_ptp(vms->pgtbl);
+	kfree(vms);
+}
+
+/* 调用者需持有 vms->lock 的读锁或写锁 */
+static struct vmregion *__find_vmregion(struct vmspace *vms, vaddr_t va)
+{
+	struct vmregion *vmr = vms->vmr_cache;
+	struct rb_node *node;
+
+	if (vmr && va - vmr->start < vmr->size)
+		return vmr;
+
+	node = vms->vmr_tree.node;
+	while (node) {
+		vmr = rb_entry(node, struct vmregion, rb);
+		if (va < vmr->start) {
+			node = node->left;
+		} else if (va - vmr->start >= vmr->size) {
+			node = node->right;
+		} else {
+			/* 持有读锁时多个CPU可能同时写入，写入的都是仍在树中的区域 */
+			vms->vmr_cache = vmr;
+			return vmr;
+		}
+	}
+	return NULL;
+}
+
+struct vmregion *find_vmregion(struct vmspace *vms, vaddr_t va)
+{
+	struct vmregion *vmr;
+
+	read_lock(&vms->lock);
+	vmr = __find_vmregion(vms, va);
+	read_unlock(&vms->lock);
+	return vmr;
+}
+
+/**
+ * @brief: 查找结束地址在va之后的第一个区域，即包含va或者va之后的第一个区域，调用者需持有锁
+*/
+static struct vmregion *find_vmregion_from(struct vmspace *vms, vaddr_t va)
+{
+	struct rb_node *node = vms->vmr_tree.node;
+	struct vmregion *vmr, *found = NULL;
+
+	while (node) {
+		vmr = rb_entry(node, struct vmregion, rb);
+		if (va - vmr->start < vmr->size)
+			return vmr;
+		if (va < vmr->start) {
+			found = vmr;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief: 在 VMS_MAP_BASE 以上查找能放下长度为len、按align对齐的区域的最低的空闲地址，调用者需持有写锁。
+ *         沿 subtree_gap 足够大的子树向下查找，只访问O(log n)个区域
+ * @return: 0 on success, -ENOMEM 如果没有足够大的空闲范围
+*/
+static int find_vmregion_gap(struct vmspace *vms, size_t len, size_t align, vaddr_t *va)
+{
+	struct rb_node *node = vms->vmr_tree.node;
+	/* 这么大的空闲范围中一定能找到对齐的地址 */
+	size_t need = len + align - PAGE_SIZE;
+	struct vmregion *vmr, *prev, *last;
+	vaddr_t low;
+
+	if (subtree_gap(node) >= need) {
+		while (node) {
+			vmr = rb_entry(node, struct vmregion, rb);
+			if (subtree_gap(node->left) >= need) {
+				node = node->left;
+			} else if (vmr->gap >= need) {
+				prev = vmr_prev(vms, vmr);
+				low = prev ? MAX(prev->start + prev->size, VMS_MAP_BASE) : VMS_MAP_BASE;
+				*va = ROUND_UP(low, align);
+				return 0;
+			} else {
+				/* 子树的 subtree_gap 足够大，左子树和自身都不满足时一定在右子树中 */
+				node = node->right;
+			}
+		}
+		BUG("vmregion gap tree corrupted\n");
+	}
+
+	/* 最后一个区域之后的空闲范围 */
+	last = list_empty(&vms->vmr_list) ? NULL : container_of(vms->vmr_list.prev, struct vmregion, node);
+	low = ROUND_UP(last ? MAX(last->start + last->size, VMS_MAP_BASE) : VMS_MAP_BASE, align);
+	if (low >= USER_SPACE_END || len > USER_SPACE_END - low)
+		return -ENOMEM;
+	*va = low;
+	return 0;
+}
+
+/**
+ * @brief: 在地址空间中建立一段匿名内存区域，不分配物理页，第一次访问时由缺页处理分配
+ * @param vms: 地址空间
+ * @param va: 起始虚拟地址，需要按页对齐
+ * @param len: 长度
+ * @param perm: 访问权限
+ * @return: 0 on success, -EINVAL 如果范围不合法, -EEXIST 如果与已有区域重叠, -ENOMEM
+*/
+int vmspace_map_anonymous(struct vmspace *vms, vaddr_t va, size_t len, vmr_prop_t perm)
+{
+	struct vmregion *vmr;
+	int ret;
+
+	len = ROUND_UP(len, PAGE_SIZE);
+	if (va % PAGE_SIZE || len == 0 || va >= USER_SPACE_END || len > USER_SPACE_END - va)
+		return -EINVAL;
+
+	vmr = alloc_vmregion(vms, len, perm);
+	if (!vmr)
+		return -ENOMEM;
+	vmr->start = va;
+
+	write_lock(&vms->lock);
+	ret = vmr_insert(vms, vmr);
+	write_unlock(&vms->lock);
+
+	if (ret < 0)
+		free_vmregion(vmr);
+	return ret;
+}
+
+/**
+ * @brief: 由内核选择地址建立一段匿名内存区域：VMS_MAP_BASE 以上能放下它的最低的空闲地址。
+ *         不小于2MB的区域按2MB对齐，使其中完整的2MB可以用透明大页映射
+ * @param vms: 地址空间
+ * @param len: 长度
+ * @param perm: 访问权限
+ * @param va: 返回区域的起始虚拟地址
+ * @return: 0 on success, -EINVAL 如果len为0, -ENOMEM 如果内存不足或没有足够大的空闲地址范围
+*/
+int vmspace_map_anonymous_anywhere(struct vmspace *vms, size_t len, vmr_prop_t perm, vaddr_t *va)
+{
+	size_t align;
+	struct vmregion *vmr;
+	int ret;
+
+	len = ROUND_UP(len, PAGE_SIZE);
+	if (len == 0 || len > USER_SPACE_END - VMS_MAP_BASE)
+		return -EINVAL;
+	align = len >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : PAGE_SIZE;
+
+	vmr = alloc_vmregion(vms, len, perm);
+	if (!vmr)
+		return -ENOMEM;
+
+	write_lock(&vms->lock);
+	ret = find_vmregion_gap(vms, len, align, &vmr->start);
+	if (ret == 0) {
+		ret = vmr_insert(vms, vmr);
+		BUG_ON(ret != 0);
+	}
+	write_unlock(&vms->lock);
+
+	if (ret < 0) {
+		free_vmregion(vmr);
+		return ret;
+	}
+	*va = vmr->start;
+	return 0;
+}
+
+/**
+ * @brief: 删除[va, va + len)对应的区域，解除映射并释放缺页时分配的页
+ * @return: 0 on success, -EINVAL 如果没有恰好以va开始、长度为len的区域
+*/
+int vmspace_unmap(struct vmspace *vms, vaddr_t va, size_t len)
+{
+	struct vmregion *vmr;
+	int ret;
+
+	write_lock(&vms->lock);
+	vmr = __find_vmregion(vms, va);
+	if (!vmr || vmr->start != va || vmr->size != ROUND_UP(len, PAGE_SIZE)) {
+		write_unlock(&vms->lock);
+		return -EINVAL;
+	}
+	vmr_erase(vms, vmr);
+	ret = unmap_range_in_pgtbl(vms->pgtbl, vmr->start, vmr->size, &vms->rss);
+	write_unlock(&vms->lock);
+
+	free_vmregion(vmr);
+	return ret;
+}
+
+/**
+ * @brief: 把区域vmr在at处拆分为两个区域，new 成为后一半并加入链表和红黑树，调用者需持有写锁
+*/
+static void vmr_split(struct vmspace *vms, struct vmregion *vmr, struct vmregion *new, vaddr_t at)
+{
+	int ret;
+
+	new->perm = vmr->perm;
+	new->vms = vms;
+	/* 先缩小vmr再插入new，两个区域不会重叠；起始地址不变，vmr在树中的位置和 gap 都不变 */
+	anon_vma_split(vmr, new, at);
+	ret = vmr_insert(vms, new);
+	BUG_ON(ret != 0);
+}
+
+/**
+ * @brief: 修改[va, va + len)的访问权限：先修改区域的权限，之后缺页映射的页使用新的权限，
+ *         再修改已有映射的页表项。范围只覆盖区域的一部分时在边界处拆分区域
+ * @param vms: 地址空间
+ * @param va: 起始虚拟地址，需要按页对齐
+ * @param len: 长度
+ * @param perm: 新的权限，VMR_READ、VMR_WRITE 和 VMR_EXEC 的组合
+ * @return: 0 on success, -EINVAL 如果参数不合法, -ENOMEM 如果范围中有不属于任何区域的地址或者内存不足
+*/
+int vmspace_protect(struct vmspace *vms, vaddr_t va, size_t len, vmr_prop_t perm)
+{
+	/* 范围的两端各最多拆分出一个区域 */
+	struct vmregion *split[2] = { NULL, NULL };
+	struct vmregion *vmr, *first;
+	vaddr_t end, covered;
+	int nr_split = 0;
+	int ret = 0;
+
+	len = ROUND_UP(len, PAGE_SIZE);
+	if (va % PAGE_SIZE || len == 0 || va >= USER_SPACE_END || len > USER_SPACE_END - va)
+		return -EINVAL;
+	end = va + len;
+
+	for (int i = 0; i < ARRAY_SIZE(split); i++) {
+		split[i] = kmalloc(sizeof(*split[i]));
+		if (!split[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	write_lock(&vms->lock);
+	/* 范围必须完整地由相邻的区域覆盖 */
+	first = __find_vmregion(vms, va);
+	covered = va;
+	for (vmr = first; vmr && vmr->start <= covered && covered < end; vmr = vmr_next(vms, vmr))
+		covered = vmr->start + vmr->size;
+	if (covered < end) {
+		write_unlock(&vms->lock);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (first->start < va) {
+		vmr_split(vms, first, split[nr_split], va);
+		first = split[nr_split++];
+	}
+	for (vmr = first; vmr && vmr->start < end; vmr = vmr_next(vms, vmr)) {
+		if (vmr->start + vmr->size > end)
+			vmr_split(vms, vmr, split[nr_split++], end);
+		vmr->perm = (vmr->perm & ~(VMR_READ | VMR_WRITE | VMR_EXEC)) | perm;
+	}
+	ret = protect_range_in_pgtbl(vms->pgtbl, va, len, perm, &vms->rss);
+	write_unlock(&vms->lock);
+
+out:
+	for (int i = nr_split; i < ARRAY_SIZE(split); i++) {
+		if (split[i])
+			kfree(split[i]);
+	}
+	return ret;
+}
+
+/**
+ * @brief: 以写时复制的方式复制地址空间：复制所有区域，已经分配的页在父子之间共享，写入时才复制，
+ *         还没有访问过的页之后在父子中各自按需分配，子地址空间中分配的页属于子区域自己的 anon_vma
+ * @return: 新的地址空间，内存不足时返回NULL
+*/
+struct vmspace *clone_vmspace(struct vmspace *src)
+{
+	struct vmspace *dst = create_vmspace();
+	struct vmregion *vmr, *new_vmr;
+	int ret = 0;
+
+	if (!dst)
+		return NULL;
+
+	/* 复制时修改了父地址空间的页表项（去掉写权限），与缺页处理互斥 */
+	write_lock(&src->lock);
+	for_each_in_list(vmr, struct vmregion, node, &src->vmr_list) {
+		new_vmr = kmalloc(sizeof(*new_vmr));
+		if (!new_vmr) {
+			ret = -ENOMEM;
+			break;
+		}
+		*new_vmr = *vmr;
+		new_vmr->vms = dst;
+		/* 先把子区域挂到父区域的 anon_vma 下再复制映射，反向映射不会漏掉子地址空间中的映射 */
+		ret = anon_vma_fork(new_vmr, vmr);
+		if (ret < 0) {
+			kfree(new_vmr);
+			break;
+		}
+		/* 按地址顺序复制，不会与已复制的区域重叠 */
+		ret = vmr_insert(dst, new_vmr);
+		BUG_ON(ret != 0);
+		ret = clone_range_in_pgtbl_cow(dst->pgtbl, src->pgtbl, vmr->start, vmr->size, &dst->rss, &src->rss);
+		if (ret < 0)
+			break;
+	}
+	write_unlock(&src->lock);
+
+	if (ret < 0) {
+		destroy_vmspace(dst);
+		return NULL;
+	}
+	return dst;
+}
+
+/**
+ * @brief: 在当前CPU上切换到地址空间vms。vms为NULL时当前CPU不再使用任何地址空间，用户页表保持不变
+*/
+void switch_vmspace(struct vmspace *vms)
+{
+	current_vmspaces[smp_get_cpu_id()] = vms;
+	if (vms)
+		set_page_table(virt_to_phys(vms->pgtbl));
+}
+
+struct vmspace *get_current_vmspace(void)
+{
+	return current_vmspaces[smp_get_cpu_id()];
+}
+
+/**
+ * @brief: 设置每次缺页映射的页数，向下取整为2的幂，最多为一个L3页表页覆盖的页数。设为1时关闭 fault-around
+*/
+void set_fault_around_pages(unsigned long nr_pages)
+{
+	unsigned long nr = 1;
+
+	while (nr * 2 <= nr_pages && nr * 2 <= PTP_ENTRIES)
+		nr *= 2;
+	fault_around_pages = nr;
+}
+
+/**
+ * @brief: 开启或关闭透明大页，只影响之后的缺页和收拢，已经映射的大页保持不变
+*/
+void set_thp_enabled(bool enabled)
+{
+	thp_enabled = enabled;
+}
+
+/**
+ * @brief: 用一个透明大页映射区域中va开始的2MB：分配2MB的连续内存并清零，拆成单独计数的页，
+ *         每一页都是页表管理的匿名页，然后用L2块映射安装
+ * @return: 0 on success, -EEXIST 如果这2MB中已经有映射, -ENOMEM
+*/
+static int handle_huge_fault(struct vmspace *vms, struct vmregion *vmr, vaddr_t va)
+{
+	struct page *page;
+	long rss = 0;
+	void *huge;
+	int ret;
+
+	/* 2MB中已有映射时安装一定失败，不必先分配并清零2MB */
+	if (!huge_range_unmapped_in_pgtbl(vms->pgtbl, va))
+		return -EEXIST;
+	huge = get_pages(HUGE_PAGE_ORDER);
+	if (!huge)
+		return -ENOMEM;
+	memset(huge, 0, HUGE_PAGE_SIZE);
+
+	/* 块映射一旦可见，这些页就可能被解除映射、拆分或者复制，安装之前先设置好引用计数和反向映射 */
+	page = virt_to_page(huge);
+	buddy_split_pages(page);
+	for (int i = 0; i < PTP_ENTRIES; i++) {
+		page[i].refcount = 1;
+		page_add_anon_rmap(&page[i], vmr->anon_vma, va + i * PAGE_SIZE);
+	}
+	ret = map_huge_page_in_pgtbl(vms->pgtbl, va, virt_to_phys((vaddr_t)huge), vmr->perm, &rss);
+	atomic_fetch_add_64(&vms->rss, rss);
+	if (ret < 0) {
+		/* 没有安装，放弃每一页的引用和反向映射，逐页释放 */
+		for (int i = 0; i < PTP_ENTRIES; i++)
+			put_anon_page(&page[i]);
+		return ret;
+	}
+	return 0;
+}
+
+/**
+ * @brief: 映射 fault-around 收集的一批页。其他CPU已经映射了的位置，以及分配页表页失败时，释放没有安装的页
+*/
+static void fault_around_map(struct vmspace *vms, vaddr_t va, struct page **pages, int nr, vmr_prop_t perm)
+{
+	long rss = 0;
+
+	install_pages_in_pgtbl(vms->pgtbl, va, pages, nr, perm, &rss);
+	atomic_fetch_add_64(&vms->rss, rss);
+	for (int i = 0; i < nr; i++) {
+		if (pages[i])
+			put_anon_page(pages[i]);
+	}
+}
+
+/**
+ * @brief: 处理匿名内存区域中未映射地址上的缺页：分配清零的页并映射。
+ *         区域完整覆盖va所在的2MB并且其中还没有任何映射时，用一个透明大页映射整个2MB；
+ *         否则同时映射va所在的、按 fault_around_pages 对齐的窗口内区域中其余未映射的页，
+ *         顺序访问时只有每个窗口的第一次访问会触发缺页
+ * @param vms: 地址空间
+ * @param va: 出错的虚拟地址
+ * @param access: 出错的访问类型，VMR_READ、VMR_WRITE 或 VMR_EXEC
+ * @return: 0 on success, -EFAULT 如果va不属于任何区域或区域不允许该访问, -ENOMEM
+ *
+ * 只持有 vms->lock 的读锁，不同区域（不同L3页表页）上的缺页可以在多个CPU上并发处理
+*/
+int handle_anon_fault(struct vmspace *vms, vaddr_t va, vmr_prop_t access)
+{
+	size_t window = fault_around_pages * PAGE_SIZE;
+	struct page *pages[FAULT_AROUND_BATCH];
+	vaddr_t start, end, addr, batch_va = 0;
+	vaddr_t huge_va = ROUND_DOWN(va, HUGE_PAGE_SIZE);
+	struct vmregion *vmr;
+	paddr_t pa;
+	void *page;
+	int nr = 0;
+	int ret = 0;
+
+	read_lock(&vms->lock);
+	vmr = __find_vmregion(vms, va);
+	if (!vmr || (access & ~vmr->perm)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	/* 2MB中已有映射或者无法分配连续内存时，退回逐页映射 */
+	if (thp_enabled && huge_va >= vmr->start && huge_va + HUGE_PAGE_SIZE - vmr->start <= vmr->size &&
+	    handle_huge_fault(vms, vmr, huge_va) == 0) {
+		atomic_fetch_add_64(&vms->nr_faults, 1);
+		goto out;
+	}
+
+	start = MAX(ROUND_DOWN(va, window), vmr->start);
+	end = MIN(ROUND_DOWN(va, window) + window, vmr->start + vmr->size);
+	/* 连续的未映射页收集起来一次映射。这里不持锁的检查只是提示，安装时在页表页的锁内重新检查 */
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		/* 其他CPU可能已经处理了同一个缺页 */
+		if (query_in_pgtbl(vms->pgtbl, addr, &pa, NULL) == 0) {
+			if (nr > 0)
+				fault_around_map(vms, batch_va, pages, nr, vmr->perm);
+			nr = 0;
+			continue;
+		}
+		page = get_pages(0);
+		if (!page)
+			break;
+		memset(page, 0, PAGE_SIZE);
+		virt_to_page(page)->refcount = 1;
+		page_add_anon_rmap(virt_to_page(page), vmr->anon_vma, addr);
+		if (nr == 0)
+			batch_va = addr;
+		pages[nr++] = virt_to_page(page);
+		if (nr == FAULT_AROUND_BATCH) {
+			fault_around_map(vms, batch_va, pages, nr, vmr->perm);
+			nr = 0;
+		}
+	}
+	if (nr > 0)
+		fault_around_map(vms, batch_va, pages, nr, vmr->perm);
+	/* 相邻的页只是顺带映射，只有出错的页没有映射上时才返回错误 */
+	if (query_in_pgtbl(vms->pgtbl, va, &pa, NULL) != 0)
+		ret = -ENOMEM;
+	atomic_fetch_add_64(&vms->nr_faults, 1);
+
+out:
+	read_unlock(&vms->lock);
+	return ret;
+}
+
+/**
+ * @brief: 用一轮采样的结果更新工作集统计，调用者持有写锁
+*/
+static void ws_update(struct vmspace *vms, struct pgtbl_ws_sample *sample)
+{
+	struct ws_stats *ws = &vms->ws;
+
+	ws->resident_pages = sample->nr_pages;
+	ws->accessed_pages = sample->nr_accessed;
+	ws->dirty_pages = sample->nr_dirty;
+	ws->idle_pages = sample->nr_pages - sample->nr_accessed;
+	if (ws->nr_scans == 0)
+		ws->ws_pages = sample->nr_accessed;
+	else
+		ws->ws_pages = (ws->ws_pages * ((1 << WS_EWMA_SHIFT) - 1) + sample->nr_accessed) >> WS_EWMA_SHIFT;
+	ws->flags = pgtbl_hw_dirty() ? WS_DIRTY_TRACKED : 0;
+	ws->nr_scans++;
+}
+
+/**
+ * @brief: 采样地址空间中所有区域的访问标志和脏状态，更新工作集统计，并清除它们开始下一个采样周期。
+ *         定时器中断中正在分批进行的一轮采样作废，从头开始
+*/
+void vmspace_scan_ws(struct vmspace *vms)
+{
+	struct pgtbl_ws_sample sample = { 0 };
+	struct vmregion *vmr;
+
+	/* 采样会清除访问标志和脏状态，与缺页处理互斥 */
+	write_lock(&vms->lock);
+	for_each_in_list(vmr, struct vmregion, node, &vms->vmr_list)
+		harvest_range_in_pgtbl(vms->pgtbl, vmr->start, vmr->size, &sample);
+	ws_update(vms, &sample);
+	vms->ws_scanning = false;
+	write_unlock(&vms->lock);
+}
+
+/**
+ * @brief: 从 vms->ws_scan_va 开始采样最多 WS_SCAN_TICK_SIZE 的地址范围，累加到 vms->ws_sample，
+ *         采样完最后一个区域时更新工作集统计，结束这一轮。调用者持有写锁
+ *
+ * 两批之间区域可能被解除映射或拆分，每批都按地址重新查找区域
+*/
+static void vmspace_scan_ws_step(struct vmspace *vms)
+{
+	struct vmregion *vmr = find_vmregion_from(vms, vms->ws_scan_va);
+	size_t budget = WS_SCAN_TICK_SIZE;
+	vaddr_t start;
+	size_t len;
+
+	while (vmr && budget) {
+		start = MAX(vms->ws_scan_va, vmr->start);
+		len = MIN(vmr->start + vmr->size - start, budget);
+		harvest_range_in_pgtbl(vms->pgtbl, start, len, &vms->ws_sample);
+		vms->ws_scan_va = start + len;
+		budget -= len;
+		if (vms->ws_scan_va == vmr->start + vmr->size)
+			vmr = vmr_next(vms, vmr);
+	}
+	if (vmr)
+		return;
+	ws_update(vms, &vms->ws_sample);
+	vms->ws_scanning = false;
+}
+
+/**
+ * @brief: 从 *cursor 开始把逐页映射的2MB收拢为透明大页，见 collapse_huge_page_in_pgtbl。调用者持有写锁
+ * @param cursor: 开始检查的地址，返回下一个要检查的地址，检查完所有区域时为0
+ * @param max: 最多收拢的大页数
+ * @param max_checks: 最多检查的2MB个数
+ * @return: 收拢的大页数
+*/
+static int collapse_huge_pages_from(struct vmspace *vms, vaddr_t *cursor, int max, unsigned long max_checks)
+{
+	struct vmregion *vmr;
+	vaddr_t va;
+	int nr = 0;
+
+	for (vmr = find_vmregion_from(vms, *cursor); vmr; vmr = vmr_next(vms, vmr)) {
+		for (va = ROUND_UP(MAX(*cursor, vmr->start), HUGE_PAGE_SIZE);
+		     va + HUGE_PAGE_SIZE - vmr->start <= vmr->size; va += HUGE_PAGE_SIZE) {
+			if (nr == max || max_checks == 0) {
+				*cursor = va;
+				return nr;
+			}
+			max_checks--;
+			if (collapse_huge_page_in_pgtbl(vms->pgtbl, va, vmr->anon_vma, &vms->rss) == 0)
+				nr++;
+		}
+	}
+	*cursor = 0;
+	return nr;
+}
+
+/**
+ * @brief: 把地址空间中逐页映射的2MB收拢为透明大页，见 collapse_huge_page_in_pgtbl
+ * @param vms: 地址空间
+ * @param max: 最多收拢的大页数，每个大页需要复制2MB，限制一次收拢的耗时
+ * @return: 收拢的大页数
+*/
+int vmspace_collapse_huge_pages(struct vmspace *vms, int max)
+{
+	vaddr_t cursor = 0;
+	int nr;
+
+	if (!thp_enabled)
+		return 0;
+	write_lock(&vms->lock);
+	nr = collapse_huge_pages_from(vms, &cursor, max, ~0UL);
+	write_unlock(&vms->lock);
+	return nr;
+}
+
+/**
+ * @brief: 由定时器中断调用，每 WS_SCAN_INTERVAL_TICKS 次开始一轮本CPU当前地址空间的工作集采样。
+ *         中断处理的耗时需要有上限：一轮采样分多次中断完成，每次最多采样 WS_SCAN_TICK_SIZE，
+ *         每轮结束后按需收拢的大页也有个数和检查次数的上限。
+ *         只有EL0会被中断，此时本CPU不持有 vms->lock；其他CPU持有锁时跳过这次中断，不在中断中等待
+*/
+void vmspace_ws_tick(void)
+{
+	u32 cpu = smp_get_cpu_id();
+	struct vmspace *vms = current_vmspaces[cpu];
+	bool start = ++ws_ticks[cpu] >= WS_SCAN_INTERVAL_TICKS;
+
+	if (!vms) {
+		if (start)
+			ws_ticks[cpu] = 0;
+		return;
+	}
+	/* 不持锁的检查只是提示，多个CPU运行同一个地址空间时由持锁的CPU开始和推进一轮采样 */
+	if (!start && !*(volatile bool *)&vms->ws_scanning)
+		return;
+	if (!write_trylock(&vms->lock))
+		return;
+	if (start) {
+		ws_ticks[cpu] = 0;
+		if (!vms->ws_scanning) {
+			vms->ws_scanning = true;
+			vms->ws_scan_va = 0;
+			memset(&vms->ws_sample, 0, sizeof(vms->ws_sample));
+		}
+	}
+	if (vms->ws_scanning) {
+		vmspace_scan_ws_step(vms);
+		/* 后台收拢大页，每次只收拢少量 */
+		if (!vms->ws_scanning && thp_enabled && vms->ws.nr_scans % THP_COLLAPSE_INTERVAL_SCANS == 0)
+			collapse_huge_pages_from(vms, &vms->collapse_va, THP_COLLAPSE_PAGES, THP_COLLAPSE_CHECKS);
+	}
+	write_unlock(&vms->lock);
+}
+
+/**
+ * @brief: 读取地址空间最近一次采样得到的工作集统计
+*/
+void vmspace_get_ws_stats(struct vmspace *vms, struct ws_stats *stats)
+{
+	read_lock(&vms->lock);
+	*stats = vms->ws;
+	read_unlock(&vms->lock);
+}
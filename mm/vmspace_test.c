@@ -0,0 +1,339 @@
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <common/utils.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/page_table.h>
+#include <mm/common_pte.h>
+#include <mm/ptp_cache.h>
+#include <mm/vmspace.h>
+#include <mm/rmap.h>
+#include <mm/migrate.h>
+#include <arch/sync.h>
+
+#define VMS_TEST_VA (0x10000000UL)
+#define VMS_TEST_PAGES (64)
+/* 按2MB对齐，用于透明大页 */
+#define VMS_THP_VA (0x20000000UL)
+#define VMS_PROT_VA (0x30000000UL)
+#define VMS_WS_VA (0x50000000UL)
+/* 逐级复制的深度和重复的次数 */
+#define VMS_CLONE_VA (0x40000000UL)
+#define VMS_CLONE_DEPTH (4)
+#define VMS_CLONE_ROUNDS (8)
+#define VMS_CLONE_SIZE ((VMS_CLONE_DEPTH + 1) * PAGE_SIZE)
+/* 不指定地址建立的区域数，每个区域 VMS_MANY_SIZE 大小 */
+#define VMS_MANY_REGIONS (256)
+#define VMS_MANY_SIZE (2 * PAGE_SIZE)
+#define VMS_MANY_VA(i) (VMS_MAP_BASE + (i) * VMS_MANY_SIZE)
+
+void vmspace_test(void)
+{
+	unsigned long free_mem_after_first_round = 0;
+	struct vmspace *vms, *child, *saved_vms;
+	void *saved_pgtbl;
+	struct vmspace *chain[VMS_CLONE_DEPTH];
+	struct anon_vma *anon_vma;
+	struct vmregion *vmr;
+	struct page *page;
+	struct page *old_pages[4], *new_pages[4];
+	struct common_pte_t cpte;
+	pte_t *pte;
+	int nr;
+	long rss;
+	paddr_t pa, pa2;
+	vaddr_t va;
+
+	for (int round = 0; round < 2; round++) {
+		/* 1. 建立区域时不分配物理页，重叠的区域被拒绝 */
+		vms = create_vmspace();
+		assert(vms != NULL);
+		assert(vmspace_map_anonymous(vms, VMS_TEST_VA, VMS_TEST_PAGES * PAGE_SIZE, VMR_READ | VMR_WRITE) == 0);
+		assert(vms->rss == 0);
+		assert(vmspace_map_anonymous(vms, VMS_TEST_VA + PAGE_SIZE, PAGE_SIZE, VMR_READ) == -EEXIST);
+		assert(vmspace_map_anonymous(vms, VMS_TEST_VA + 3, PAGE_SIZE, VMR_READ) == -EINVAL);
+		assert(find_vmregion(vms, VMS_TEST_VA + VMS_TEST_PAGES * PAGE_SIZE - 1) != NULL);
+		assert(find_vmregion(vms, VMS_TEST_VA + VMS_TEST_PAGES * PAGE_SIZE) == NULL);
+
+		/* 2. 顺序访问时每 FAULT_AROUND_PAGES_DEFAULT 页只缺页一次，新页内容为0 */
+		for (int i = 0; i < VMS_TEST_PAGES; i++) {
+			va = VMS_TEST_VA + i * PAGE_SIZE;
+			if (query_in_pgtbl(vms->pgtbl, va, &pa, NULL) != 0)
+				assert(handle_anon_fault(vms, va + 8, VMR_WRITE) == 0);
+			assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0);
+			for (int j = 0; j < PAGE_SIZE / sizeof(u64); j++)
+				assert(((u64 *)phys_to_virt(pa))[j] == 0);
+		}
+		assert(vms->nr_faults == VMS_TEST_PAGES / FAULT_AROUND_PAGES_DEFAULT);
+		/* 64页以及 L1、L2、L3 三个页表页 */
+		assert(vms->rss == (VMS_TEST_PAGES + 3) * PAGE_SIZE);
+
+		/* 3. 工作集采样：刚分配的页都被访问过，之后没有访问的页计为空闲，估计值逐渐衰减 */
+		vmspace_scan_ws(vms);
+		assert(vms->ws.nr_scans == 1 && vms->ws.resident_pages == VMS_TEST_PAGES);
+		assert(vms->ws.accessed_pages == VMS_TEST_PAGES && vms->ws.idle_pages == 0);
+		assert(vms->ws.ws_pages == VMS_TEST_PAGES);
+		assert(vms->ws.dirty_pages == (pgtbl_hw_dirty() ? VMS_TEST_PAGES : 0));
+		/* 缺页分配的页恰好物理连续时按连续映射组整组设置访问标志 */
+		assert(handle_access_fault(vms->pgtbl, VMS_TEST_VA) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA, &pa, &pte) == 0);
+		nr = IS_PTE_CONT(pte->pte) ? CONT_PTES : 1;
+		vmspace_scan_ws(vms);
+		assert(vms->ws.accessed_pages == nr && vms->ws.idle_pages == VMS_TEST_PAGES - nr);
+		assert(vms->ws.dirty_pages == 0);
+		assert(vms->ws.ws_pages == (VMS_TEST_PAGES * 3 + nr) / 4);
+		/* 定时器中断分批采样，每次最多采样 WS_SCAN_TICK_SIZE，一轮结束后才更新统计 */
+		assert(vmspace_map_anonymous(vms, VMS_WS_VA, 2 * WS_SCAN_TICK_SIZE, VMR_READ) == 0);
+		saved_vms = get_current_vmspace();
+		saved_pgtbl = get_current_user_pgtbl();
+		switch_vmspace(vms);
+		for (int i = 0; i < WS_SCAN_INTERVAL_TICKS && !vms->ws_scanning; i++)
+			vmspace_ws_tick();
+		assert(vms->ws_scanning && vms->ws.nr_scans == 2);
+		vmspace_ws_tick();
+		assert(vms->ws_scanning && vms->ws.nr_scans == 2);
+		vmspace_ws_tick();
+		assert(!vms->ws_scanning && vms->ws.nr_scans == 3 && vms->ws.resident_pages == VMS_TEST_PAGES);
+		switch_vmspace(saved_vms);
+		set_page_table(virt_to_phys(saved_pgtbl));
+		assert(vmspace_unmap(vms, VMS_WS_VA, 2 * WS_SCAN_TICK_SIZE) == 0);
+
+		/* 4. 区域之外或权限不允许的访问返回错误；fault-around 不会越过区域的边界 */
+		assert(handle_anon_fault(vms, VMS_TEST_VA + VMS_TEST_PAGES * PAGE_SIZE, VMR_READ) == -EFAULT);
+		assert(handle_anon_fault(vms, VMS_TEST_VA, VMR_EXEC) == -EFAULT);
+		va = VMS_TEST_VA + VMS_TEST_PAGES * PAGE_SIZE + 2 * PAGE_SIZE;
+		assert(vmspace_map_anonymous(vms, va, 3 * PAGE_SIZE, VMR_READ) == 0);
+		assert(handle_anon_fault(vms, va + PAGE_SIZE, VMR_READ) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va + 2 * PAGE_SIZE, &pa, NULL) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va - PAGE_SIZE, &pa, NULL) != 0);
+		assert(query_in_pgtbl(vms->pgtbl, va + 3 * PAGE_SIZE, &pa, NULL) != 0);
+		assert(vmspace_unmap(vms, va, PAGE_SIZE) == -EINVAL);
+		assert(vmspace_unmap(vms, va, 3 * PAGE_SIZE) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) != 0);
+
+		/* 5. 关闭 fault-around 后每次缺页只映射一页 */
+		set_fault_around_pages(1);
+		va = VMS_TEST_VA + 2 * VMS_TEST_PAGES * PAGE_SIZE;
+		assert(vmspace_map_anonymous(vms, va, 4 * PAGE_SIZE, VMR_READ | VMR_WRITE) == 0);
+		assert(handle_anon_fault(vms, va, VMR_READ) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va + PAGE_SIZE, &pa, NULL) != 0);
+		set_fault_around_pages(FAULT_AROUND_PAGES_DEFAULT);
+
+		/* 6. 复制地址空间：已分配的页写时复制，写入后父子各有一份 */
+		child = clone_vmspace(vms);
+		assert(child != NULL);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA, &pa, NULL) == 0);
+		assert(query_in_pgtbl(child->pgtbl, VMS_TEST_VA, &pa2, NULL) == 0);
+		assert(pa == pa2);
+		assert(handle_cow_fault(child->pgtbl, VMS_TEST_VA, &child->rss) == 0);
+		assert(query_in_pgtbl(child->pgtbl, VMS_TEST_VA, &pa2, NULL) == 0);
+		assert(pa != pa2);
+		/* 复制时没有分配的页在子地址空间中按需分配 */
+		assert(query_in_pgtbl(child->pgtbl, va + PAGE_SIZE, &pa2, NULL) != 0);
+		assert(handle_anon_fault(child, va + PAGE_SIZE, VMR_WRITE) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va + PAGE_SIZE, &pa, NULL) != 0);
+
+		/* 7. 反向映射：共享的页在父子中各有一个映射，写时复制之后各自只有一个；解除所有映射后再访问得到新的页 */
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA, &pa, NULL) == 0);
+		assert(page_mapcount(virt_to_page((void *)phys_to_virt(pa))) == 1);
+		assert(query_in_pgtbl(child->pgtbl, VMS_TEST_VA, &pa, NULL) == 0);
+		assert(page_mapcount(virt_to_page((void *)phys_to_virt(pa))) == 1);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA + PAGE_SIZE, &pa, NULL) == 0);
+		page = virt_to_page((void *)phys_to_virt(pa));
+		assert(page_mapcount(page) == 2);
+		atomic_fetch_add_32(&page->refcount, 1);
+		assert(try_to_unmap(page) == 0);
+		assert(page_mapcount(page) == 0 && page->refcount == 1);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA + PAGE_SIZE, &pa, NULL) != 0);
+		assert(query_in_pgtbl(child->pgtbl, VMS_TEST_VA + PAGE_SIZE, &pa, NULL) != 0);
+		put_anon_page(page);
+		assert(handle_anon_fault(vms, VMS_TEST_VA + PAGE_SIZE, VMR_READ) == 0);
+		/* 地址空间正被修改时不等待 */
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA, &pa, NULL) == 0);
+		write_lock(&vms->lock);
+		assert(page_mapcount(virt_to_page((void *)phys_to_virt(pa))) == -EAGAIN);
+		write_unlock(&vms->lock);
+
+		/* 8. 页迁移：共享页在父子中的映射都指向新的页，内容不变，仍然写时复制 */
+		va = VMS_TEST_VA + 2 * PAGE_SIZE;
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0);
+		page = virt_to_page((void *)phys_to_virt(pa));
+		*(u64 *)phys_to_virt(pa) = 0x6d696772617465UL;
+		atomic_fetch_add_32(&page->refcount, 1);
+		new_pages[0] = virt_to_page(get_pages(0));
+		assert(migrate_page(page, new_pages[0]) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0);
+		assert(pa == virt_to_phys(page_to_virt(new_pages[0])));
+		assert(query_in_pgtbl(child->pgtbl, va, &pa2, NULL) == 0 && pa2 == pa);
+		assert(*(u64 *)phys_to_virt(pa) == 0x6d696772617465UL);
+		assert(new_pages[0]->refcount == 2 && page_mapcount(new_pages[0]) == 2);
+		assert(handle_cow_fault(child->pgtbl, va, &child->rss) == 0);
+		assert(query_in_pgtbl(child->pgtbl, va, &pa2, NULL) == 0 && pa2 != pa);
+		assert(*(u64 *)phys_to_virt(pa2) == 0x6d696772617465UL);
+		/* 一批迁移多个页 */
+		for (int i = 0; i < 4; i++) {
+			assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA + (4 + i) * PAGE_SIZE, &pa, NULL) == 0);
+			old_pages[i] = virt_to_page((void *)phys_to_virt(pa));
+			atomic_fetch_add_32(&old_pages[i]->refcount, 1);
+			new_pages[i] = virt_to_page(get_pages(0));
+		}
+		assert(migrate_pages(old_pages, new_pages, 4) == 4);
+		for (int i = 0; i < 4; i++) {
+			va = VMS_TEST_VA + (4 + i) * PAGE_SIZE;
+			assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) == 0);
+			assert(query_in_pgtbl(child->pgtbl, va, &pa2, NULL) == 0);
+			assert(pa == virt_to_phys(page_to_virt(new_pages[i])) && pa2 == pa);
+		}
+		/* 地址空间正被修改时整个放弃，页表不变 */
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA + 8 * PAGE_SIZE, &pa, NULL) == 0);
+		page = virt_to_page((void *)phys_to_virt(pa));
+		atomic_fetch_add_32(&page->refcount, 1);
+		new_pages[0] = virt_to_page(get_pages(0));
+		write_lock(&child->lock);
+		assert(migrate_page(page, new_pages[0]) == -EAGAIN);
+		write_unlock(&child->lock);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_TEST_VA + 8 * PAGE_SIZE, &pa2, NULL) == 0 && pa2 == pa);
+		put_anon_page(page);
+		free_pages(page_to_virt(new_pages[0]));
+
+		/* 9. 透明大页：区域完整覆盖的2MB第一次访问时用一个块映射，解除其中一页时拆分 */
+		assert(vmspace_map_anonymous(vms, VMS_THP_VA, 2 * HUGE_PAGE_SIZE, VMR_READ | VMR_WRITE) == 0);
+		rss = vms->rss;
+		assert(huge_range_unmapped_in_pgtbl(vms->pgtbl, VMS_THP_VA));
+		assert(handle_anon_fault(vms, VMS_THP_VA + 5 * PAGE_SIZE, VMR_WRITE) == 0);
+		assert(vms->rss >= rss + (long)HUGE_PAGE_SIZE);
+		assert(!huge_range_unmapped_in_pgtbl(vms->pgtbl, VMS_THP_VA));
+		va = VMS_THP_VA + HUGE_PAGE_SIZE - PAGE_SIZE;
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, &pte) == 0 && !IS_PTE_TABLE(pte->pte));
+		page = virt_to_page((void *)phys_to_virt(pa));
+		assert(page->refcount == 1 && page_mapcount(page) == 1);
+		atomic_fetch_add_32(&page->refcount, 1);
+		assert(try_to_unmap(page) == 0);
+		put_anon_page(page);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, NULL) != 0);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_THP_VA, &pa, &pte) == 0 && IS_PTE_TABLE(pte->pte));
+		assert(!huge_range_unmapped_in_pgtbl(vms->pgtbl, VMS_THP_VA));
+		/* 关闭大页时逐页映射，之后由收拢把两个2MB都合并为大页，空的位置填0 */
+		set_thp_enabled(false);
+		for (int i = 0; i < PTP_ENTRIES; i += FAULT_AROUND_PAGES_DEFAULT)
+			assert(handle_anon_fault(vms, VMS_THP_VA + HUGE_PAGE_SIZE + i * PAGE_SIZE, VMR_WRITE) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_THP_VA + HUGE_PAGE_SIZE, &pa, &pte) == 0);
+		assert(IS_PTE_TABLE(pte->pte));
+		*(u64 *)phys_to_virt(pa) = 0x6875676570616765UL;
+		set_thp_enabled(true);
+		rss = vms->rss;
+		assert(vmspace_collapse_huge_pages(vms, 4) == 2);
+		assert(vms->rss == rss - PAGE_SIZE);
+		assert(query_in_pgtbl(vms->pgtbl, VMS_THP_VA + HUGE_PAGE_SIZE, &pa, &pte) == 0);
+		assert(!IS_PTE_TABLE(pte->pte));
+		assert(*(u64 *)phys_to_virt(pa) == 0x6875676570616765UL);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, &pte) == 0 && !IS_PTE_TABLE(pte->pte));
+		assert(*(u64 *)phys_to_virt(pa) == 0);
+		assert(vmspace_collapse_huge_pages(vms, 4) == 0);
+
+		/* 10. 不指定地址时从 VMS_MAP_BASE 开始紧密排列，删除的区域留下的空闲范围按地址从低到高重新使用 */
+		for (int i = 0; i < VMS_MANY_REGIONS; i++) {
+			assert(vmspace_map_anonymous_anywhere(vms, VMS_MANY_SIZE, VMR_READ | VMR_WRITE, &va) == 0);
+			assert(va == VMS_MANY_VA(i));
+		}
+		for (int i = 0; i < VMS_MANY_REGIONS; i++)
+			assert(find_vmregion(vms, VMS_MANY_VA(i) + PAGE_SIZE)->start == VMS_MANY_VA(i));
+		for (int i = 1; i < VMS_MANY_REGIONS; i += 2)
+			assert(vmspace_unmap(vms, VMS_MANY_VA(i), VMS_MANY_SIZE) == 0);
+		assert(find_vmregion(vms, VMS_MANY_VA(1)) == NULL);
+		assert(handle_anon_fault(vms, VMS_MANY_VA(3), VMR_READ) == -EFAULT);
+		assert(handle_anon_fault(vms, VMS_MANY_VA(4), VMR_WRITE) == 0);
+		assert(vmspace_map_anonymous_anywhere(vms, VMS_MANY_SIZE, VMR_READ, &va) == 0);
+		assert(va == VMS_MANY_VA(1));
+		/* 指定地址建立的区域同样占用空闲范围 */
+		assert(vmspace_map_anonymous(vms, VMS_MANY_VA(3), VMS_MANY_SIZE, VMR_READ) == 0);
+		assert(vmspace_map_anonymous_anywhere(vms, VMS_MANY_SIZE, VMR_READ, &va) == 0);
+		assert(va == VMS_MANY_VA(5));
+		/* 放不进区域之间的空闲范围时放在最后一个区域之后（最后一个区域已经删除），不小于2MB的区域按2MB对齐 */
+		assert(vmspace_map_anonymous_anywhere(vms, 2 * VMS_MANY_SIZE, VMR_READ, &va) == 0);
+		assert(va == VMS_MANY_VA(VMS_MANY_REGIONS - 1));
+		assert(vmspace_map_anonymous_anywhere(vms, HUGE_PAGE_SIZE, VMR_READ, &va) == 0);
+		assert(va == ROUND_UP(VMS_MANY_VA(VMS_MANY_REGIONS + 1), HUGE_PAGE_SIZE));
+		assert(vmspace_map_anonymous_anywhere(vms, USER_SPACE_END, VMR_READ, &va) == -EINVAL);
+
+		/* 11. 修改权限：范围内的区域在边界处拆分，之后缺页映射的页也使用新的权限 */
+		assert(vmspace_map_anonymous(vms, VMS_PROT_VA, 8 * PAGE_SIZE, VMR_READ | VMR_WRITE) == 0);
+		assert(handle_anon_fault(vms, VMS_PROT_VA, VMR_WRITE) == 0);
+		assert(vmspace_protect(vms, VMS_PROT_VA + 2 * PAGE_SIZE, 4 * PAGE_SIZE, VMR_READ) == 0);
+		assert(find_vmregion(vms, VMS_PROT_VA)->start == VMS_PROT_VA);
+		assert(find_vmregion(vms, VMS_PROT_VA)->perm == (VMR_READ | VMR_WRITE));
+		assert(find_vmregion(vms, VMS_PROT_VA + 5 * PAGE_SIZE)->start == VMS_PROT_VA + 2 * PAGE_SIZE);
+		assert(find_vmregion(vms, VMS_PROT_VA + 5 * PAGE_SIZE)->perm == VMR_READ);
+		assert(find_vmregion(vms, VMS_PROT_VA + 6 * PAGE_SIZE)->start == VMS_PROT_VA + 6 * PAGE_SIZE);
+		assert(find_vmregion(vms, VMS_PROT_VA + 6 * PAGE_SIZE)->perm == (VMR_READ | VMR_WRITE));
+		va = VMS_PROT_VA + 3 * PAGE_SIZE;
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, &pte) == 0);
+		parse_pte_to_common(pte, L3, &cpte);
+		assert(cpte.perm == VMR_READ);
+		assert(unmap_range_in_pgtbl(vms->pgtbl, va, PAGE_SIZE, &vms->rss) == 0);
+		assert(handle_anon_fault(vms, va, VMR_WRITE) == -EFAULT);
+		assert(handle_anon_fault(vms, va, VMR_READ) == 0);
+		assert(query_in_pgtbl(vms->pgtbl, va, &pa, &pte) == 0);
+		parse_pte_to_common(pte, L3, &cpte);
+		assert(cpte.perm == VMR_READ);
+		/* 恢复写权限后相邻的区域不合并，但写缺页可以成功 */
+		assert(vmspace_protect(vms, VMS_PROT_VA, 8 * PAGE_SIZE, VMR_READ | VMR_WRITE) == 0);
+		assert(find_vmregion(vms, va)->perm == (VMR_READ | VMR_WRITE));
+		assert(unmap_range_in_pgtbl(vms->pgtbl, va, PAGE_SIZE, &vms->rss) == 0);
+		assert(handle_anon_fault(vms, va, VMR_WRITE) == 0);
+		/* 范围中有不属于任何区域的地址时不做任何修改 */
+		assert(vmspace_protect(vms, VMS_PROT_VA + 6 * PAGE_SIZE, 4 * PAGE_SIZE, VMR_READ) == -ENOMEM);
+		assert(find_vmregion(vms, VMS_PROT_VA + 6 * PAGE_SIZE)->perm == (VMR_READ | VMR_WRITE));
+		assert(vmspace_unmap(vms, VMS_PROT_VA, 8 * PAGE_SIZE) == -EINVAL);
+		assert(vmspace_unmap(vms, VMS_PROT_VA, 2 * PAGE_SIZE) == 0);
+		assert(vmspace_unmap(vms, VMS_PROT_VA + 2 * PAGE_SIZE, 4 * PAGE_SIZE) == 0);
+		assert(vmspace_unmap(vms, VMS_PROT_VA + 6 * PAGE_SIZE, 2 * PAGE_SIZE) == 0);
+		assert(find_vmregion(vms, VMS_PROT_VA + 7 * PAGE_SIZE) == NULL);
+
+		/* 12. 反复复制：子区域有自己的 anon_vma，子地址空间中新分配的页属于它；销毁后不在父 anon_vma 上留下节点 */
+		set_fault_around_pages(1);
+		assert(vmspace_map_anonymous(vms, VMS_CLONE_VA, VMS_CLONE_SIZE, VMR_READ | VMR_WRITE) == 0);
+		assert(handle_anon_fault(vms, VMS_CLONE_VA, VMR_WRITE) == 0);
+		anon_vma = find_vmregion(vms, VMS_CLONE_VA)->anon_vma;
+		assert(query_in_pgtbl(vms->pgtbl, VMS_CLONE_VA, &pa, NULL) == 0);
+		page = virt_to_page((void *)phys_to_virt(pa));
+		for (int r = 0; r < VMS_CLONE_ROUNDS; r++) {
+			/* chain[i] 复制自上一级，并在第 i + 1 页分配一个新页，之后的各级共享这个页 */
+			for (int i = 0; i < VMS_CLONE_DEPTH; i++) {
+				chain[i] = clone_vmspace(i == 0 ? vms : chain[i - 1]);
+				assert(chain[i] != NULL);
+				assert(handle_anon_fault(chain[i], VMS_CLONE_VA + (i + 1) * PAGE_SIZE, VMR_WRITE) == 0);
+			}
+			assert(page_mapcount(page) == VMS_CLONE_DEPTH + 1);
+			for (int i = 0; i < VMS_CLONE_DEPTH; i++) {
+				vmr = find_vmregion(chain[i], VMS_CLONE_VA);
+				assert(vmr->anon_vma->parent ==
+				       (i == 0 ? anon_vma : find_vmregion(chain[i - 1], VMS_CLONE_VA)->anon_vma));
+				va = VMS_CLONE_VA + (i + 1) * PAGE_SIZE;
+				assert(query_in_pgtbl(chain[i]->pgtbl, va, &pa, NULL) == 0);
+				assert(virt_to_page((void *)phys_to_virt(pa))->anon_vma == vmr->anon_vma);
+				assert(page_mapcount(virt_to_page((void *)phys_to_virt(pa))) == VMS_CLONE_DEPTH - i);
+			}
+			/* 先销毁上级，它的 anon_vma 保留到后代都销毁之后 */
+			for (int i = 0; i < VMS_CLONE_DEPTH; i++)
+				destroy_vmspace(chain[i]);
+			/* 只剩父区域和它的一个页的引用 */
+			assert(list_empty(&anon_vma->children) && anon_vma->refcount == 2);
+			assert(page_mapcount(page) == 1);
+		}
+		assert(vmspace_unmap(vms, VMS_CLONE_VA, VMS_CLONE_SIZE) == 0);
+		set_fault_around_pages(FAULT_AROUND_PAGES_DEFAULT);
+
+		/* 13. 销毁地址空间后所有页和页表页都被释放 */
+		destroy_vmspace(child);
+		destroy_vmspace(vms);
+		ptp_cache_drain();
+		if (round == 0)
+			free_mem_after_first_round = get_free_mem_size_from_buddy();
+	}
+	assert(get_free_mem_size_from_buddy() == free_mem_after_first_round);
+	kinfo("vmspace test passed\n");
+}
@@ -2,7 +2,11 @@
 #include <io/uart.h>
 #include <mm/kmalloc.h>
 #include <mm/mm.h>
+#include <mm/page_table.h>
+#include <mm/uaccess.h>
+#include <mm/vmspace.h>
 #include <common/kprint.h>
+#include <common/macro.h>
 #include <common/lock.h>
 #include <common/errno.h>
 #include <common/poweroff.h>
@@ -20,7 +24,99 @@ void sys_poweroff(void)
 	plat_poweroff();
 }
 
+static int get_phys_addr_run(struct pgtbl_run *run, void *arg)
+{
+	*(paddr_t *)arg = run->pa;
+	return 1;
+}
+
+/**
+ * @brief: 查询当前地址空间中虚拟地址va对应的物理地址
+ * @param va: 用户虚拟地址
+ * @param pa_buf: 用户缓冲区，用于返回物理地址
+ * @return: 0 on success, -EINVAL 如果va没有映射, -EFAULT 如果pa_buf不可写
+*/
+int sys_get_phys_addr(vaddr_t va, paddr_t *pa_buf)
+{
+	struct vmspace *vms = get_current_vmspace();
+	paddr_t pa;
+	int ret;
+
+	if (va >= USER_SPACE_END)
+		return -EINVAL;
+	/* 防止遍历时页表页被同一地址空间中的其他线程回收 */
+	if (vms != NULL)
+		read_lock(&vms->lock);
+	ret = walk_range_in_pgtbl(get_current_user_pgtbl(), va, 1, get_phys_addr_run, &pa);
+	if (vms != NULL)
+		read_unlock(&vms->lock);
+	if (ret != 1)
+		return -EINVAL;
+	return copy_to_user(pa_buf, &pa, sizeof(pa));
+}
+
+/**
+ * @brief: 修改当前地址空间中[addr, addr + length)范围的访问权限，包括区域的权限和已有映射的页表项
+ * @param addr: 用户虚拟地址，需要按页对齐
+ * @param length: 长度
+ * @param prot: 新的权限，VMR_READ、VMR_WRITE 和 VMR_EXEC 的组合
+ * @return: 0 on success, -EINVAL 如果参数不合法, -ENOMEM 如果范围中有不属于任何区域的地址或者内存不足
+*/
+int sys_handle_mprotect(vaddr_t addr, size_t length, vmr_prop_t prot)
+{
+	struct vmspace *vms = get_current_vmspace();
+	size_t len = ROUND_UP(length, PAGE_SIZE);
+
+	if (addr % PAGE_SIZE || (prot & ~(VMR_READ | VMR_WRITE | VMR_EXEC)))
+		return -EINVAL;
+	if (len < length || addr >= USER_SPACE_END || len > USER_SPACE_END - addr)
+		return -EINVAL;
+	/* 同时修改区域的权限，之后缺页映射的页也使用新的权限 */
+	if (vms != NULL)
+		return vmspace_protect(vms, addr, len, prot);
+	return protect_range_in_pgtbl(get_current_user_pgtbl(), addr, len, prot, NULL);
+}
+
+/**
+ * @brief: 获取当前地址空间的工作集统计
+ * @param buf: 用户缓冲区
+ * @return: 0 on success, -EINVAL 如果当前CPU没有使用 vmspace, -EFAULT 如果buf不可写
+*/
+int sys_get_ws_stats(struct ws_stats *buf)
+{
+	struct vmspace *vms = get_current_vmspace();
+	struct ws_stats stats;
+
+	if (vms == NULL)
+		return -EINVAL;
+	vmspace_get_ws_stats(vms, &stats);
+	return copy_to_user(buf, &stats, sizeof(stats));
+}
+
+/**
+ * @brief: 获取当前地址空间页表的内存占用和映射粒度统计
+ * @param buf: 用户缓冲区
+ * @return: 0 on success, -EFAULT 如果buf不可写
+*/
+int sys_get_pgtbl_stats(struct pgtbl_stats *buf)
+{
+	struct vmspace *vms = get_current_vmspace();
+	struct pgtbl_stats stats;
+
+	/* 防止遍历时页表页被同一地址空间中的其他线程回收 */
+	if (vms != NULL)
+		read_lock(&vms->lock);
+	get_pgtbl_stats(get_current_user_pgtbl(), &stats);
+	if (vms != NULL)
+		read_unlock(&vms->lock);
+	return copy_to_user(buf, &stats, sizeof(stats));
+}
+
 const void *syscall_table[NR_SYSCALL] = {
 	[0 ... NR_SYSCALL - 1] = sys_null_placeholder,
+	[KMK_SYS_get_phys_addr] = sys_get_phys_addr,
+	[KMK_SYS_handle_mprotect] = sys_handle_mprotect,
 	[KMK_SYS_poweroff] = sys_poweroff,
+	[KMK_SYS_get_ws_stats] = sys_get_ws_stats,
+	[KMK_SYS_get_pgtbl_stats] = sys_get_pgtbl_stats,
 };